@@ -0,0 +1,237 @@
+#include <parg.h>
+#include <parwin.h>
+#include <GLFW/glfw3.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Microbenchmarks for the math headers and the per-draw camera math.  Each
+// one streams through arrays that fit in L1, so the times are throughput
+// rather than latency.  Build with -DVECTORMATH_FORCE_SCALAR to compare
+// against the scalar code.
+
+#define COUNT 256
+#define REPEAT 4000
+#define MIPMAP_REPEAT 4
+
+#define ASSET_TABLE(F) F(TEXTURE_TERRAIN, "terrainpts.png")
+ASSET_TABLE(PARG_TOKEN_DECLARE);
+
+static volatile float sink;
+
+static float frand() { return (float) rand() / RAND_MAX - 0.5f; }
+
+static Matrix4 random_matrix()
+{
+    Vector3 axis = V3Normalize((Vector3){frand(), frand(), frand()});
+    Matrix4 m = M4MakeRotationAxis(frand() * PARG_TWOPI, axis);
+    m.col3 = (Vector4){frand(), frand(), frand(), 1};
+    return m;
+}
+
+static void report(const char* name, double start, int count)
+{
+    double ns = (parg_profile_now() - start) * 1e9 / count;
+    printf("%-20s %8.2f ns  %8.1f M/s\n", name, ns, 1e3 / ns);
+}
+
+static void bench_vmath()
+{
+    Matrix4* mats = malloc(sizeof(Matrix4) * COUNT);
+    Matrix4* out = malloc(sizeof(Matrix4) * COUNT);
+    Vector3* vecs = malloc(sizeof(Vector3) * COUNT);
+    Point3* pts = malloc(sizeof(Point3) * COUNT);
+    float* coords = malloc(sizeof(float) * 3 * COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        mats[i] = random_matrix();
+        vecs[i] = (Vector3){frand(), frand(), frand()};
+        pts[i] = (Point3){frand(), frand(), frand()};
+        coords[i * 3] = pts[i].x;
+        coords[i * 3 + 1] = pts[i].y;
+        coords[i * 3 + 2] = pts[i].z;
+    }
+    Matrix4* xform = malloc(sizeof(Matrix4));
+    *xform = random_matrix();
+    int total = COUNT * REPEAT;
+
+    // Each pass feeds the next so that the repeats cannot be folded away.
+    double start = parg_profile_now();
+    for (int r = 0; r < REPEAT; r++) {
+        Matrix4* src = r % 2 ? out : mats;
+        Matrix4* dst = r % 2 ? mats : out;
+        for (int i = 0; i < COUNT; i++) {
+            dst[i] = M4Mul(*xform, src[i]);
+        }
+    }
+    report("M4Mul", start, total);
+    sink = mats[COUNT - 1].col0.x;
+
+    start = parg_profile_now();
+    for (int r = 0; r < REPEAT; r++) {
+        Matrix4* src = r % 2 ? out : mats;
+        Matrix4* dst = r % 2 ? mats : out;
+        for (int i = 0; i < COUNT; i++) {
+            dst[i] = M4Inverse(src[i]);
+        }
+    }
+    report("M4Inverse", start, total);
+    sink = mats[COUNT - 1].col0.x;
+
+    Vector4 sum = {0};
+    start = parg_profile_now();
+    for (int r = 0; r < REPEAT; r++) {
+        for (int i = 0; i < COUNT; i++) {
+            sum = V4Add(sum, M4MulP3(mats[i], pts[i]));
+        }
+    }
+    report("M4MulP3", start, total);
+    sink = sum.x;
+
+    Vector3 vsum = {0};
+    start = parg_profile_now();
+    for (int r = 0; r < REPEAT; r++) {
+        for (int i = 0; i < COUNT; i++) {
+            vsum = V3Add(vsum, V3Normalize(vecs[i]));
+        }
+    }
+    report("V3Normalize", start, total);
+    sink = vsum.x;
+
+    start = parg_profile_now();
+    for (int r = 0; r < REPEAT; r++) {
+        M4MulP3Array(coords, xform, coords, COUNT);
+    }
+    report("M4MulP3Array", start, total);
+    sink = coords[0];
+
+    start = parg_profile_now();
+    for (int r = 0; r < REPEAT; r++) {
+        V3NormalizeArray(coords, coords, COUNT);
+    }
+    report("V3NormalizeArray", start, total);
+    sink = coords[0];
+
+    free(xform);
+    free(mats);
+    free(out);
+    free(vecs);
+    free(pts);
+    free(coords);
+}
+
+// The per-draw MVPs of the marina demo, which draws four levels of photo
+// tiles.  The chained products in double precision are what it used to do
+// before parg_zcam_rte_mvp fused them.
+#define NUM_LEVELS 4
+
+static void bench_dmath()
+{
+    const int levels[NUM_LEVELS] = {5, 10, 15, 20};
+    const double tscale = 1280 / 256;
+    DMatrix4 models[NUM_LEVELS];
+    for (int j = 0; j < NUM_LEVELS; j++) {
+        double scale = tscale / pow(2, levels[j]);
+        models[j] = DM4MakeScale((DVector3){scale, scale, scale});
+    }
+    parg_zcam_init(1, 1, 32 * PARG_TWOPI / 180);
+    parg_zcam_set_position(0.3, 0.2, 0.0001);
+    parg_zcam_tick(1.5, 0);
+    DMatrix4 proj, view;
+    DPoint3 camerapos = parg_zcam_dmatrices(&proj, &view);
+    view = DM4MakeLookAt((DPoint3){0, 0, 0}, (DPoint3){0, 0, -1},
+        (DVector3){0, 1, 0});
+    DPoint3* photos = malloc(sizeof(DPoint3) * COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        photos[i] = (DPoint3){0.3 + frand() * 1e-4, 0.2 + frand() * 1e-4, 0};
+    }
+    int total = COUNT * REPEAT * NUM_LEVELS;
+
+    // Each pass starts at a different photo so that the repeats cannot be
+    // folded away.
+    Vector4 sum = {0};
+    double start = parg_profile_now();
+    for (int r = 0; r < REPEAT; r++) {
+        for (int i = 0; i < COUNT; i++) {
+            DPoint3 photo = photos[(i + r) % COUNT];
+            DVector3 offset = DP3Sub(photo, camerapos);
+            for (int j = 0; j < NUM_LEVELS; j++) {
+                DMatrix4 model = DM4Mul(DM4MakeTranslation(offset), models[j]);
+                Matrix4 mvp = M4MakeFromDM4(DM4Mul(proj, DM4Mul(view, model)));
+                sum = V4Add(sum, M4MulV4(mvp, (Vector4){1, 1, 1, 1}));
+            }
+        }
+    }
+    report("DM4Mul chain", start, total);
+    sink = sum.x;
+
+    sum = (Vector4){0};
+    start = parg_profile_now();
+    for (int r = 0; r < REPEAT; r++) {
+        for (int i = 0; i < COUNT; i++) {
+            DPoint3 photo = photos[(i + r) % COUNT];
+            for (int j = 0; j < NUM_LEVELS; j++) {
+                Matrix4 mvp = parg_zcam_rte_mvp(photo, models[j]);
+                sum = V4Add(sum, M4MulV4(mvp, (Vector4){1, 1, 1, 1}));
+            }
+        }
+    }
+    report("parg_zcam_rte_mvp", start, total);
+    sink = sum.x;
+
+    free(photos);
+}
+
+// Builds mipmapped textures from the 4096x2048 terrain image, timing
+// glGenerateMipmap against each CPU filter.  Both include the upload of
+// every level, and the times are per texel of the top level.  The first
+// texture of each kind is not timed.
+static void bench_mipmap(float winwidth, float winheight, float pixratio)
+{
+    const parg_mipmap_filter filters[] = {PARG_MIPMAP_DRIVER,
+        PARG_MIPMAP_BOX, PARG_MIPMAP_GAMMA, PARG_MIPMAP_MAX,
+        PARG_MIPMAP_KAISER};
+    const char* names[] = {"glGenerateMipmap", "box chain", "gamma chain",
+        "max chain", "kaiser chain"};
+    int* rawdata;
+    parg_buffer* buf =
+        parg_buffer_slurp_asset(TEXTURE_TERRAIN, (void*) &rawdata);
+    int width = rawdata[0], height = rawdata[1];
+    for (int f = 0; f < 5; f++) {
+        parg_texture_mipmap_filter(filters[f]);
+        double start = 0;
+        for (int r = -1; r < MIPMAP_REPEAT; r++) {
+            if (r == 0) {
+                start = parg_profile_now();
+            }
+            parg_texture* tex = parg_texture_from_u8(buf, width, height, 4,
+                3 * sizeof(int));
+            glFinish();
+            parg_texture_free(tex);
+        }
+        report(names[f], start, MIPMAP_REPEAT * width * height);
+    }
+    parg_texture_mipmap_filter(PARG_MIPMAP_DRIVER);
+    parg_buffer_free(buf);
+}
+
+int main(int argc, char* argv[])
+{
+    srand(1);
+    bench_vmath();
+    bench_dmath();
+
+    // The mipmap benchmark needs a context, so it runs from the init callback
+    // of a single offscreen frame.  Add "-headless egl" to run it without a
+    // display.
+    ASSET_TABLE(PARG_ASSET_TABLE);
+    char** args = malloc(sizeof(char*) * (argc + 2));
+    memcpy(args, argv, sizeof(char*) * argc);
+    args[argc] = "-frames";
+    args[argc + 1] = "1";
+    parg_window_setargs(argc + 2, args);
+    parg_window_oninit(bench_mipmap);
+    int result = parg_window_exec(256, 256, 0, 0);
+    free(args);
+    return result;
+}
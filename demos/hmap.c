@@ -6,7 +6,6 @@
 
 #include "lodepng.h"
 
-#define PAR_MSQUARES_IMPLEMENTATION
 #include <par/par_msquares.h>
 
 #define TOKEN_TABLE(F)            \
@@ -50,150 +49,165 @@ enum {
 #define CELLSIZE 32
 #define IMGWIDTH 1024
 #define IMGHEIGHT 1024
+#define BUMP_RADIUS 64
 
 int needs_draw = 1;
 int state = STATE_MULTI_RGBA;
+int nextstate = STATE_MULTI_RGBA;
 Matrix4 projection;
 Matrix4 view;
-parg_mesh* trimesh[48] = {0};
-uint32_t meshcolors[48];
+parg_msquares* trimesh = 0;
+parg_msquares* pending = 0;
+parg_msquares* meshcache[STATE_COUNT] = {0};
 parg_mesh* rectmesh;
 parg_texture* colortex;
 parg_texture* graytex;
 parg_buffer* graybuf;
 parg_buffer* colorbuf;
-int nmeshes = 0;
 
-static void create_mesh()
+// Starts meshing in the background for the next state, or returns null if the
+// next state does not have a mesh.  Every state has its own source image,
+// threshold, and flags, so meshes are cached by state.
+static parg_msquares* create_mesh()
 {
-    par_msquares_meshlist* mlist = 0;
+    if (meshcache[nextstate]) {
+        return meshcache[nextstate];
+    }
+    parg_msquares* mlist = 0;
     float threshold = 0;
     int flags = 0;
-    if (state == STATE_GRAY_DEFAULT) {
+    if (nextstate == STATE_GRAY_DEFAULT) {
         float const* graydata = parg_buffer_lock(graybuf, PARG_READ);
-        mlist = par_msquares_grayscale(
+        mlist = parg_msquares_grayscale(
             graydata, IMGWIDTH, IMGHEIGHT, CELLSIZE, threshold, flags);
         parg_buffer_unlock(graybuf);
-    } else if (state == STATE_GRAY_SIMPLIFY) {
+    } else if (nextstate == STATE_GRAY_SIMPLIFY) {
         float const* graydata = parg_buffer_lock(graybuf, PARG_READ);
         flags = PAR_MSQUARES_SIMPLIFY;
-        mlist = par_msquares_grayscale(
+        mlist = parg_msquares_grayscale(
             graydata, IMGWIDTH, IMGHEIGHT, CELLSIZE, threshold, flags);
         parg_buffer_unlock(graybuf);
-    } else if (state == STATE_GRAY_INVERT) {
+    } else if (nextstate == STATE_GRAY_INVERT) {
         float const* graydata = parg_buffer_lock(graybuf, PARG_READ);
         flags = PAR_MSQUARES_INVERT;
-        mlist = par_msquares_grayscale(
+        mlist = parg_msquares_grayscale(
             graydata, IMGWIDTH, IMGHEIGHT, CELLSIZE, threshold, flags);
         parg_buffer_unlock(graybuf);
-    } else if (state == STATE_GRAY_DUAL) {
+    } else if (nextstate == STATE_GRAY_DUAL) {
         float const* graydata = parg_buffer_lock(graybuf, PARG_READ);
         flags = PAR_MSQUARES_DUAL;
-        mlist = par_msquares_grayscale(
+        mlist = parg_msquares_grayscale(
             graydata, IMGWIDTH, IMGHEIGHT, CELLSIZE, threshold, flags);
         parg_buffer_unlock(graybuf);
-    } else if (state == STATE_GRAY_HEIGHTS) {
+    } else if (nextstate == STATE_GRAY_HEIGHTS) {
         float const* graydata = parg_buffer_lock(graybuf, PARG_READ);
         flags = PAR_MSQUARES_HEIGHTS;
-        mlist = par_msquares_grayscale(
+        mlist = parg_msquares_grayscale(
             graydata, IMGWIDTH, IMGHEIGHT, CELLSIZE, threshold, flags);
         parg_buffer_unlock(graybuf);
-    } else if (state == STATE_GRAY_DHS) {
+    } else if (nextstate == STATE_GRAY_DHS) {
         float const* graydata = parg_buffer_lock(graybuf, PARG_READ);
         flags = PAR_MSQUARES_DUAL | PAR_MSQUARES_HEIGHTS | PAR_MSQUARES_SNAP;
-        mlist = par_msquares_grayscale(
+        mlist = parg_msquares_grayscale(
             graydata, IMGWIDTH, IMGHEIGHT, CELLSIZE, threshold, flags);
         parg_buffer_unlock(graybuf);
-    } else if (state == STATE_GRAY_DHSC) {
+    } else if (nextstate == STATE_GRAY_DHSC) {
         float const* graydata = parg_buffer_lock(graybuf, PARG_READ);
         flags = PAR_MSQUARES_DUAL | PAR_MSQUARES_HEIGHTS | PAR_MSQUARES_SNAP |
             PAR_MSQUARES_CONNECT;
-        mlist = par_msquares_grayscale(
+        mlist = parg_msquares_grayscale(
             graydata, IMGWIDTH, IMGHEIGHT, CELLSIZE, threshold, flags);
         parg_buffer_unlock(graybuf);
-    } else if (state == STATE_GRAY_MULTI) {
+    } else if (nextstate == STATE_GRAY_MULTI) {
         float const* graydata = parg_buffer_lock(graybuf, PARG_READ);
         float thresholds[] = {0.0, 0.1};
         flags = PAR_MSQUARES_SIMPLIFY | PAR_MSQUARES_HEIGHTS |
             PAR_MSQUARES_SNAP | PAR_MSQUARES_CONNECT;
-        mlist = par_msquares_grayscale_multi(
+        mlist = parg_msquares_grayscale_multi(
             graydata, IMGWIDTH, IMGHEIGHT, CELLSIZE, thresholds, 2, flags);
         parg_buffer_unlock(graybuf);
-    } else if (state == STATE_COLOR_DEFAULT) {
+    } else if (nextstate == STATE_COLOR_DEFAULT) {
         parg_byte const* rgbadata = parg_buffer_lock(colorbuf, PARG_READ);
         rgbadata += sizeof(int) * 3;
-        mlist = par_msquares_color(
+        mlist = parg_msquares_color(
             rgbadata, IMGWIDTH, IMGHEIGHT, CELLSIZE, 0x214562, 4, flags);
         parg_buffer_unlock(colorbuf);
-    } else if (state == STATE_COLOR_IH) {
+    } else if (nextstate == STATE_COLOR_IH) {
         parg_byte const* rgbadata = parg_buffer_lock(colorbuf, PARG_READ);
         rgbadata += sizeof(int) * 3;
         flags = PAR_MSQUARES_INVERT | PAR_MSQUARES_HEIGHTS;
-        mlist = par_msquares_color(
+        mlist = parg_msquares_color(
             rgbadata, IMGWIDTH, IMGHEIGHT, CELLSIZE, 0x214562, 4, flags);
         parg_buffer_unlock(colorbuf);
-    } else if (state == STATE_COLOR_DHSCSI) {
+    } else if (nextstate == STATE_COLOR_DHSCSI) {
         parg_byte const* rgbadata = parg_buffer_lock(colorbuf, PARG_READ);
         rgbadata += sizeof(int) * 3;
         flags = PAR_MSQUARES_DUAL | PAR_MSQUARES_HEIGHTS | PAR_MSQUARES_SNAP |
             PAR_MSQUARES_CONNECT | PAR_MSQUARES_SIMPLIFY |
             PAR_MSQUARES_INVERT;
-        mlist = par_msquares_color(
+        mlist = parg_msquares_color(
             rgbadata, IMGWIDTH, IMGHEIGHT, CELLSIZE, 0x214562, 4, flags);
         parg_buffer_unlock(colorbuf);
-    } else if (state == STATE_MULTI_RGB) {
+    } else if (nextstate == STATE_MULTI_RGB) {
         unsigned dims[2] = {0, 0};
         unsigned char* pixels;
         lodepng_decode_file(
             &pixels, &dims[0], &dims[1], "extern/par/test/rgb.png", LCT_RGB, 8);
-        mlist = par_msquares_color_multi(
+        mlist = parg_msquares_color_multi(
             pixels, dims[0], dims[1], 16, 3, PAR_MSQUARES_SIMPLIFY);
         free(pixels);
-    } else if (state == STATE_MULTI_RGBA) {
+    } else if (nextstate == STATE_MULTI_RGBA) {
         unsigned dims[2] = {0, 0};
         unsigned char* pixels;
         lodepng_decode_file(&pixels, &dims[0], &dims[1],
             "extern/par/test/rgba.png", LCT_RGBA, 8);
-        mlist = par_msquares_color_multi(pixels, dims[0], dims[1], 16, 4,
+        mlist = parg_msquares_color_multi(pixels, dims[0], dims[1], 16, 4,
                 PAR_MSQUARES_HEIGHTS | PAR_MSQUARES_CONNECT |
                 PAR_MSQUARES_SIMPLIFY);
         free(pixels);
-    } else if (state == STATE_MULTI_DIAGRAM) {
+    } else if (nextstate == STATE_MULTI_DIAGRAM) {
         parg_byte const* rgbadata = parg_buffer_lock(colorbuf, PARG_READ);
         rgbadata += sizeof(int) * 3;
-        mlist = par_msquares_color_multi(rgbadata, IMGWIDTH, IMGHEIGHT,
+        mlist = parg_msquares_color_multi(rgbadata, IMGWIDTH, IMGHEIGHT,
                 CELLSIZE, 4, PAR_MSQUARES_SIMPLIFY | PAR_MSQUARES_HEIGHTS);
         parg_buffer_unlock(colorbuf);
     }
 
-    nmeshes = par_msquares_get_count(mlist);
-    printf("%d meshes\n", nmeshes);
-    for (int imesh = 0; imesh < nmeshes; imesh++) {
-        par_msquares_mesh const* mesh = par_msquares_get_mesh(mlist, imesh);
-
-        // mquares_mesh might have dimensionality of 2 or 3, while parg_mesh
-        // only
-        // supports the latter.  So, we potentially need to expand the data from
-        // vec2 to vec3.
+    meshcache[nextstate] = mlist;
+    return mlist;
+}
 
-        float* points = mesh->points;
-        if (mesh->dim == 2) {
-            points = malloc(mesh->npoints * sizeof(float) * 3);
-            for (int i = 0; i < mesh->npoints; i++) {
-                points[i * 3] = mesh->points[i * 2];
-                points[i * 3 + 1] = mesh->points[i * 2 + 1];
-                points[i * 3 + 2] = 0;
+// Raises a bump at a random spot in the height field, then re-meshes the
+// affected strips of every cached grayscale mesh.
+static void add_bump()
+{
+    int radius = BUMP_RADIUS;
+    int cx = rand() % IMGWIDTH, cy = rand() % IMGHEIGHT;
+    int x0 = PARG_MAX(cx - radius, 0), x1 = PARG_MIN(cx + radius, IMGWIDTH);
+    int y0 = PARG_MAX(cy - radius, 0), y1 = PARG_MIN(cy + radius, IMGHEIGHT);
+    float* graydata = parg_buffer_lock(graybuf, PARG_MODIFY);
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            float dx = (float) (x - cx) / radius;
+            float dy = (float) (y - cy) / radius;
+            float d2 = dx * dx + dy * dy;
+            if (d2 < 1) {
+                graydata[y * IMGWIDTH + x] += 0.2 * (1 - d2) * (1 - d2);
             }
         }
-        meshcolors[imesh] = mesh->color;
-        trimesh[imesh] = parg_mesh_create(
-            points, mesh->npoints, mesh->triangles, mesh->ntriangles);
-        if (mesh->dim == 2) {
-            free(points);
+    }
+    for (int i = STATE_GRAY_DEFAULT; i <= STATE_GRAY_MULTI; i++) {
+        if (meshcache[i]) {
+            parg_msquares_edit(
+                meshcache[i], graydata, x0, y0, x1 - x0, y1 - y0);
         }
     }
-
-    par_msquares_free(mlist);
+    parg_buffer_unlock(graybuf);
+    // Redraw when the visible mesh is ready, unless another state's mesh is
+    // already on its way.
+    if (!pending && state >= STATE_GRAY_DEFAULT && state <= STATE_GRAY_MULTI) {
+        pending = trimesh;
+    }
 }
 
 void init(float winwidth, float winheight, float pixratio)
@@ -214,7 +228,7 @@ void init(float winwidth, float winheight, float pixratio)
     colortex =
         parg_texture_from_u8(colorbuf, width, height, ncomps, 3 * sizeof(int));
     graybuf = parg_buffer_from_asset(BIN_ISLAND);
-    graytex = parg_texture_from_fp32(graybuf, IMGWIDTH, IMGHEIGHT, 1, 0);
+    graytex = parg_texture_from_fp16(graybuf, IMGWIDTH, IMGHEIGHT, 1, 0);
     const float h = 1.5f;
     const float w = h * winwidth / winheight;
     const float znear = 10;
@@ -225,6 +239,7 @@ void init(float winwidth, float winheight, float pixratio)
     Vector3 up = {0, 1, 0};
     view = M4MakeLookAt(eye, target, up);
     rectmesh = parg_mesh_rectangle(20, 20);
+    pending = create_mesh();
 }
 
 void draw()
@@ -290,14 +305,6 @@ void draw()
         break;
     }
 
-    if (mesh) {
-        for (int i = 0; i < sizeof(trimesh) / sizeof(trimesh[0]); i++) {
-            parg_mesh_free(trimesh[i]);
-        }
-        memset(trimesh, 0, sizeof(trimesh));
-        create_mesh();
-    }
-
     Matrix4 model;
     if (mesh) {
         model = M4MakeScale(V3MakeFromElems(20, 20, 10));
@@ -310,22 +317,20 @@ void draw()
     Matrix4 mvp = M4Mul(projection, modelview);
     parg_uniform_matrix4f(U_MVP, &mvp);
     parg_draw_clear();
-    if (mesh) {
+    if (mesh && trimesh) {
         Vector4 colors[3];
         colors[0] = (Vector4){0, 0.6, 0.9, 1};
         colors[1] = (Vector4){0, 0.9, 0.6, 1};
         colors[2] = (Vector4){0.9, 0.6, 0, 1};
         Vector4 black = {0, 0, 0, 1.0};
 
-        for (int imesh = 0; imesh < nmeshes; imesh++) {
-            parg_varray_enable(parg_mesh_coord(trimesh[imesh]), A_POSITION, 3,
-                PARG_FLOAT, 0, 0);
-            parg_varray_bind(parg_mesh_index(trimesh[imesh]));
+        for (int imesh = 0; imesh < parg_msquares_count(trimesh); imesh++) {
             if (meshcolor) {
-                unsigned int b = meshcolors[imesh] & 0xff;
-                unsigned int g = (meshcolors[imesh] >> 8) & 0xff;
-                unsigned int r = (meshcolors[imesh] >> 16) & 0xff;
-                unsigned int a = (meshcolors[imesh] >> 24) & 0xff;
+                uint32_t tmcolor = parg_msquares_get_color(trimesh, imesh);
+                unsigned int b = tmcolor & 0xff;
+                unsigned int g = (tmcolor >> 8) & 0xff;
+                unsigned int r = (tmcolor >> 16) & 0xff;
+                unsigned int a = (tmcolor >> 24) & 0xff;
                 Vector4 color;
                 color.x = r / 255.0f;
                 color.y = g / 255.0f;
@@ -335,10 +340,9 @@ void draw()
             } else {
                 parg_uniform4f(U_COLOR, &colors[imesh]);
             }
-            parg_draw_triangles_u16(0, parg_mesh_ntriangles(trimesh[imesh]));
+            parg_msquares_draw(trimesh, imesh, A_POSITION);
             parg_uniform4f(U_COLOR, &black);
-            parg_draw_wireframe_triangles_u16(
-                0, parg_mesh_ntriangles(trimesh[imesh]));
+            parg_msquares_draw_wireframe(trimesh, imesh, A_POSITION);
         }
 
     } else {
@@ -361,8 +365,8 @@ void dispose()
     parg_texture_free(colortex);
     parg_texture_free(graytex);
     parg_buffer_free(graybuf);
-    for (int i = 0; i < sizeof(trimesh) / sizeof(trimesh[0]); i++) {
-        parg_mesh_free(trimesh[i]);
+    for (int i = 0; i < STATE_COUNT; i++) {
+        parg_msquares_free(meshcache[i]);
     }
 }
 
@@ -370,13 +374,27 @@ void input(parg_event evt, float code, float unused0, float unused1)
 {
     int key = (char) code;
     if ((evt == PARG_EVENT_KEYPRESS && key == ' ') || evt == PARG_EVENT_UP) {
-        state = (state + 1) % STATE_COUNT;
-        needs_draw = 1;
+        nextstate = (nextstate + 1) % STATE_COUNT;
+        pending = create_mesh();
+        if (!pending) {
+            state = nextstate;
+            needs_draw = 1;
+        }
+    } else if (evt == PARG_EVENT_KEYPRESS && key == 'B') {
+        add_bump();
     }
 }
 
 int tick(float seconds, float winwidth, float winheight, float pixratio)
 {
+    // Keep showing the current state until the next mesh is ready.
+    if (pending && parg_msquares_done(pending)) {
+        trimesh = pending;
+        pending = 0;
+        state = nextstate;
+        needs_draw = 1;
+        printf("%d meshes\n", parg_msquares_count(trimesh));
+    }
     int retval = needs_draw;
     needs_draw = 0;
     return retval;
@@ -385,6 +403,7 @@ int tick(float seconds, float winwidth, float winheight, float pixratio)
 int main(int argc, char* argv[])
 {
     printf("Spacebar to cycle the msquares test.\n");
+    printf("B to add a bump to the height field.\n");
     TOKEN_TABLE(PARG_TOKEN_DEFINE);
     ASSET_TABLE(PARG_ASSET_TABLE);
     parg_window_setargs(argc, argv);
@@ -5,13 +5,14 @@
 #include <stdio.h>
 #include <string.h>
 
-#define TOKEN_TABLE(F)          \
-    F(P_TEXTURED, "p_textured") \
-    F(P_HIGHP, "p_highp")       \
-    F(A_POSITION, "a_position") \
-    F(A_TEXCOORD, "a_texcoord") \
-    F(U_MVP, "u_mvp")           \
-    F(U_EYEPOS, "u_eyepos")     \
+#define TOKEN_TABLE(F)                          \
+    F(P_TEXTURED, "p_textured")                 \
+    F(P_HIGHP, "p_highp")                       \
+    F(A_POSITION, "a_position")                 \
+    F(A_POSITION_LOWPART, "a_position_lowpart") \
+    F(A_TEXCOORD, "a_texcoord")                 \
+    F(U_MVP, "u_mvp")                           \
+    F(U_EYEPOS, "u_eyepos")                     \
     F(U_EYEPOS_LOWPART, "u_eyepos_lowpart")
 TOKEN_TABLE(PARG_TOKEN_DECLARE);
 
@@ -38,6 +39,7 @@ parg_texture* marina_textures[NUM_LEVELS];
 parg_texture* origin_texture;
 parg_texture* doggies_texture;
 parg_buffer* lines_buffer;
+parg_buffer* lines_lowpart;
 DVector3 photo_position = {0};
 parg_mesh* tile_mesh;
 parg_mesh* photo_mesh;
@@ -63,18 +65,19 @@ void init(float winwidth, float winheight, float pixratio)
         sds name = sdsnew("marina_z");
         name = sdscatprintf(name, "%02d.png", levels[i]);
         parg_token id = parg_token_from_string(name);
-        marina_textures[i] = parg_texture_from_asset(id);
+        marina_textures[i] =
+            parg_texture_from_asset_compressed(id, PARG_TEXTURE_BC1);
         sdsfree(name);
     }
     doggies_texture = parg_texture_from_asset(TEXTURE_DOGGIES);
     parg_texture_info(doggies_texture, &imgwidth, &imgheight);
     photo_mesh = parg_mesh_rectangle(1, (float) imgheight / imgwidth);
-    int nverts = 4;
+    DPoint3 origin = {photo_position.x, photo_position.y, photo_position.z};
+    parg_mesh_set_origin(photo_mesh, origin);
 
-    // Populate a single-precision buffer of vec2's for the lines.
-    int vstride = sizeof(float) * 2;
-    lines_buffer = parg_buffer_alloc(nverts * vstride, PARG_GPU_ARRAY);
-    float* plines = parg_buffer_lock(lines_buffer, PARG_WRITE);
+    // Split the line endpoints into high and low parts.
+    double lines[8];
+    double* plines = lines;
     *plines++ = photo_position.x;
     *plines++ = -1;
     *plines++ = photo_position.x;
@@ -83,15 +86,15 @@ void init(float winwidth, float winheight, float pixratio)
     *plines++ = photo_position.y;
     *plines++ = 1;
     *plines++ = photo_position.y;
-    parg_buffer_unlock(lines_buffer);
+    lines_buffer = parg_buffer_from_doubles(lines, 8, &lines_lowpart);
 }
 
 void draw()
 {
     double scale;
-    DMatrix4 view, projection, model;
+    DMatrix4 model;
+    DPoint3 origin = {0, 0, 0};
     Matrix4 mvp;
-    parg_zcam_dmatrices(&projection, &view);
     parg_draw_clear();
 
     // First, draw the map "tiles" (these aren't really slippy map tiles)
@@ -102,15 +105,15 @@ void draw()
         parg_mesh_uv(tile_mesh), A_TEXCOORD, 2, PARG_FLOAT, 0, 0);
     scale = tscale / pow(2, 2);
     model = DM4MakeScale((DVector3){scale, scale, scale});
-    mvp = M4MakeFromDM4(DM4Mul(projection, DM4Mul(view, model)));
+    mvp = parg_zcam_rte_mvp(origin, model);
     parg_texture_bind(origin_texture, 0);
     parg_uniform_matrix4f(U_MVP, &mvp);
     parg_draw_one_quad();
+    DPoint3 photo = parg_mesh_origin(photo_mesh);
     for (int i = 0; i < NUM_LEVELS; i++) {
         scale = tscale / pow(2, levels[i]);
-        model = DM4Mul(DM4MakeTranslation(photo_position),
-                DM4MakeScale((DVector3){scale, scale, scale}));
-        mvp = M4MakeFromDM4(DM4Mul(projection, DM4Mul(view, model)));
+        model = DM4MakeScale((DVector3){scale, scale, scale});
+        mvp = parg_zcam_rte_mvp(photo, model);
         parg_texture_bind(marina_textures[i], 0);
         parg_uniform_matrix4f(U_MVP, &mvp);
         parg_draw_one_quad();
@@ -129,16 +132,20 @@ void draw()
     parg_uniform_point(U_EYEPOS, &eyepos);
     parg_uniform_point(U_EYEPOS_LOWPART, &eyepos_lowpart);
     parg_varray_enable(lines_buffer, A_POSITION, 2, PARG_FLOAT, 0, 0);
+    if (mode_highp) {
+        parg_varray_enable(
+            lines_lowpart, A_POSITION_LOWPART, 2, PARG_FLOAT, 0, 0);
+    }
     parg_draw_lines(2);
+    parg_varray_disable(A_POSITION_LOWPART);
 
     // Draw the photo.
     parg_shader_bind(P_TEXTURED);
     parg_varray_enable(
         parg_mesh_coord(photo_mesh), A_POSITION, 2, PARG_FLOAT, 0, 0);
     scale = tscale / pow(2, 25);
-    model = DM4Mul(DM4MakeTranslation(photo_position),
-            DM4MakeScale((DVector3){scale, scale, scale}));
-    mvp = M4MakeFromDM4(DM4Mul(projection, DM4Mul(view, model)));
+    model = DM4MakeScale((DVector3){scale, scale, scale});
+    mvp = parg_zcam_rte_mvp(photo, model);
     parg_texture_bind(doggies_texture, 0);
     parg_uniform_matrix4f(U_MVP, &mvp);
     parg_draw_one_quad();
@@ -153,6 +160,7 @@ int tick(float winwidth, float winheight, float pixratio, float seconds)
 void dispose()
 {
     parg_buffer_free(lines_buffer);
+    parg_buffer_free(lines_lowpart);
     parg_mesh_free(tile_mesh);
     parg_mesh_free(photo_mesh);
     parg_texture_free(origin_texture);
@@ -6,6 +6,7 @@
 
 static const int WINSIZE = 256;
 static const int NASTEROIDS = 3;
+static const float TIMESTEP = 0.01666;
 
 #define TOKEN_TABLE(F)              \
     F(P_BACKGROUND, "p_background") \
@@ -19,6 +20,7 @@ static const int NASTEROIDS = 3;
     F(U_POSITIONS, "u_positions")   \
     F(U_PROPERTIES, "u_properties") \
     F(U_DELTASQR, "u_deltasqr")     \
+    F(U_ALPHA, "u_alpha")           \
     F(U_BUFSIZE, "u_bufsize")       \
     F(U_TIME, "u_time")
 TOKEN_TABLE(PARG_TOKEN_DECLARE);
@@ -115,10 +117,35 @@ static void message(const char* msg)
     }
 }
 
-static void draw()
+static int update(float seconds, float dt)
 {
-    const float TIMESTEP = 0.01666;
+    if (!app.playing) {
+        return 0;
+    }
+    if (app.nparticles != app.bufsize * app.bufsize) {
+        dispose_particles();
+        create_particles();
+    }
+    parg_shader_bind(P_PHYSICS);
+    parg_varray_enable(
+        parg_mesh_coord(app.quadmesh), A_POSITION, 2, PARG_FLOAT, 0, 0);
+    parg_varray_enable(
+        parg_mesh_uv(app.quadmesh), A_TEXCOORD, 2, PARG_FLOAT, 0, 0);
+    parg_uniform1i(U_POSITIONS, 0);
+    parg_uniform1i(U_PROPERTIES, 1);
+    parg_uniform1f(U_DELTASQR, dt * dt);
+    parg_framebuffer_bindtex(app.particle_positionsa, 0);
+    parg_framebuffer_bindtex(app.particle_properties, 1);
+    parg_framebuffer_pushfbo(app.particle_positionsb, 0);
+    parg_draw_one_quad();
+    parg_framebuffer_popfbo();
+    parg_framebuffer_swap(app.particle_positionsa, app.particle_positionsb);
+    parg_varray_disable(A_TEXCOORD);
+    return 1;
+}
 
+static void draw()
+{
     if (app.nparticles != app.bufsize * app.bufsize) {
         dispose_particles();
         create_particles();
@@ -132,17 +159,6 @@ static void draw()
     parg_varray_enable(uvs, A_TEXCOORD, 2, PARG_FLOAT, 0, 0);
     parg_texture_bind(app.bkgdtex, 0);
     parg_draw_one_quad();
-
-    parg_shader_bind(P_PHYSICS);
-    parg_uniform1i(U_POSITIONS, 0);
-    parg_uniform1i(U_PROPERTIES, 1);
-    parg_uniform1f(U_DELTASQR, TIMESTEP * TIMESTEP);
-    parg_framebuffer_bindtex(app.particle_positionsa, 0);
-    parg_framebuffer_bindtex(app.particle_properties, 1);
-    parg_framebuffer_pushfbo(app.particle_positionsb, 0);
-    parg_draw_one_quad();
-    parg_framebuffer_popfbo();
-    parg_framebuffer_swap(app.particle_positionsa, app.particle_positionsb);
     parg_varray_disable(A_TEXCOORD);
 
     parg_shader_bind(P_ASTEROIDS);
@@ -161,6 +177,7 @@ static void draw()
     parg_framebuffer_bindtex(app.particle_positionsa, 0);
     parg_uniform1i(U_POSITIONS, 0);
     parg_uniform1f(U_BUFSIZE, app.bufsize);
+    parg_uniform1f(U_ALPHA, app.playing ? parg_window_alpha() : 0);
     parg_draw_points(app.nparticles);
     parg_state_blending(0);
 }
@@ -186,7 +203,7 @@ static void init(float winwidth, float winheight, float pixratio)
         parg_buffer_create(asteroids, nbytes, PARG_GPU_ARRAY);
 
     create_particles();
-    draw();
+    update(0, TIMESTEP);
 }
 
 static void dispose()
@@ -226,7 +243,7 @@ static void input(parg_event evt, float x, float y, float z)
 static int tick(float winwidth, float winheight, float pixratio, float seconds)
 {
     app.current_time = seconds;
-    return app.playing;
+    return 0;
 }
 
 int main(int argc, char* argv[])
@@ -239,6 +256,7 @@ int main(int argc, char* argv[])
     parg_window_oninit(init);
     parg_window_ontick(tick);
     parg_window_ondraw(draw);
+    parg_window_onupdate(update, TIMESTEP);
     parg_window_onexit(dispose);
     parg_window_oninput(input);
     parg_window_onmessage(message);
@@ -11,6 +11,7 @@ uniform float u_time;
 uniform float u_npoints;
 uniform float u_deltasqr;
 uniform float u_bufsize;
+uniform float u_alpha;
 uniform sampler2D u_image;
 uniform sampler2D u_positions;
 uniform sampler2D u_properties;
@@ -22,6 +23,7 @@ const float NCOLS = 5.0;
 const float ROTSPEED = 40.0;
 const float BRIGHTEN = 1.75;
 const float DARKEN = 1.0;
+const int SUBSTEPS = 5;
 
 // http://www.iquilezles.org/www/articles/palettes/palettes.htm
 vec3 select_color(float t)
@@ -63,7 +65,7 @@ void main()
     vec2 current_position = postexel.rg;
     vec2 previous_position = postexel.ba;
 
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < SUBSTEPS; i++) {
         float d = distance(asteroid_position, current_position);
         d = max(d, 0.2); // stability!
         vec2 force_direction = (asteroid_position - current_position) / d;
@@ -113,7 +115,11 @@ void main()
     float u = mod(a_position, u_bufsize);
     float v = floor(a_position / u_bufsize);
     vec4 texel = texture2D(u_positions, vec2(u, v) / u_bufsize);
-    gl_Position = vec4(texel.xy, 0, 1);
+
+    // Carries the particle forward by the part of a step that has elapsed
+    // since the latest physics update.
+    vec2 velocity = (texel.xy - texel.zw) * float(SUBSTEPS);
+    gl_Position = vec4(texel.xy + velocity * u_alpha, 0, 1);
     gl_PointSize = 8.0;
 }
 
@@ -40,10 +40,15 @@ ASSET_TABLE(PARG_TOKEN_DECLARE);
 parg_buffer* ptsvbo;
 parg_texture* terraintex;
 parg_mesh* backquad;
+parg_pointcloud* pointcloud;
 float pointscale = 1;
+float fbwidth = 1;
 const float fovy = 16 * PARG_TWOPI / 180;
 const float worldwidth = 1;
 const int maxpts = 1400000;
+const float pointsize = 20;
+const float density = 0.1;
+const int leafsize = 4096;
 const unsigned int ocean_color = 0xFFB2B283;
 
 #define clamp(x, min, max) ((x < min) ? min : ((x > max) ? max : x))
@@ -52,6 +57,8 @@ const unsigned int ocean_color = 0xFFB2B283;
 void init(float winwidth, float winheight, float pixratio)
 {
     backquad = parg_mesh_rectangle(1, 0.5);
+    float worldheight = worldwidth * sqrt(0.75);
+    Vector2 mapsize = {worldwidth, worldheight};
 
 #if DO_BAKE
 
@@ -73,6 +80,7 @@ void init(float winwidth, float winheight, float pixratio)
 
     printf("Generating point sequence...\n");
     float* cpupts = par_bluenoise_generate_exact(ctx, maxpts, 3);
+    pointcloud = parg_pointcloud_create(cpupts, maxpts, mapsize, leafsize);
     ptsvbo = parg_buffer_alloc(maxpts * 12, PARG_GPU_ARRAY);
     float* gpupts = parg_buffer_lock(ptsvbo, PARG_WRITE);
     memcpy(gpupts, cpupts, parg_buffer_length(ptsvbo));
@@ -90,8 +98,13 @@ void init(float winwidth, float winheight, float pixratio)
 #else
 
     parg_buffer* filevbo = parg_buffer_from_asset(BUFFER_TERRAIN);
-    ptsvbo = parg_buffer_dup(filevbo, PARG_GPU_ARRAY);
+    parg_buffer* cpuvbo = parg_buffer_dup(filevbo, PARG_CPU);
     parg_buffer_free(filevbo);
+    float* cpupts = parg_buffer_lock(cpuvbo, PARG_WRITE);
+    pointcloud = parg_pointcloud_create(cpupts, maxpts, mapsize, leafsize);
+    parg_buffer_unlock(cpuvbo);
+    ptsvbo = parg_buffer_dup(cpuvbo, PARG_GPU_ARRAY);
+    parg_buffer_free(cpuvbo);
 
 #endif
 
@@ -102,7 +115,6 @@ void init(float winwidth, float winheight, float pixratio)
     parg_state_cullfaces(0);
     parg_state_blending(1);
     parg_shader_load_from_asset(SHADER_SIMPLE);
-    float worldheight = worldwidth * sqrt(0.75);
     parg_zcam_init(worldwidth, worldheight, fovy);
     parg_zcam_grab_update(0.5, 0.5, 30.0);
 }
@@ -134,15 +146,35 @@ void draw()
     parg_uniform_matrix4f(U_MVP, &mvp);
     parg_uniform_point(U_EYEPOS, &eyepos);
     parg_uniform1f(U_MAGNIFICATION, parg_zcam_get_magnification());
-    parg_uniform1f(U_DENSITY, 0.1f);
-    parg_uniform1f(U_POINTSIZE, 20.0f * pointscale);
+    parg_uniform1f(U_DENSITY, density);
+    parg_uniform1f(U_POINTSIZE, pointsize * pointscale);
     parg_varray_enable(ptsvbo, A_POSITION, 3, PARG_FLOAT, 0, 0);
-    parg_draw_points(maxpts);
+
+    // Grow the viewport by one point radius so that points centered just
+    // outside of it are still drawn.
+    parg_aar rect = parg_zcam_get_rectangle();
+    float radius = 0.5 * pointsize * pointscale;
+    radius *= parg_aar_width(rect) / fbwidth;
+    rect.left -= radius;
+    rect.bottom -= radius;
+    rect.right += radius;
+    rect.top += radius;
+
+    // The shader fades out points whose rank exceeds mag^2 / density, so
+    // only the rank prefix below that needs to be drawn.
+    float mag = parg_zcam_get_magnification();
+    const int* ranges;
+    int nranges =
+        parg_pointcloud_query(pointcloud, rect, mag * mag / density, &ranges);
+    for (int i = 0; i < nranges; i++) {
+        parg_draw_points_range(ranges[i * 2], ranges[i * 2 + 1]);
+    }
 }
 
 int tick(float winwidth, float winheight, float pixratio, float seconds)
 {
     pointscale = pixratio;
+    fbwidth = winwidth * pixratio;
     parg_zcam_tick(winwidth / winheight, seconds);
     return parg_zcam_has_moved();
 }
@@ -154,6 +186,7 @@ void dispose()
     parg_buffer_free(ptsvbo);
     parg_texture_free(terraintex);
     parg_mesh_free(backquad);
+    parg_pointcloud_free(pointcloud);
 }
 
 void input(parg_event evt, float x, float y, float z)
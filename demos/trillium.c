@@ -22,17 +22,30 @@ TOKEN_TABLE(PARG_TOKEN_DECLARE);
     F(BUFFER_BLUENOISE, "bluenoise.trimmed.bin")
 ASSET_TABLE(PARG_TOKEN_DECLARE);
 
-parg_buffer* ptsvbo;
+parg_pointstream* stream;
 par_bluenoise_context* ctx;
 float pointscale = 1;
 const float gray = 0.8;
 const float fovy = 16 * PARG_TWOPI / 180;
 const float worldwidth = 1;
 const int maxpts = 100000;
+const int streamsize = 400000;
+const float density = 40000;
 
 #define clamp(x, min, max) ((x < min) ? min : ((x > max) ? max : x))
 #define sqr(a) (a * a)
 
+// This runs on the point stream's worker thread, which is the only user of
+// the bluenoise context after initialization.  The density is scaled down
+// by the tile's share of the viewport so that the visible tiles together
+// draw about as many points as a single viewport-sized generation did.
+static float* generate(parg_aar rect, float share, int* npts, void* userdata)
+{
+    par_bluenoise_set_viewport(
+        ctx, rect.left, rect.bottom, rect.right, rect.top);
+    return par_bluenoise_generate(ctx, density * share, npts);
+}
+
 void init(float winwidth, float winheight, float pixratio)
 {
     parg_buffer* buffer;
@@ -47,31 +60,18 @@ void init(float winwidth, float winheight, float pixratio)
     par_bluenoise_density_from_gray(ctx, buffer_data + 12, 3500, 3500, 4);
     parg_buffer_free(buffer);
 
-    ptsvbo = parg_buffer_alloc(maxpts * sizeof(float) * 3, PARG_GPU_ARRAY);
     parg_state_clearcolor((Vector4){gray, gray, gray, 1});
     parg_state_depthtest(0);
     parg_state_cullfaces(0);
     parg_shader_load_from_asset(SHADER_SIMPLE);
     float worldheight = worldwidth;
     parg_zcam_init(worldwidth, worldheight, fovy);
+    Vector2 mapsize = {worldwidth, worldheight};
+    stream = parg_pointstream_create(mapsize, streamsize, generate, 0);
 }
 
 void draw()
 {
-    float lbrt[4];
-    parg_zcam_get_viewport(lbrt);
-    float left = lbrt[0];
-    float bottom = lbrt[1];
-    float right = lbrt[2];
-    float top = lbrt[3];
-    par_bluenoise_set_viewport(ctx, left, bottom, right, top);
-
-    int npts;
-    float* cpupts = par_bluenoise_generate(ctx, 40000, &npts);
-    float* gpupts = parg_buffer_lock(ptsvbo, PARG_WRITE);
-    memcpy(gpupts, cpupts, npts * 3 * sizeof(float));
-    parg_buffer_unlock(ptsvbo);
-
     Matrix4 view;
     Matrix4 projection;
     parg_zcam_matrices(&projection, &view);
@@ -82,21 +82,28 @@ void draw()
     parg_shader_bind(P_SIMPLE);
     parg_uniform_matrix4f(U_MVP, &mvp);
     parg_uniform1f(U_POINTSIZE, 2.5f * pointscale);
-    parg_varray_enable(ptsvbo, A_POSITION, 3, PARG_FLOAT, 0, 0);
-    parg_draw_points(npts);
+    parg_varray_enable(
+        parg_pointstream_buffer(stream), A_POSITION, 3, PARG_FLOAT, 0, 0);
+    const int* ranges;
+    int nranges = parg_pointstream_ranges(stream, &ranges);
+    for (int i = 0; i < nranges; i++) {
+        parg_draw_points_range(ranges[i * 2], ranges[i * 2 + 1]);
+    }
 }
 
 int tick(float winwidth, float winheight, float pixratio, float seconds)
 {
     pointscale = pixratio;
     parg_zcam_tick(winwidth / winheight, seconds);
-    return parg_zcam_has_moved();
+    int changed = parg_pointstream_tick(stream, parg_zcam_get_rectangle());
+    return parg_zcam_has_moved() || changed;
 }
 
 void dispose()
 {
     parg_shader_free(P_SIMPLE);
-    parg_buffer_free(ptsvbo);
+    parg_pointstream_free(stream);
+    par_bluenoise_free(ctx);
 }
 
 void input(parg_event evt, float x, float y, float z)
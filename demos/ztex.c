@@ -4,20 +4,24 @@
 #include <sds.h>
 #include <stdio.h>
 
-#define PAR_MSQUARES_IMPLEMENTATION
 #include <par/par_msquares.h>
 
-#define TOKEN_TABLE(F)                              \
-    F(P_LANDMASS, "p_landmass")                     \
-    F(P_LANDMASS_FRAGCOORD, "p_landmass_fragcoord") \
-    F(P_OCEAN, "p_ocean")                           \
-    F(P_SOLID, "p_solid")                           \
-    F(A_POSITION, "a_position")                     \
-    F(U_MVP, "u_mvp")                               \
-    F(U_COLOR, "u_color")                           \
-    F(U_SHOWGRID, "u_showgrid")                     \
-    F(U_SLIPPYBOX, "u_slippybox")                   \
-    F(U_SLIPPYFRACT, "u_slippyfract")
+#define TOKEN_TABLE(F)                \
+    F(P_LANDMASS, "p_landmass")       \
+    F(P_OCEAN, "p_ocean")             \
+    F(P_SOLID, "p_solid")             \
+    F(F_FRAGCOORD, "FRAGCOORD")       \
+    F(F_SHOWGRID, "SHOWGRID")         \
+    F(F_VTEX, "VTEX")                 \
+    F(A_POSITION, "a_position")       \
+    F(U_MVP, "u_mvp")                 \
+    F(U_COLOR, "u_color")             \
+    F(U_SLIPPYBOX, "u_slippybox")     \
+    F(U_SLIPPYFRACT, "u_slippyfract") \
+    F(U_ATLAS, "u_atlas")             \
+    F(U_INDIRECTION, "u_indirection") \
+    F(U_VTEX, "u_vtex")               \
+    F(U_VTEXWINDOW, "u_vtexwindow")
 TOKEN_TABLE(PARG_TOKEN_DECLARE);
 
 #define ASSET_TABLE(F)              \
@@ -31,23 +35,53 @@ const Vector3 TARGETPOS = {0.35287, 0.005156, 0.000005};
 const float DEMO_DURATION = 6;
 const double STARTZ = 1.2;
 const float fovy = 16 * PARG_TWOPI / 180;
+const int VTEX_TILESIZE = 128;
+const float PREFETCH_TIME = 0.25;
 int mode_highp = 1;
-float current_time;
-float mode_demo_start = 0;
 int mode_demo_direction = 1;
 int showgrid = 0;
+int mode_vtex = 0;
 parg_mesh* landmass_mesh;
 parg_mesh* ocean_mesh;
+parg_quadtree* landmass_quadtree;
+parg_quadtree* ocean_quadtree;
 parg_texture* ocean_texture;
 parg_texture* paper_texture;
+parg_vtex* europe_vtex;
 Vector2 fbsize;
 
+// Centers the mesh at the origin and sorts its triangles for culling.
+static parg_quadtree* create_quadtree(parg_msquares_mesh* mesh)
+{
+    Vector2 mapsize = {1, 1};
+    for (int i = 0; i < mesh->npoints; i++) {
+        mesh->points[i * 3] -= 0.5;
+        mesh->points[i * 3 + 1] -= 0.5;
+    }
+    return parg_quadtree_from_triangles(
+        mesh->points, 3, mesh->triangles, mesh->ntriangles, mapsize);
+}
+
+static void draw_visible(parg_quadtree* quadtree, parg_aar rect, int wireframe)
+{
+    const int* ranges;
+    int nranges = parg_quadtree_query(quadtree, rect, &ranges);
+    for (int i = 0; i < nranges; i++) {
+        if (wireframe) {
+            parg_draw_wireframe_triangles_u16(ranges[i * 2], ranges[i * 2 + 1]);
+        } else {
+            parg_draw_triangles_u16(ranges[i * 2], ranges[i * 2 + 1]);
+        }
+    }
+}
+
 void init(float winwidth, float winheight, float pixratio)
 {
     printf(
         "Spacebar to toggle texture modes.\n"
         "D to toggle auto-zooming demo mode.\n"
-        "G to toggle the slippy map grid.\n");
+        "G to toggle the slippy map grid.\n"
+        "V to toggle the streamed europe texture.\n");
     parg_state_clearcolor((Vector4){0.43, 0.61, 0.8, 1});
     parg_state_cullfaces(1);
     parg_state_depthtest(0);
@@ -57,39 +91,45 @@ void init(float winwidth, float winheight, float pixratio)
     ocean_texture = parg_texture_from_asset(TEXTURE_OCEAN);
     paper_texture = parg_texture_from_asset(TEXTURE_PAPER);
 
-    // Decode the europe image.
+    // Stream the europe image through a virtual texture.
+    Vector2 mapsize = {1, 1};
+    europe_vtex =
+        parg_vtex_from_asset(mapsize, TEXTURE_EUROPE, VTEX_TILESIZE);
+
+    // The meshes are built from the decoded image, which is then freed.
     int* rawdata;
     parg_buffer* colorbuf =
         parg_buffer_slurp_asset(TEXTURE_EUROPE, (void*) &rawdata);
     int width = *rawdata++;
     int height = *rawdata++;
     int ncomps = *rawdata++;
+    assert(ncomps == 4);
     parg_texture_fliprows(rawdata, width * ncomps, height);
 
     // Sample the ocean color from one corner of the image.
     int ocean_color = rawdata[0];
 
     // Perform marching squares and generate a mesh.
-    par_msquares_meshlist* mlist = par_msquares_color((parg_byte*) rawdata,
+    parg_msquares* mlist = parg_msquares_color((parg_byte*) rawdata,
             width, height, 16, ocean_color, 4, PAR_MSQUARES_SWIZZLE |
             PAR_MSQUARES_DUAL | PAR_MSQUARES_HEIGHTS | PAR_MSQUARES_SIMPLIFY);
-    par_msquares_mesh const* mesh;
-    mesh = par_msquares_get_mesh(mlist, 0);
+    parg_buffer_free(colorbuf);
+    parg_msquares_mesh* mesh;
+    mesh = parg_msquares_get_mesh(mlist, 0);
+    landmass_quadtree = create_quadtree(mesh);
     landmass_mesh = parg_mesh_create(
         mesh->points, mesh->npoints, mesh->triangles, mesh->ntriangles);
-    mesh = par_msquares_get_mesh(mlist, 1);
+    mesh = parg_msquares_get_mesh(mlist, 1);
+    ocean_quadtree = create_quadtree(mesh);
     ocean_mesh = parg_mesh_create(
         mesh->points, mesh->npoints, mesh->triangles, mesh->ntriangles);
-    parg_buffer_unlock(colorbuf);
-    par_msquares_free(mlist);
+    parg_msquares_free(mlist);
 }
 
 void draw()
 {
-    DMatrix4 view, projection;
-    parg_zcam_dmatrices(&projection, &view);
-    DMatrix4 model = DM4MakeTranslation((DVector3){-0.5, -0.5, -1});
-    Matrix4 mvp = M4MakeFromDM4(DM4Mul(projection, DM4Mul(view, model)));
+    DPoint3 origin = {0, 0, -1};
+    Matrix4 mvp = parg_zcam_rte_mvp(origin, DM4MakeIdentity());
     const Vector4 BLACK = {0, 0, 0, 1};
 
     Vector2 mapsize = {1, 1};
@@ -97,28 +137,29 @@ void draw()
     parg_tilerange tiles;
     float slippyfract = parg_aar_to_tilerange(rect, mapsize, &tiles);
     parg_aar slippyaar = parg_aar_from_tilename(tiles.mintile, mapsize);
-    Vector4* slippybox = (Vector4*) &slippyaar;
-    slippybox->z = 1.0 / (slippybox->z - slippybox->x);
-    slippybox->w = 1.0 / (slippybox->w - slippybox->y);
+    Vector4 slipbox = {slippyaar.left, slippyaar.bottom,
+        1.0 / (slippyaar.right - slippyaar.left),
+        1.0 / (slippyaar.top - slippyaar.bottom)};
+    Vector4* slippybox = &slipbox;
 
     parg_draw_clear();
-    parg_shader_bind(P_OCEAN);
+    parg_shader_bind_variant(
+        P_OCEAN, parg_shader_feature(P_OCEAN, F_SHOWGRID, showgrid));
     parg_uniform_matrix4f(U_MVP, &mvp);
-    parg_uniform1i(U_SHOWGRID, showgrid);
     parg_uniform4f(U_SLIPPYBOX, slippybox);
     parg_uniform1f(U_SLIPPYFRACT, slippyfract);
     parg_texture_bind(ocean_texture, 0);
     parg_varray_bind(parg_mesh_index(ocean_mesh));
     parg_varray_enable(
         parg_mesh_coord(ocean_mesh), A_POSITION, 3, PARG_FLOAT, 0, 0);
-    parg_draw_triangles_u16(0, parg_mesh_ntriangles(ocean_mesh));
+    draw_visible(ocean_quadtree, rect, 0);
     parg_shader_bind(P_SOLID);
     parg_uniform_matrix4f(U_MVP, &mvp);
     parg_uniform4f(U_COLOR, &BLACK);
     parg_varray_bind(parg_mesh_index(landmass_mesh));
     parg_varray_enable(
         parg_mesh_coord(landmass_mesh), A_POSITION, 3, PARG_FLOAT, 0, 0);
-    parg_draw_wireframe_triangles_u16(0, parg_mesh_ntriangles(landmass_mesh));
+    draw_visible(landmass_quadtree, rect, 1);
 
     if (mode_highp) {
         float x = parg_aar_width(rect) / fbsize.x;
@@ -129,38 +170,66 @@ void draw()
         slippybox->y = (slippybox->y - rect.bottom) / y;
     }
 
-    parg_shader_bind(mode_highp ? P_LANDMASS_FRAGCOORD : P_LANDMASS);
+    uint32_t features = parg_shader_feature(P_LANDMASS, F_SHOWGRID, showgrid) |
+        parg_shader_feature(P_LANDMASS, F_FRAGCOORD, mode_highp) |
+        parg_shader_feature(P_LANDMASS, F_VTEX, mode_vtex);
+    parg_shader_bind_variant(P_LANDMASS, features);
     parg_uniform_matrix4f(U_MVP, &mvp);
-    parg_uniform1i(U_SHOWGRID, showgrid);
     parg_uniform4f(U_SLIPPYBOX, slippybox);
     parg_uniform1f(U_SLIPPYFRACT, slippyfract);
     parg_texture_bind(paper_texture, 0);
-    parg_draw_triangles_u16(0, parg_mesh_ntriangles(landmass_mesh));
+    if (mode_vtex) {
+        int nslots, tilesize;
+        Vector4 window;
+        parg_vtex_info(europe_vtex, &nslots, &tilesize, &window);
+        parg_vtex_bind(europe_vtex, 1, 2);
+        parg_uniform1i(U_ATLAS, 1);
+        parg_uniform1i(U_INDIRECTION, 2);
+        parg_uniform2f(U_VTEX, nslots, tilesize);
+        parg_uniform4f(U_VTEXWINDOW, &window);
+    }
+    draw_visible(landmass_quadtree, rect, 0);
+}
+
+// Flies to the target, or back to the starting view, whichever is next.
+static void toggle_demo()
+{
+    if (!parg_zcam_is_settled()) {
+        return;
+    }
+    mode_demo_direction = 1 - mode_demo_direction;
+    Vector3 pos = {0, 0, STARTZ};
+    if (!mode_demo_direction) {
+        pos = TARGETPOS;
+    }
+    float half = pos.z * tan(fovy / 2);
+    parg_aar rect = {pos.x - half, pos.y - half, pos.x + half, pos.y + half};
+    parg_zcam_fly_to(rect, DEMO_DURATION);
 }
 
 int tick(float winwidth, float winheight, float pixratio, float seconds)
 {
-    current_time = seconds;
     fbsize.x = winwidth * pixratio;
     fbsize.y = winheight * pixratio;
     parg_zcam_tick(winwidth / winheight, seconds);
-    if (mode_demo_start) {
-        double t = (current_time - mode_demo_start) / DEMO_DURATION;
-        if (t >= 1) {
-            mode_demo_start = 0;
-        }
-        float scrolldelta = mode_demo_direction ? -3 : 3;
-        parg_zcam_grab_update(TARGETPOS.x, TARGETPOS.y, scrolldelta);
+    int uploaded = 0;
+    if (mode_vtex) {
+        parg_aar predicted = parg_zcam_get_predicted_rectangle(PREFETCH_TIME);
+        uploaded = parg_vtex_tick(
+            europe_vtex, parg_zcam_get_rectangle(), predicted, fbsize.x);
     }
-    return parg_zcam_has_moved();
+    return parg_zcam_has_moved() || uploaded;
 }
 
 void dispose()
 {
     parg_mesh_free(landmass_mesh);
     parg_mesh_free(ocean_mesh);
+    parg_quadtree_free(landmass_quadtree);
+    parg_quadtree_free(ocean_quadtree);
     parg_texture_free(ocean_texture);
     parg_texture_free(paper_texture);
+    parg_vtex_free(europe_vtex);
 }
 
 void input(parg_event evt, float x, float y, float z)
@@ -175,11 +244,11 @@ void input(parg_event evt, float x, float y, float z)
         } else if (key == 'G') {
             showgrid = 1 - showgrid;
             parg_zcam_touch();
+        } else if (key == 'V') {
+            mode_vtex = 1 - mode_vtex;
+            parg_zcam_touch();
         } else if (key == 'D') {
-            if (!mode_demo_start) {
-                mode_demo_start = current_time;
-                mode_demo_direction = 1 - mode_demo_direction;
-            }
+            toggle_demo();
         }
         break;
     case PARG_EVENT_DOWN:
@@ -205,11 +274,11 @@ void message(const char* msg)
     } else if (!strcmp(msg, "grid")) {
         showgrid = 1 - showgrid;
         parg_zcam_touch();
+    } else if (!strcmp(msg, "vtex")) {
+        mode_vtex = 1 - mode_vtex;
+        parg_zcam_touch();
     } else if (!strcmp(msg, "demo")) {
-        if (!mode_demo_start) {
-            mode_demo_start = current_time;
-            mode_demo_direction = 1 - mode_demo_direction;
-        }
+        toggle_demo();
     }
 }
 
@@ -1,15 +1,17 @@
 
-// @program p_landmass, vertex, landmass
-// @program p_landmass_fragcoord, vertex, landmass_fragcoord
-// @program p_ocean, vertex, ocean
+// @program p_landmass, vertex, landmass, FRAGCOORD?, SHOWGRID?, VTEX?
+// @program p_ocean, vertex, ocean, SHOWGRID?
 // @program p_solid, vertex, solid
 
 uniform mat4 u_mvp;
 uniform vec4 u_color;
 uniform vec4 u_slippybox;
 uniform float u_slippyfract;
-uniform bool u_showgrid;
 uniform sampler2D u_texture;
+uniform sampler2D u_atlas;
+uniform sampler2D u_indirection;
+uniform vec2 u_vtex;
+uniform vec4 u_vtexwindow;
 varying vec2 v_texcoord;
 
 const float LANDMASS_TEXTURE_FREQUENCY = 4.0;
@@ -19,15 +21,28 @@ const vec4 LANDMASS_COLOR = vec4(0.5, 0.7, 0.6, 1.0);
 vec4 sample(vec2 uv)
 {
     vec4 texel = texture2D(u_texture, uv);
-    if (u_showgrid) {
-        uv = mod(uv, vec2(1));
-        vec2 del = abs(vec2(0.5) - uv);
-        vec2 m = 0.5 * smoothstep(0.5, 0.45, del);
-        texel *= m.x * m.y + 0.5;
-    }
+#ifdef SHOWGRID
+    uv = mod(uv, vec2(1));
+    vec2 del = abs(vec2(0.5) - uv);
+    vec2 m = 0.5 * smoothstep(0.5, 0.45, del);
+    texel *= m.x * m.y + 0.5;
+#endif
     return texel;
 }
 
+// Each indirection texel holds the atlas slot and level of the finest
+// resident tile; u_vtex has the slots per side and the tile size, and
+// u_vtexwindow maps the texcoord into the indirection window.
+vec4 vtex_sample(vec2 uv)
+{
+    vec2 page = (uv - u_vtexwindow.xy) * u_vtexwindow.zw;
+    vec3 entry = floor(texture2D(u_indirection, page).rgb * 255.0 + 0.5);
+    vec2 local = fract(uv * exp2(entry.b));
+    float inset = 0.5 / u_vtex.y;
+    local = clamp(local, inset, 1.0 - inset);
+    return texture2D(u_atlas, (entry.rg + local) / u_vtex.x);
+}
+
 -- vertex
 
 attribute vec4 a_position;
@@ -35,7 +50,7 @@ attribute vec4 a_position;
 void main()
 {
     gl_Position = u_mvp * a_position;
-    v_texcoord = a_position.xy;
+    v_texcoord = a_position.xy + 0.5;
 }
 
 -- ocean
@@ -58,22 +73,18 @@ void main()
 
 void main()
 {
-    vec2 tex_offset = v_texcoord - u_slippybox.xy;
-    vec2 uv = tex_offset * u_slippybox.zw;
-    vec4 texel0 = sample(uv * LANDMASS_TEXTURE_FREQUENCY);
-    vec4 texel1 = sample(uv * LANDMASS_TEXTURE_FREQUENCY * 2.0);
-    vec4 mixed = mix(texel0, texel1, u_slippyfract);
-    gl_FragColor = LANDMASS_COLOR * mixed;
-}
-
--- landmass_fragcoord
-
-void main()
-{
+#ifdef FRAGCOORD
     vec2 tex_offset = gl_FragCoord.xy - u_slippybox.xy;
+#else
+    vec2 tex_offset = v_texcoord - u_slippybox.xy;
+#endif
     vec2 uv = tex_offset * u_slippybox.zw;
     vec4 texel0 = sample(uv * LANDMASS_TEXTURE_FREQUENCY);
     vec4 texel1 = sample(uv * LANDMASS_TEXTURE_FREQUENCY * 2.0);
     vec4 mixed = mix(texel0, texel1, u_slippyfract);
+#ifdef VTEX
+    gl_FragColor = vtex_sample(v_texcoord) * mixed;
+#else
     gl_FragColor = LANDMASS_COLOR * mixed;
+#endif
 }
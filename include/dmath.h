@@ -33,6 +33,19 @@
 
 #include <math.h>
 
+/* SSE2 and AVX paths for the double-precision matrix products, selected from
+   the target flags unless VECTORMATH_FORCE_SCALAR is defined.  Loads and
+   stores are unaligned.
+ */
+#if !defined(VECTORMATH_FORCE_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define _DVECTORMATH_SIMD_SSE2 1
+#if defined(__AVX__)
+#include <immintrin.h>
+#define _DVECTORMATH_SIMD_AVX 1
+#endif
+#endif
+
 #ifdef _DVECTORMATH_DEBUG
 #include <stdio.h>
 #endif
@@ -5714,6 +5727,24 @@ static inline void dmathM4GetRow(
 static inline void dmathM4Transpose(
     DmathMatrix4* result, const DmathMatrix4* mat)
 {
+#ifdef _DVECTORMATH_SIMD_SSE2
+    /* Transposes the four 2x2 blocks and swaps the off-diagonal ones. */
+    const double* m = &mat->col0.x;
+    __m128d a0 = _mm_loadu_pd(m), a1 = _mm_loadu_pd(m + 4);
+    __m128d b0 = _mm_loadu_pd(m + 2), b1 = _mm_loadu_pd(m + 6);
+    __m128d c0 = _mm_loadu_pd(m + 8), c1 = _mm_loadu_pd(m + 12);
+    __m128d d0 = _mm_loadu_pd(m + 10), d1 = _mm_loadu_pd(m + 14);
+    double* r = &result->col0.x;
+    _mm_storeu_pd(r, _mm_unpacklo_pd(a0, a1));
+    _mm_storeu_pd(r + 2, _mm_unpacklo_pd(c0, c1));
+    _mm_storeu_pd(r + 4, _mm_unpackhi_pd(a0, a1));
+    _mm_storeu_pd(r + 6, _mm_unpackhi_pd(c0, c1));
+    _mm_storeu_pd(r + 8, _mm_unpacklo_pd(b0, b1));
+    _mm_storeu_pd(r + 10, _mm_unpacklo_pd(d0, d1));
+    _mm_storeu_pd(r + 12, _mm_unpackhi_pd(b0, b1));
+    _mm_storeu_pd(r + 14, _mm_unpackhi_pd(d0, d1));
+    return;
+#endif
     DmathMatrix4 tmpResult;
     dmathV4MakeFromElems(
         &tmpResult.col0, mat->col0.x, mat->col1.x, mat->col2.x, mat->col3.x);
@@ -5909,6 +5940,32 @@ static inline void dmathM4ScalarMul(
 static inline void dmathM4MulV4(
     DmathVector4* result, const DmathMatrix4* mat, const DmathVector4* vec)
 {
+#if defined(_DVECTORMATH_SIMD_AVX)
+    __m256d sum = _mm256_mul_pd(
+        _mm256_loadu_pd(&mat->col0.x), _mm256_set1_pd(vec->x));
+    sum = _mm256_add_pd(sum,
+        _mm256_mul_pd(_mm256_loadu_pd(&mat->col1.x), _mm256_set1_pd(vec->y)));
+    sum = _mm256_add_pd(sum,
+        _mm256_mul_pd(_mm256_loadu_pd(&mat->col2.x), _mm256_set1_pd(vec->z)));
+    sum = _mm256_add_pd(sum,
+        _mm256_mul_pd(_mm256_loadu_pd(&mat->col3.x), _mm256_set1_pd(vec->w)));
+    _mm256_storeu_pd(&result->x, sum);
+    return;
+#elif defined(_DVECTORMATH_SIMD_SSE2)
+    /* Each half of the column is two doubles wide. */
+    const double* m = &mat->col0.x;
+    __m128d v[4] = {_mm_set1_pd(vec->x), _mm_set1_pd(vec->y),
+        _mm_set1_pd(vec->z), _mm_set1_pd(vec->w)};
+    __m128d lo = _mm_mul_pd(_mm_loadu_pd(m), v[0]);
+    __m128d hi = _mm_mul_pd(_mm_loadu_pd(m + 2), v[0]);
+    for (int i = 1; i < 4; i++) {
+        lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(m + i * 4), v[i]));
+        hi = _mm_add_pd(hi, _mm_mul_pd(_mm_loadu_pd(m + i * 4 + 2), v[i]));
+    }
+    _mm_storeu_pd(&result->x, lo);
+    _mm_storeu_pd(&result->z, hi);
+    return;
+#endif
     double tmpX, tmpY, tmpZ, tmpW;
     tmpX = ((((mat->col0.x * vec->x) + (mat->col1.x * vec->y)) +
         (mat->col2.x * vec->z)) +
@@ -8971,3 +9028,61 @@ static inline DVector3 DV3MakeFromV3(Vector3 sv)
     v.z = sv.z;
     return v;
 }
+
+/* Computes the float matrix a * b * c one column at a time, without forming
+   the intermediate double-precision products.
+ */
+static inline Matrix4 M4MakeFromDM4Mul3(DMatrix4 a, DMatrix4 b, DMatrix4 c)
+{
+    Matrix4 m;
+    const DVector4* src = &c.col0;
+    float* dst = &m.col0.x;
+    for (int i = 0; i < 4; i++, dst += 4) {
+        DVector4 t, col;
+        dmathM4MulV4(&t, &b, src + i);
+        dmathM4MulV4(&col, &a, &t);
+#if defined(_DVECTORMATH_SIMD_AVX)
+        _mm_storeu_ps(dst, _mm256_cvtpd_ps(_mm256_loadu_pd(&col.x)));
+#elif defined(_DVECTORMATH_SIMD_SSE2)
+        _mm_storeu_ps(dst, _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(&col.x)),
+            _mm_cvtpd_ps(_mm_loadu_pd(&col.z))));
+#else
+        dst[0] = col.x;
+        dst[1] = col.y;
+        dst[2] = col.z;
+        dst[3] = col.w;
+#endif
+    }
+    return m;
+}
+
+/* Splits count doubles into their float approximations and the float
+   remainders, for hi/lo vertex attributes.
+ */
+static inline void DSplitArray(
+    float* hi, float* lo, const double* src, int count)
+{
+    int i = 0;
+#ifdef _DVECTORMATH_SIMD_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128d d0 = _mm_loadu_pd(src + i);
+        __m128d d1 = _mm_loadu_pd(src + i + 2);
+        __m128 h0 = _mm_cvtpd_ps(d0);
+        __m128 h1 = _mm_cvtpd_ps(d1);
+        __m128 l0 = _mm_cvtpd_ps(_mm_sub_pd(d0, _mm_cvtps_pd(h0)));
+        __m128 l1 = _mm_cvtpd_ps(_mm_sub_pd(d1, _mm_cvtps_pd(h1)));
+        _mm_storeu_ps(hi + i, _mm_movelh_ps(h0, h1));
+        _mm_storeu_ps(lo + i, _mm_movelh_ps(l0, l1));
+    }
+#endif
+    for (; i < count; i++) {
+        hi[i] = src[i];
+        lo[i] = src[i] - hi[i];
+    }
+}
+
+static inline void DP3SplitArray(
+    Point3* hi, Point3* lo, const DPoint3* src, int count)
+{
+    DSplitArray(&hi->x, &lo->x, &src->x, count * 3);
+}
@@ -67,6 +67,8 @@ parg_token parg_token_from_string(const char*);
     parg_asset_preload(NAME);
 #define PARG_ASSET_LIST(VAL) parg_asset_preload(parg_token_from_string(VAL));
 void parg_asset_preload(parg_token id);
+void parg_asset_watch(int enabled);
+int parg_asset_poll();
 
 // BUFFERS
 
@@ -78,6 +80,8 @@ parg_buffer* parg_buffer_dup(parg_buffer*, parg_buffer_type);
 void parg_buffer_free(parg_buffer*);
 int parg_buffer_length(parg_buffer*);
 void* parg_buffer_lock(parg_buffer*, parg_buffer_mode);
+void* parg_buffer_lock_range(
+    parg_buffer*, int offset, int nbytes, parg_buffer_mode);
 void parg_buffer_unlock(parg_buffer*);
 void parg_buffer_gpu_bind(parg_buffer*);
 int parg_buffer_gpu_check(parg_buffer*);
@@ -87,6 +91,20 @@ void parg_buffer_to_file(parg_buffer*, const char* filepath);
 parg_buffer* parg_buffer_to_gpu(parg_buffer* buf, parg_buffer_type memtype);
 parg_buffer* parg_buffer_from_file(const char* filepath);
 
+// Splits doubles into a GPU array of their float approximations and a GPU
+// array of the remainders, for vertex shaders that subtract a hi/lo eye
+// position (see parg_zcam_highprec).
+parg_buffer* parg_buffer_from_doubles(
+    const double* src, int count, parg_buffer** lowpart);
+
+// Batch operations on packed 3-float elements, run with the vmath batch
+// kernels across worker threads for large buffers.  Sources must be CPU
+// buffers; the destination may be a GPU buffer, or the same buffer as a
+// source.
+void parg_buffer_transform(parg_buffer* dst, parg_buffer* src, Matrix4 mat);
+void parg_buffer_normalize(parg_buffer* dst, parg_buffer* src);
+void parg_buffer_cross(parg_buffer* dst, parg_buffer* a, parg_buffer* b);
+
 // AXIS-ALIGNED RECTANGLE
 
 typedef struct {
@@ -110,6 +128,55 @@ parg_aar parg_aar_stretch_to_square(parg_aar rect);
 float parg_aar_height(parg_aar rect);
 float parg_aar_width(parg_aar rect);
 
+// QUADTREE
+
+// Spatial index aligned with the slippy tile scheme.  Building reorders the
+// given points (stride is in floats) or triangles in place so that each node
+// covers one contiguous range.  Queries return {first, count} pairs that are
+// merged where adjacent and remain valid until the next query.
+typedef struct parg_quadtree_s parg_quadtree;
+parg_quadtree* parg_quadtree_from_points(
+    float* pts, int npts, int stride, Vector2 mapsize);
+parg_quadtree* parg_quadtree_from_triangles(const float* pts, int stride,
+    uint16_t* tris, int ntris, Vector2 mapsize);
+int parg_quadtree_query(parg_quadtree*, parg_aar viewport, const int** ranges);
+void parg_quadtree_free(parg_quadtree*);
+
+// POINT CLOUDS
+
+// Level-of-detail structure for progressive point sets such as blue noise,
+// where any prefix of the sequence is a valid lower-density sample.  Points
+// are XYZ where Z is the rank.  Creation reorders them in place.  Queries
+// return {first, count} pairs that cover the visible points whose rank is
+// below maxrank.  They remain valid until the next query.
+typedef struct parg_pointcloud_s parg_pointcloud;
+parg_pointcloud* parg_pointcloud_create(
+    float* pts, int npts, Vector2 mapsize, int leafsize);
+int parg_pointcloud_query(parg_pointcloud*, parg_aar viewport,
+    float maxrank, const int** ranges);
+void parg_pointcloud_free(parg_pointcloud*);
+
+// POINT STREAMS
+
+// Caches generated points per tile and streams them into a GPU ring buffer
+// of XYZ points, where Z is a progressive rank as for point clouds.  Tiles
+// are two levels finer than the viewport's tile range, so each spans a
+// quarter to a half of the viewport's extent.  The generator runs on a
+// worker thread and returns points that stay valid until its next call.
+// It is given the largest fraction of the viewport's area that the tile
+// will cover, and only the rank prefix for the tile's current share is
+// drawn.  The tick function returns 1 if the ranges to draw have changed;
+// the ranges are {first, count} pairs into the buffer.
+typedef struct parg_pointstream_s parg_pointstream;
+typedef float* (*parg_pointstream_generator)(
+    parg_aar rect, float share, int* npts, void* userdata);
+parg_pointstream* parg_pointstream_create(Vector2 mapsize, int capacity,
+    parg_pointstream_generator generator, void* userdata);
+int parg_pointstream_tick(parg_pointstream*, parg_aar viewport);
+parg_buffer* parg_pointstream_buffer(parg_pointstream*);
+int parg_pointstream_ranges(parg_pointstream*, const int** ranges);
+void parg_pointstream_free(parg_pointstream*);
+
 // MESHES
 
 typedef struct parg_mesh_s parg_mesh;
@@ -132,29 +199,130 @@ parg_buffer* parg_mesh_index(parg_mesh* m);
 int parg_mesh_ntriangles(parg_mesh* m);
 void parg_mesh_compute_normals(parg_mesh* m);
 void parg_mesh_send_to_gpu(parg_mesh* m);
+void parg_mesh_set_origin(parg_mesh* m, DPoint3 origin);
+DPoint3 parg_mesh_origin(parg_mesh* m);
+
+// MARCHING SQUARES
+
+// Background job that splits the image into strips of cells, meshes them
+// with par_msquares in parallel, and welds the strips back together.  The
+// pixels are copied, and the flags are PAR_MSQUARES_* values.  Points are
+// always XYZ, normalized by the larger image dimension.  Editing copies a
+// rectangle of pixels from an image of the original size and format, then
+// re-meshes only the strips that it overlaps.  The accessors return the
+// meshes of the last finished job and wait only if no job has finished yet;
+// the done function never blocks and returns 1 once every edit is meshed.
+// Drawing uploads each strip of a mesh into its own range of a vertex
+// buffer and an index buffer that are shared by every mesh, and only
+// re-meshed strips are written again.
+typedef struct parg_msquares_s parg_msquares;
+typedef struct {
+    float* points;
+    int npoints;
+    uint16_t* triangles;
+    int ntriangles;
+    uint32_t color;
+} parg_msquares_mesh;
+parg_msquares* parg_msquares_grayscale(const float* data, int width,
+    int height, int cellsize, float threshold, int flags);
+parg_msquares* parg_msquares_grayscale_multi(const float* data, int width,
+    int height, int cellsize, const float* thresholds, int nthresholds,
+    int flags);
+parg_msquares* parg_msquares_color(const parg_byte* data, int width,
+    int height, int cellsize, uint32_t color, int bpp, int flags);
+parg_msquares* parg_msquares_color_multi(const parg_byte* data, int width,
+    int height, int cellsize, int bpp, int flags);
+void parg_msquares_edit(parg_msquares*, const void* data, int x, int y,
+    int width, int height);
+int parg_msquares_done(parg_msquares*);
+int parg_msquares_count(parg_msquares*);
+parg_msquares_mesh* parg_msquares_get_mesh(parg_msquares*, int mesh);
+uint32_t parg_msquares_get_color(parg_msquares*, int mesh);
+void parg_msquares_draw(parg_msquares*, int mesh, parg_token position);
+void parg_msquares_draw_wireframe(
+    parg_msquares*, int mesh, parg_token position);
+void parg_msquares_free(parg_msquares*);
 
 // SHADERS
 
 void parg_shader_load_from_buffer(parg_buffer*);
 void parg_shader_load_from_asset(parg_token id);
 void parg_shader_bind(parg_token);
+void parg_shader_bind_variant(parg_token, uint32_t features);
+uint32_t parg_shader_feature(parg_token program, parg_token feature, int val);
 void parg_shader_free(parg_token);
 
 // TEXTURES
 
 typedef struct parg_texture_s parg_texture;
+typedef enum {
+    PARG_TEXTURE_RAW,
+    PARG_TEXTURE_BC1,
+    PARG_TEXTURE_BC3,
+    PARG_TEXTURE_ETC1
+} parg_texture_codec;
+typedef enum {
+    PARG_MIPMAP_DRIVER,
+    PARG_MIPMAP_BOX,
+    PARG_MIPMAP_GAMMA,
+    PARG_MIPMAP_MAX,
+    PARG_MIPMAP_KAISER
+} parg_mipmap_filter;
 parg_texture* parg_texture_from_buffer(parg_buffer* rgba);
 parg_texture* parg_texture_from_asset(parg_token id);
 parg_texture* parg_texture_from_asset_linear(parg_token id);
+parg_texture* parg_texture_from_asset_compressed(
+    parg_token id, parg_texture_codec codec);
+
+// The following accept 1 to 4 components, which map to ALPHA,
+// LUMINANCE_ALPHA, RGB, and RGBA.  The fp16 variant takes fp32 data and
+// converts it to half floats before uploading.
 parg_texture* parg_texture_from_fp32(
     parg_buffer* buf, int width, int height, int ncomps, int bytoffset);
+parg_texture* parg_texture_from_fp16(
+    parg_buffer* buf, int width, int height, int ncomps, int bytoffset);
 parg_texture* parg_texture_from_u8(
     parg_buffer* buf, int width, int height, int ncomps, int byteoffset);
+parg_texture* parg_texture_from_u16(
+    parg_buffer* buf, int width, int height, int ncomps, int byteoffset);
 void parg_texture_bind(parg_texture*, int stage);
 void parg_texture_info(parg_texture*, int* width, int* height);
 void parg_texture_free(parg_texture*);
 void parg_texture_fliprows(void* data, int rowsize, int nrows);
 
+// Selects how subsequently created textures get their mipmaps.  DRIVER uses
+// glGenerateMipmap, the others build the chain on the CPU.  KAISER is a
+// windowed sinc, which is sharper than BOX but slower.
+void parg_texture_mipmap_filter(parg_mipmap_filter);
+
+// VIRTUAL TEXTURES
+
+// Streams square tiles of a large map texture into a fixed-size atlas.  The
+// loader runs on worker threads, fills tilesize x tilesize bottom-up RGBA,
+// and returns zero if the tile is unavailable.  The indirection texture
+// stores the atlas slot and level of the finest resident tile for a window
+// of tiles around the viewport; the info function returns the window as an
+// offset (xy) and scale (zw) from map texture coordinates to indirection
+// texture coordinates.  The tick function requests tiles for the current
+// viewport and prefetches tiles for the predicted one, returning 1 if any
+// tiles were uploaded.  On desktop, a virtual texture made from a PNG asset
+// bakes its tiles next to the executable and decodes them on demand, so the
+// decoded asset can be freed once it returns.
+typedef struct parg_vtex_s parg_vtex;
+typedef int (*parg_vtex_loader)(
+    parg_tilename tile, parg_byte* rgba, void* userdata);
+parg_vtex* parg_vtex_create(Vector2 mapsize, int tilesize, int maxlevel,
+    int nslots, parg_vtex_loader loader, void* userdata);
+parg_vtex* parg_vtex_from_image(Vector2 mapsize, const parg_byte* rgba,
+    int width, int height, int tilesize);
+parg_vtex* parg_vtex_from_asset(Vector2 mapsize, parg_token id, int tilesize);
+int parg_vtex_tick(
+    parg_vtex*, parg_aar viewport, parg_aar predicted, float fbwidth);
+void parg_vtex_bind(parg_vtex*, int atlas_stage, int indirection_stage);
+void parg_vtex_info(
+    parg_vtex*, int* nslots, int* tilesize, Vector4* window);
+void parg_vtex_free(parg_vtex*);
+
 // UNIFORMS
 
 void parg_uniform1i(parg_token tok, int val);
@@ -189,6 +357,7 @@ void parg_draw_triangles_u16(int start, int count);
 void parg_draw_wireframe_triangles_u16(int start, int count);
 void parg_draw_lines(int nsegments);
 void parg_draw_points(int npoints);
+void parg_draw_points_range(int start, int count);
 
 // MAP CAMERA
 
@@ -197,16 +366,66 @@ void parg_zcam_tick(float window_aspect, float seconds);
 float parg_zcam_get_magnification();
 void parg_zcam_get_viewport(float* lbrt);
 parg_aar parg_zcam_get_rectangle();
+
+// Extrapolates the viewport from the smoothed pan velocity and zoom rate
+// observed across calls to parg_zcam_tick.
+parg_aar parg_zcam_get_predicted_rectangle(float seconds_ahead);
 void parg_zcam_grab_begin(float winx, float winy);
 void parg_zcam_grab_update(float winx, float winy, float scrolldelta);
 void parg_zcam_grab_end();
 Point3 parg_zcam_matrices(Matrix4* proj, Matrix4* view);
 DPoint3 parg_zcam_dmatrices(DMatrix4* proj, DMatrix4* view);
 void parg_zcam_highprec(Matrix4* vp, Point3* eyepos_lo, Point3* eyepos_hi);
+
+// Computes the MVP in double precision with the eye at the origin, for
+// geometry whose coordinates are relative to the given world-space origin.
+// Only the small camera-relative result is rounded to float, so deep zooms
+// do not jitter.
+Matrix4 parg_zcam_rte_mvp(DPoint3 origin, DMatrix4 model);
 int parg_zcam_has_moved();
 void parg_zcam_touch();
 void parg_zcam_set_position(double x, double y, double z);
 
+// Animates towards a view that encloses the given rectangle along a smooth
+// zoom-and-pan path.  Scroll zooms and released pans are also eased over
+// time by parg_zcam_tick; the camera is settled once none of these motions
+// are in progress.
+void parg_zcam_fly_to(parg_aar rect, float duration);
+int parg_zcam_is_settled();
+
+// The functions above drive a default camera.  Each of them has a
+// counterpart that takes an explicit camera, so several views can be
+// driven at once, each from its own thread if need be.
+typedef struct parg_zcamera_s parg_zcamera;
+parg_zcamera* parg_zcamera_create(
+    float world_width, float world_height, float fovy);
+parg_zcamera* parg_zcamera_default();
+void parg_zcamera_free(parg_zcamera*);
+void parg_zcamera_init(
+    parg_zcamera*, float world_width, float world_height, float fovy);
+void parg_zcamera_tick(parg_zcamera*, float window_aspect, float seconds);
+float parg_zcamera_get_magnification(parg_zcamera*);
+void parg_zcamera_get_viewport(parg_zcamera*, float* lbrt);
+parg_aar parg_zcamera_get_rectangle(parg_zcamera*);
+parg_aar parg_zcamera_get_predicted_rectangle(
+    parg_zcamera*, float seconds_ahead);
+void parg_zcamera_grab_begin(parg_zcamera*, float winx, float winy);
+void parg_zcamera_grab_update(
+    parg_zcamera*, float winx, float winy, float scrolldelta);
+void parg_zcamera_grab_end(parg_zcamera*);
+Point3 parg_zcamera_matrices(parg_zcamera*, Matrix4* proj, Matrix4* view);
+DPoint3 parg_zcamera_dmatrices(
+    parg_zcamera*, DMatrix4* proj, DMatrix4* view);
+void parg_zcamera_highprec(
+    parg_zcamera*, Matrix4* vp, Point3* eyepos_lo, Point3* eyepos_hi);
+Matrix4 parg_zcamera_rte_mvp(
+    parg_zcamera*, DPoint3 origin, DMatrix4 model);
+int parg_zcamera_has_moved(parg_zcamera*);
+void parg_zcamera_touch(parg_zcamera*);
+void parg_zcamera_set_position(parg_zcamera*, double x, double y, double z);
+void parg_zcamera_fly_to(parg_zcamera*, parg_aar rect, float duration);
+int parg_zcamera_is_settled(parg_zcamera*);
+
 // OFFSCREEN FRAMEBUFFER
 
 typedef struct parg_framebuffer_s parg_framebuffer;
@@ -221,6 +440,88 @@ void parg_framebuffer_popfbo();
 void parg_framebuffer_free(parg_framebuffer*);
 void parg_framebuffer_swap(parg_framebuffer*, parg_framebuffer*);
 
+// PROFILING
+
+// Counts GL work and the GPU memory held by parg resources.  The per-frame
+// counts cover everything since the previous call to parg_counters_frame,
+// which the window loop makes after each drawn frame, so work done during
+// idle ticks shows up in the next drawn frame.  Byte totals are estimates
+// that ignore driver padding.
+
+typedef struct {
+    int draws;
+    int triangles;
+    int program_binds;
+    int state_changes;
+    int buffer_uploads;
+    int texture_uploads;
+    int64_t uploaded_bytes;
+    int live_buffers;
+    int live_textures;
+    int live_framebuffers;
+    int64_t buffer_bytes;
+    int64_t texture_bytes;
+    int64_t framebuffer_bytes;
+} parg_counters;
+
+void parg_counters_frame();
+void parg_counters_snapshot(parg_counters* dst);
+
+// Keeps a ring of recent frames, each with the CPU time spent in every phase
+// of the window loop, the CPU and GPU times of named scopes, and the counters
+// of the frame if it drew.  Nothing is recorded until profiling is enabled.
+// GPU times need ARB_timer_query or EXT_disjoint_timer_query and show up a
+// frame or two late, since their queries are read back only after they
+// complete.  All times are in seconds on the monotonic clock of
+// parg_profile_now.
+
+#define PARG_PROFILE_MAXSCOPES 32
+
+typedef enum {
+    PARG_PHASE_TICK,
+    PARG_PHASE_UPDATE,
+    PARG_PHASE_DRAW,
+    PARG_PHASE_SWAP,
+    PARG_PHASE_EVENTS,
+    PARG_PHASE_COUNT
+} parg_phase;
+
+typedef struct {
+    parg_token name;
+    int depth;
+    double cpu_begin;
+    double cpu_end;
+    double gpu_begin; // negative while unavailable
+    double gpu_end;
+} parg_profile_scope;
+
+typedef struct {
+    int index;
+    double begin;
+    double end;
+    double phase_begin[PARG_PHASE_COUNT];
+    double phase_time[PARG_PHASE_COUNT];
+    int drawn;
+    parg_counters counters;
+    int nscopes;
+    parg_profile_scope scopes[PARG_PROFILE_MAXSCOPES];
+} parg_profile_frame;
+
+double parg_profile_now();
+void parg_profile_enable(int enabled);
+void parg_profile_frame_begin();
+void parg_profile_frame_end();
+void parg_profile_phase_begin(parg_phase);
+void parg_profile_phase_end(parg_phase);
+void parg_profile_push(parg_token name);
+void parg_profile_pop();
+int parg_profile_frames(parg_profile_frame* dst, int maxframes);
+void parg_profile_write_trace(const char* filepath);
+
+// Overlays a graph of recent frame times in the lower-left corner of the
+// viewport, with one stacked bar per phase and a line at 60 fps.
+void parg_profile_draw_hud();
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,6 +13,7 @@ typedef void (*parg_window_fn_input)(parg_event, float, float, float);
 typedef void (*parg_window_fn_draw)();
 typedef void (*parg_window_fn_exit)(void);
 typedef void (*parg_window_fn_message)(const char*);
+typedef int (*parg_window_fn_update)(float, float);
 
 void parg_window_setargs(int argc, char *argv[]);
 void parg_window_oninit(parg_window_fn_init);
@@ -21,4 +22,26 @@ void parg_window_ondraw(parg_window_fn_draw);
 void parg_window_onexit(parg_window_fn_exit);
 void parg_window_oninput(parg_window_fn_input);
 void parg_window_onmessage(parg_window_fn_message);
+// Renders offscreen instead of showing the window when given "-capture
+// file.png", "-frames N", or "-headless egl|osmesa|auto".  The latter needs
+// no display at all.  "-size WxH" sets the resolution, and simulated time
+// advances by 1/60 of a second per frame.  A capture path with one "%d",
+// such as "frame%04d.png", saves every frame; write "%%" for a literal
+// percent sign.
 int parg_window_exec(float winwidth, float winheight, int vsync, int aa);
+
+// The window skips drawing and sleeps while the tick callback returns 0.
+// Requesting a redraw wakes it up and draws the next frame regardless; this
+// may be called from any thread.  A maximum frame rate of 0 means no limit.
+void parg_window_request_redraw();
+void parg_window_set_maxfps(float fps);
+
+// Registers a callback that advances a simulation in fixed steps, receiving
+// the simulated time and the step length.  It runs on the rendering thread
+// with the GL context current, as many times per frame as the elapsed time
+// calls for, and returns nonzero if anything changed.  The alpha is the
+// fraction of a step that has elapsed since the latest update, for
+// interpolating what gets drawn.  The "-simulate N" argument runs N seconds
+// of steps back to back before the first frame.
+void parg_window_onupdate(parg_window_fn_update, float timestep);
+float parg_window_alpha();
@@ -33,6 +33,62 @@
 
 #include <math.h>
 
+/* SIMD backend, selected at compile time from the target instruction set.
+   Define VECTORMATH_FORCE_SCALAR to use the plain float code everywhere.
+   Loads and stores are unaligned, so vectors may still live in buffers of
+   packed floats.
+ */
+#if defined(VECTORMATH_FORCE_SCALAR)
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#define _VECTORMATH_SIMD_SSE 1
+typedef __m128 _VmathF4;
+#define _vmathF4Load(p) _mm_loadu_ps(p)
+#define _vmathF4Store(p, v) _mm_storeu_ps(p, v)
+#define _vmathF4Splat(s) _mm_set1_ps(s)
+#define _vmathF4Add(a, b) _mm_add_ps(a, b)
+#define _vmathF4Sub(a, b) _mm_sub_ps(a, b)
+#define _vmathF4Mul(a, b) _mm_mul_ps(a, b)
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define _VECTORMATH_SIMD_WASM 1
+typedef v128_t _VmathF4;
+#define _vmathF4Load(p) wasm_v128_load(p)
+#define _vmathF4Store(p, v) wasm_v128_store(p, v)
+#define _vmathF4Splat(s) wasm_f32x4_splat(s)
+#define _vmathF4Add(a, b) wasm_f32x4_add(a, b)
+#define _vmathF4Sub(a, b) wasm_f32x4_sub(a, b)
+#define _vmathF4Mul(a, b) wasm_f32x4_mul(a, b)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define _VECTORMATH_SIMD_NEON 1
+typedef float32x4_t _VmathF4;
+#define _vmathF4Load(p) vld1q_f32(p)
+#define _vmathF4Store(p, v) vst1q_f32(p, v)
+#define _vmathF4Splat(s) vdupq_n_f32(s)
+#define _vmathF4Add(a, b) vaddq_f32(a, b)
+#define _vmathF4Sub(a, b) vsubq_f32(a, b)
+#define _vmathF4Mul(a, b) vmulq_f32(a, b)
+#endif
+
+#if defined(_VECTORMATH_SIMD_SSE) || defined(_VECTORMATH_SIMD_WASM) || \
+    defined(_VECTORMATH_SIMD_NEON)
+#define _VECTORMATH_SIMD 1
+#if defined(_MSC_VER)
+#define _VECTORMATH_ALIGNED __declspec(align(16))
+#else
+#define _VECTORMATH_ALIGNED __attribute__((aligned(16)))
+#endif
+#else
+#define _VECTORMATH_ALIGNED
+#endif
+
 #ifdef _VECTORMATH_DEBUG
 #include <stdio.h>
 #endif
@@ -59,7 +115,7 @@ typedef struct _VmathVector3 {
 
 /* A 4-D vector in array-of-structures format
  */
-typedef struct _VmathVector4 {
+typedef struct _VECTORMATH_ALIGNED _VmathVector4 {
     float x;
     float y;
     float z;
@@ -76,7 +132,7 @@ typedef struct _VmathPoint3 {
 
 /* A quaternion in array-of-structures format
  */
-typedef struct _VmathQuat {
+typedef struct _VECTORMATH_ALIGNED _VmathQuat {
     float x;
     float y;
     float z;
@@ -93,7 +149,7 @@ typedef struct _VmathMatrix3 {
 
 /* A 4x4 matrix in array-of-structures format
  */
-typedef struct _VmathMatrix4 {
+typedef struct _VECTORMATH_ALIGNED _VmathMatrix4 {
     VmathVector4 col0;
     VmathVector4 col1;
     VmathVector4 col2;
@@ -4104,6 +4160,19 @@ static inline void vmathV3Normalize(
     VmathVector3* result, const VmathVector3* vec)
 {
     float lenSqr, lenInv;
+#ifdef _VECTORMATH_SIMD_SSE
+    /* Vector3 is packed, so only three lanes are loaded and stored.  The
+       sum runs in the same order as the scalar code. */
+    __m128 v = _mm_setr_ps(vec->x, vec->y, vec->z, 0.0f);
+    __m128 sqr = _mm_mul_ps(v, v);
+    __m128 len = _mm_add_ss(
+        _mm_add_ss(sqr, _mm_shuffle_ps(sqr, sqr, 1)), _mm_movehl_ps(sqr, sqr));
+    __m128 inv = _mm_div_ss(_mm_set_ss(1.0f), _mm_sqrt_ss(len));
+    v = _mm_mul_ps(v, _mm_shuffle_ps(inv, inv, 0));
+    _mm_storel_pi((__m64*) &result->x, v);
+    _mm_store_ss(&result->z, _mm_movehl_ps(v, v));
+    return;
+#endif
     lenSqr = vmathV3LengthSqr(vec);
     lenInv = (1.0f / sqrtf(lenSqr));
     result->x = (vec->x * lenInv);
@@ -4303,6 +4372,11 @@ static inline float vmathV4GetElem(const VmathVector4* vec, int idx)
 static inline void vmathV4Add(
     VmathVector4* result, const VmathVector4* vec0, const VmathVector4* vec1)
 {
+#ifdef _VECTORMATH_SIMD
+    _vmathF4Store(&result->x,
+        _vmathF4Add(_vmathF4Load(&vec0->x), _vmathF4Load(&vec1->x)));
+    return;
+#endif
     result->x = (vec0->x + vec1->x);
     result->y = (vec0->y + vec1->y);
     result->z = (vec0->z + vec1->z);
@@ -4312,6 +4386,11 @@ static inline void vmathV4Add(
 static inline void vmathV4Sub(
     VmathVector4* result, const VmathVector4* vec0, const VmathVector4* vec1)
 {
+#ifdef _VECTORMATH_SIMD
+    _vmathF4Store(&result->x,
+        _vmathF4Sub(_vmathF4Load(&vec0->x), _vmathF4Load(&vec1->x)));
+    return;
+#endif
     result->x = (vec0->x - vec1->x);
     result->y = (vec0->y - vec1->y);
     result->z = (vec0->z - vec1->z);
@@ -4321,6 +4400,11 @@ static inline void vmathV4Sub(
 static inline void vmathV4ScalarMul(
     VmathVector4* result, const VmathVector4* vec, float scalar)
 {
+#ifdef _VECTORMATH_SIMD
+    _vmathF4Store(&result->x,
+        _vmathF4Mul(_vmathF4Load(&vec->x), _vmathF4Splat(scalar)));
+    return;
+#endif
     result->x = (vec->x * scalar);
     result->y = (vec->y * scalar);
     result->z = (vec->z * scalar);
@@ -4347,6 +4431,11 @@ static inline void vmathV4Neg(VmathVector4* result, const VmathVector4* vec)
 static inline void vmathV4MulPerElem(
     VmathVector4* result, const VmathVector4* vec0, const VmathVector4* vec1)
 {
+#ifdef _VECTORMATH_SIMD
+    _vmathF4Store(&result->x,
+        _vmathF4Mul(_vmathF4Load(&vec0->x), _vmathF4Load(&vec1->x)));
+    return;
+#endif
     result->x = (vec0->x * vec1->x);
     result->y = (vec0->y * vec1->y);
     result->z = (vec0->z * vec1->z);
@@ -4455,6 +4544,10 @@ static inline float vmathV4Sum(const VmathVector4* vec)
 static inline float vmathV4Dot(
     const VmathVector4* vec0, const VmathVector4* vec1)
 {
+#if defined(_VECTORMATH_SIMD_SSE) && defined(__SSE4_1__)
+    return _mm_cvtss_f32(
+        _mm_dp_ps(_mm_loadu_ps(&vec0->x), _mm_loadu_ps(&vec1->x), 0xf1));
+#endif
     float result;
     result = (vec0->x * vec1->x);
     result = (result + (vec0->y * vec1->y));
@@ -4482,6 +4575,11 @@ static inline void vmathV4Normalize(
     VmathVector4* result, const VmathVector4* vec)
 {
     float lenSqr, lenInv;
+#ifdef _VECTORMATH_SIMD
+    lenInv = (1.0f / sqrtf(vmathV4Dot(vec, vec)));
+    vmathV4ScalarMul(result, vec, lenInv);
+    return;
+#endif
     lenSqr = vmathV4LengthSqr(vec);
     lenInv = (1.0f / sqrtf(lenSqr));
     result->x = (vec->x * lenInv);
@@ -5719,6 +5817,16 @@ static inline void vmathM4GetRow(
 static inline void vmathM4Transpose(
     VmathMatrix4* result, const VmathMatrix4* mat)
 {
+#ifdef _VECTORMATH_SIMD_SSE
+    __m128 c0 = _mm_loadu_ps(&mat->col0.x), c1 = _mm_loadu_ps(&mat->col1.x);
+    __m128 c2 = _mm_loadu_ps(&mat->col2.x), c3 = _mm_loadu_ps(&mat->col3.x);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(&result->col0.x, c0);
+    _mm_storeu_ps(&result->col1.x, c1);
+    _mm_storeu_ps(&result->col2.x, c2);
+    _mm_storeu_ps(&result->col3.x, c3);
+    return;
+#endif
     VmathMatrix4 tmpResult;
     vmathV4MakeFromElems(
         &tmpResult.col0, mat->col0.x, mat->col1.x, mat->col2.x, mat->col3.x);
@@ -5731,8 +5839,79 @@ static inline void vmathM4Transpose(
     vmathM4Copy(result, &tmpResult);
 }
 
+#ifdef _VECTORMATH_SIMD_SSE
+/* Block-wise inverse: the matrix is split into four 2x2 blocks, each held in
+   one register, and the inverse is assembled from their adjugates.
+ */
+#define _VMATH_SHUFFLE(a, b, x, y, z, w) \
+    _mm_shuffle_ps(a, b, (x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define _VMATH_SWIZZLE(a, x, y, z, w) _VMATH_SHUFFLE(a, a, x, y, z, w)
+
+static inline __m128 _vmathMat2Mul(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, _VMATH_SWIZZLE(b, 0, 3, 0, 3)),
+        _mm_mul_ps(
+            _VMATH_SWIZZLE(a, 1, 0, 3, 2), _VMATH_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+static inline __m128 _vmathMat2AdjMul(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(_VMATH_SWIZZLE(a, 3, 3, 0, 0), b),
+        _mm_mul_ps(
+            _VMATH_SWIZZLE(a, 1, 1, 2, 2), _VMATH_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+static inline __m128 _vmathMat2MulAdj(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, _VMATH_SWIZZLE(b, 3, 0, 3, 0)),
+        _mm_mul_ps(
+            _VMATH_SWIZZLE(a, 1, 0, 3, 2), _VMATH_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+static inline void _vmathM4InverseSSE(
+    VmathMatrix4* result, const VmathMatrix4* mat)
+{
+    __m128 c0 = _mm_loadu_ps(&mat->col0.x), c1 = _mm_loadu_ps(&mat->col1.x);
+    __m128 c2 = _mm_loadu_ps(&mat->col2.x), c3 = _mm_loadu_ps(&mat->col3.x);
+    __m128 A = _mm_movelh_ps(c0, c1), B = _mm_movehl_ps(c1, c0);
+    __m128 C = _mm_movelh_ps(c2, c3), D = _mm_movehl_ps(c3, c2);
+    __m128 detSub = _mm_sub_ps(
+        _mm_mul_ps(_VMATH_SHUFFLE(c0, c2, 0, 2, 0, 2),
+            _VMATH_SHUFFLE(c1, c3, 1, 3, 1, 3)),
+        _mm_mul_ps(_VMATH_SHUFFLE(c0, c2, 1, 3, 1, 3),
+            _VMATH_SHUFFLE(c1, c3, 0, 2, 0, 2)));
+    __m128 detA = _VMATH_SWIZZLE(detSub, 0, 0, 0, 0);
+    __m128 detB = _VMATH_SWIZZLE(detSub, 1, 1, 1, 1);
+    __m128 detC = _VMATH_SWIZZLE(detSub, 2, 2, 2, 2);
+    __m128 detD = _VMATH_SWIZZLE(detSub, 3, 3, 3, 3);
+    __m128 DC = _vmathMat2AdjMul(D, C), AB = _vmathMat2AdjMul(A, B);
+    __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), _vmathMat2Mul(B, DC));
+    __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), _vmathMat2Mul(C, AB));
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), _vmathMat2MulAdj(D, AB));
+    __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), _vmathMat2MulAdj(A, DC));
+    __m128 detM = _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC));
+    __m128 tr = _mm_mul_ps(AB, _VMATH_SWIZZLE(DC, 0, 2, 1, 3));
+    tr = _mm_add_ps(tr, _mm_movehl_ps(tr, tr));
+    tr = _mm_add_ps(tr, _VMATH_SWIZZLE(tr, 1, 0, 0, 0));
+    detM = _mm_sub_ps(detM, _VMATH_SWIZZLE(tr, 0, 0, 0, 0));
+    __m128 rDetM = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), detM);
+    X = _mm_mul_ps(X, rDetM);
+    Y = _mm_mul_ps(Y, rDetM);
+    Z = _mm_mul_ps(Z, rDetM);
+    W = _mm_mul_ps(W, rDetM);
+    _mm_storeu_ps(&result->col0.x, _VMATH_SHUFFLE(X, Y, 3, 1, 3, 1));
+    _mm_storeu_ps(&result->col1.x, _VMATH_SHUFFLE(X, Y, 2, 0, 2, 0));
+    _mm_storeu_ps(&result->col2.x, _VMATH_SHUFFLE(Z, W, 3, 1, 3, 1));
+    _mm_storeu_ps(&result->col3.x, _VMATH_SHUFFLE(Z, W, 2, 0, 2, 0));
+}
+#endif
+
 static inline void vmathM4Inverse(VmathMatrix4* result, const VmathMatrix4* mat)
 {
+#ifdef _VECTORMATH_SIMD_SSE
+    _vmathM4InverseSSE(result, mat);
+    return;
+#endif
     VmathVector4 res0, res1, res2, res3;
     float mA, mB, mC, mD, mE, mF, mG, mH, mI, mJ, mK, mL, mM, mN, mO, mP, tmp0,
         tmp1, tmp2, tmp3, tmp4, tmp5, detInv;
@@ -5914,6 +6093,18 @@ static inline void vmathM4ScalarMul(
 static inline void vmathM4MulV4(
     VmathVector4* result, const VmathMatrix4* mat, const VmathVector4* vec)
 {
+#ifdef _VECTORMATH_SIMD
+    _VmathF4 sum =
+        _vmathF4Mul(_vmathF4Load(&mat->col0.x), _vmathF4Splat(vec->x));
+    sum = _vmathF4Add(sum,
+        _vmathF4Mul(_vmathF4Load(&mat->col1.x), _vmathF4Splat(vec->y)));
+    sum = _vmathF4Add(sum,
+        _vmathF4Mul(_vmathF4Load(&mat->col2.x), _vmathF4Splat(vec->z)));
+    sum = _vmathF4Add(sum,
+        _vmathF4Mul(_vmathF4Load(&mat->col3.x), _vmathF4Splat(vec->w)));
+    _vmathF4Store(&result->x, sum);
+    return;
+#endif
     float tmpX, tmpY, tmpZ, tmpW;
     tmpX = ((((mat->col0.x * vec->x) + (mat->col1.x * vec->y)) +
         (mat->col2.x * vec->z)) +
@@ -5964,6 +6155,34 @@ static inline void vmathM4Mul(
     VmathMatrix4* result, const VmathMatrix4* mat0, const VmathMatrix4* mat1)
 {
     VmathMatrix4 tmpResult;
+#if defined(_VECTORMATH_SIMD_SSE) && defined(__AVX__)
+    /* Two result columns per iteration, with each column of mat0 in both
+       halves of a 256-bit register. */
+    const float* a = &mat0->col0.x;
+    const float* b = &mat1->col0.x;
+    float* r = &tmpResult.col0.x;
+    __m256 a0 = _mm256_broadcast_ps((const __m128*) (a + 0));
+    __m256 a1 = _mm256_broadcast_ps((const __m128*) (a + 4));
+    __m256 a2 = _mm256_broadcast_ps((const __m128*) (a + 8));
+    __m256 a3 = _mm256_broadcast_ps((const __m128*) (a + 12));
+    for (int i = 0; i < 16; i += 8) {
+        __m256 sum = _mm256_mul_ps(a0,
+            _mm256_setr_ps(b[i], b[i], b[i], b[i], b[i + 4], b[i + 4],
+                b[i + 4], b[i + 4]));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(a1,
+            _mm256_setr_ps(b[i + 1], b[i + 1], b[i + 1], b[i + 1], b[i + 5],
+                b[i + 5], b[i + 5], b[i + 5])));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(a2,
+            _mm256_setr_ps(b[i + 2], b[i + 2], b[i + 2], b[i + 2], b[i + 6],
+                b[i + 6], b[i + 6], b[i + 6])));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(a3,
+            _mm256_setr_ps(b[i + 3], b[i + 3], b[i + 3], b[i + 3], b[i + 7],
+                b[i + 7], b[i + 7], b[i + 7])));
+        _mm256_storeu_ps(r + i, sum);
+    }
+    vmathM4Copy(result, &tmpResult);
+    return;
+#endif
     vmathM4MulV4(&tmpResult.col0, mat0, &mat1->col0);
     vmathM4MulV4(&tmpResult.col1, mat0, &mat1->col1);
     vmathM4MulV4(&tmpResult.col2, mat0, &mat1->col2);
@@ -8920,3 +9139,150 @@ static inline VmathMatrix3 vmathV3CrossMatrixMul_V(
 #define T3Inverse vmathT3Inverse_V
 #define T3OrthoInverse vmathT3OrthoInverse_V
 #define T3Select vmathT3Select_V
+
+/* Batch kernels over packed arrays of 3-float points or vectors, such as the
+   contents of a vertex buffer.  Each group of four elements is transposed
+   into x, y and z registers so that every lane does the work of one element.
+   Source and destination may alias.
+ */
+#if defined(_VECTORMATH_SIMD_SSE) || defined(_VECTORMATH_SIMD_WASM) || \
+    (defined(_VECTORMATH_SIMD_NEON) && defined(__aarch64__))
+#define _VECTORMATH_SIMD_BATCH 1
+
+/* Picks lanes i and j from a, then lanes k and l from b. */
+#if defined(_VECTORMATH_SIMD_SSE)
+#define _vmathF4Shuffle(a, b, i, j, k, l) \
+    _mm_shuffle_ps(a, b, (i) | ((j) << 2) | ((k) << 4) | ((l) << 6))
+#define _vmathF4Div(a, b) _mm_div_ps(a, b)
+#define _vmathF4Sqrt(a) _mm_sqrt_ps(a)
+#elif defined(_VECTORMATH_SIMD_WASM)
+#define _vmathF4Shuffle(a, b, i, j, k, l) \
+    wasm_i32x4_shuffle(a, b, i, j, (k) + 4, (l) + 4)
+#define _vmathF4Div(a, b) wasm_f32x4_div(a, b)
+#define _vmathF4Sqrt(a) wasm_f32x4_sqrt(a)
+#else
+#define _vmathF4Div(a, b) vdivq_f32(a, b)
+#define _vmathF4Sqrt(a) vsqrtq_f32(a)
+#endif
+
+static inline void _vmathF4LoadXYZ(
+    const float* src, _VmathF4* x, _VmathF4* y, _VmathF4* z)
+{
+#if defined(_VECTORMATH_SIMD_NEON)
+    float32x4x3_t v = vld3q_f32(src);
+    *x = v.val[0];
+    *y = v.val[1];
+    *z = v.val[2];
+#else
+    _VmathF4 a = _vmathF4Load(src);
+    _VmathF4 b = _vmathF4Load(src + 4);
+    _VmathF4 c = _vmathF4Load(src + 8);
+    *x = _vmathF4Shuffle(a, _vmathF4Shuffle(b, c, 2, 2, 1, 1), 0, 3, 0, 2);
+    *y = _vmathF4Shuffle(_vmathF4Shuffle(a, b, 1, 1, 0, 0),
+        _vmathF4Shuffle(b, c, 3, 3, 2, 2), 0, 2, 0, 2);
+    *z = _vmathF4Shuffle(_vmathF4Shuffle(a, b, 2, 2, 1, 1),
+        _vmathF4Shuffle(c, c, 0, 0, 3, 3), 0, 2, 0, 2);
+#endif
+}
+
+static inline void _vmathF4StoreXYZ(
+    float* dst, _VmathF4 x, _VmathF4 y, _VmathF4 z)
+{
+#if defined(_VECTORMATH_SIMD_NEON)
+    float32x4x3_t v = {{x, y, z}};
+    vst3q_f32(dst, v);
+#else
+    _vmathF4Store(dst, _vmathF4Shuffle(_vmathF4Shuffle(x, y, 0, 0, 0, 0),
+        _vmathF4Shuffle(z, x, 0, 0, 1, 1), 0, 2, 0, 2));
+    _vmathF4Store(dst + 4, _vmathF4Shuffle(_vmathF4Shuffle(y, z, 1, 1, 1, 1),
+        _vmathF4Shuffle(x, y, 2, 2, 2, 2), 0, 2, 0, 2));
+    _vmathF4Store(dst + 8, _vmathF4Shuffle(_vmathF4Shuffle(z, x, 2, 2, 3, 3),
+        _vmathF4Shuffle(y, z, 3, 3, 3, 3), 0, 2, 0, 2));
+#endif
+}
+#endif
+
+/* Multiplies count points by a matrix, keeping x, y and z of the result.
+ */
+static inline void vmathM4MulP3Array(
+    float* dst, const VmathMatrix4* mat, const float* src, int count)
+{
+    int i = 0;
+#ifdef _VECTORMATH_SIMD_BATCH
+    const float* m = &mat->col0.x;
+    for (; i + 4 <= count; i += 4, src += 12, dst += 12) {
+        _VmathF4 x, y, z, r[3];
+        _vmathF4LoadXYZ(src, &x, &y, &z);
+        for (int j = 0; j < 3; j++) {
+            _VmathF4 sum = _vmathF4Add(_vmathF4Splat(m[12 + j]),
+                _vmathF4Mul(_vmathF4Splat(m[j]), x));
+            sum = _vmathF4Add(sum, _vmathF4Mul(_vmathF4Splat(m[4 + j]), y));
+            r[j] = _vmathF4Add(sum, _vmathF4Mul(_vmathF4Splat(m[8 + j]), z));
+        }
+        _vmathF4StoreXYZ(dst, r[0], r[1], r[2]);
+    }
+#endif
+    for (; i < count; i++, src += 3, dst += 3) {
+        float x = src[0], y = src[1], z = src[2];
+        dst[0] = mat->col0.x * x + mat->col1.x * y + mat->col2.x * z +
+            mat->col3.x;
+        dst[1] = mat->col0.y * x + mat->col1.y * y + mat->col2.y * z +
+            mat->col3.y;
+        dst[2] = mat->col0.z * x + mat->col1.z * y + mat->col2.z * z +
+            mat->col3.z;
+    }
+}
+
+static inline void vmathV3NormalizeArray(
+    float* dst, const float* src, int count)
+{
+    int i = 0;
+#ifdef _VECTORMATH_SIMD_BATCH
+    for (; i + 4 <= count; i += 4, src += 12, dst += 12) {
+        _VmathF4 x, y, z;
+        _vmathF4LoadXYZ(src, &x, &y, &z);
+        _VmathF4 len = _vmathF4Sqrt(_vmathF4Add(
+            _vmathF4Add(_vmathF4Mul(x, x), _vmathF4Mul(y, y)),
+            _vmathF4Mul(z, z)));
+        _VmathF4 inv = _vmathF4Div(_vmathF4Splat(1.0f), len);
+        _vmathF4StoreXYZ(dst, _vmathF4Mul(x, inv), _vmathF4Mul(y, inv),
+            _vmathF4Mul(z, inv));
+    }
+#endif
+    for (; i < count; i++, src += 3, dst += 3) {
+        float x = src[0], y = src[1], z = src[2];
+        float inv = 1.0f / sqrtf(x * x + y * y + z * z);
+        dst[0] = x * inv;
+        dst[1] = y * inv;
+        dst[2] = z * inv;
+    }
+}
+
+static inline void vmathV3CrossArray(
+    float* dst, const float* a, const float* b, int count)
+{
+    int i = 0;
+#ifdef _VECTORMATH_SIMD_BATCH
+    for (; i + 4 <= count; i += 4, a += 12, b += 12, dst += 12) {
+        _VmathF4 ax, ay, az, bx, by, bz;
+        _vmathF4LoadXYZ(a, &ax, &ay, &az);
+        _vmathF4LoadXYZ(b, &bx, &by, &bz);
+        _vmathF4StoreXYZ(dst,
+            _vmathF4Sub(_vmathF4Mul(ay, bz), _vmathF4Mul(az, by)),
+            _vmathF4Sub(_vmathF4Mul(az, bx), _vmathF4Mul(ax, bz)),
+            _vmathF4Sub(_vmathF4Mul(ax, by), _vmathF4Mul(ay, bx)));
+    }
+#endif
+    for (; i < count; i++, a += 3, b += 3, dst += 3) {
+        float x = a[1] * b[2] - a[2] * b[1];
+        float y = a[2] * b[0] - a[0] * b[2];
+        float z = a[0] * b[1] - a[1] * b[0];
+        dst[0] = x;
+        dst[1] = y;
+        dst[2] = z;
+    }
+}
+
+#define M4MulP3Array vmathM4MulP3Array
+#define V3NormalizeArray vmathV3NormalizeArray
+#define V3CrossArray vmathV3CrossArray
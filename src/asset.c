@@ -2,7 +2,6 @@
 #include "internal.h"
 #include "kvec.h"
 #include "khash.h"
-#include "lodepng.h"
 
 // Mapping from asset ids (which are tokens) to buffer pointers.
 KHASH_MAP_INIT_INT(assmap, parg_buffer*)
@@ -12,23 +11,56 @@ static khash_t(assmap)* _asset_registry = 0;
 static sds _exedir = 0;
 static sds _baseurl = 0;
 
-#ifdef EMSCRIPTEN
-void parg_asset_onload(const char* name, parg_buffer* buf)
+static void register_asset(parg_token id, parg_buffer* buf)
 {
-    parg_token id = parg_token_from_string(name);
-    parg_assert(buf, "Unable to load asset");
     if (!_asset_registry) {
         _asset_registry = kh_init(assmap);
     }
     int ret;
     int iter = kh_put(assmap, _asset_registry, id, &ret);
     kh_value(_asset_registry, iter) = buf;
+    parg_buffer_tag_asset(buf, id);
+}
+
+#ifdef EMSCRIPTEN
+void parg_asset_onload(const char* name, parg_buffer* buf)
+{
+    parg_token id = parg_token_from_string(name);
+    parg_assert(buf, "Unable to load asset");
+    register_asset(id, buf);
 }
 
 #else
 
 static sds _pngsuffix = 0;
 
+// Tall PNGs are re-encoded as strips next to the executable, keyed by a
+// hash of the file, so that later runs can inflate them in parallel.
+static unsigned decode_png(unsigned char** decoded, unsigned* width,
+    unsigned* height, parg_token id, const unsigned char* filedata, int nbytes)
+{
+    uint32_t hash = parg_texture_hash(filedata, nbytes);
+    sds path = sdscatprintf(sdsdup(parg_asset_whereami()), "%s.strips",
+        parg_token_to_string(id));
+    unsigned err = 1;
+    if (parg_asset_fileexists(path)) {
+        parg_buffer* strips = parg_buffer_from_file(path);
+        err = parg_png_decode_strips(decoded, width, height, strips, hash, 0);
+        parg_buffer_free(strips);
+    }
+    if (err) {
+        err = parg_png_decode(decoded, width, height, filedata, nbytes, 0);
+        parg_buffer* strips = err ? 0 :
+            parg_png_encode_strips(*decoded, *width, *height, hash);
+        if (strips) {
+            parg_buffer_to_file(strips, path);
+            parg_buffer_free(strips);
+        }
+    }
+    sdsfree(path);
+    return err;
+}
+
 void parg_asset_preload(parg_token id)
 {
     if (!_pngsuffix) {
@@ -44,8 +76,8 @@ void parg_asset_preload(parg_token id)
             unsigned char* decoded;
             unsigned dims[3] = {0, 0, 4};
             unsigned char* filedata = parg_buffer_lock(buf, PARG_READ);
-            unsigned err = lodepng_decode_memory(&decoded, &dims[0], &dims[1],
-                    filedata, parg_buffer_length(buf), LCT_RGBA, 8);
+            unsigned err = decode_png(&decoded, &dims[0], &dims[1], id,
+                    filedata, parg_buffer_length(buf));
             parg_assert(err == 0, "PNG decoding error");
             parg_buffer_free(buf);
             int nbytes = dims[0] * dims[1] * dims[2];
@@ -60,12 +92,7 @@ void parg_asset_preload(parg_token id)
         }
         sdsfree(suffix);
     }
-    if (!_asset_registry) {
-        _asset_registry = kh_init(assmap);
-    }
-    int ret;
-    int iter = kh_put(assmap, _asset_registry, id, &ret);
-    kh_value(_asset_registry, iter) = buf;
+    register_asset(id, buf);
 }
 
 #endif
@@ -75,7 +102,20 @@ parg_buffer* parg_asset_to_buffer(parg_token id)
     parg_assert(_asset_registry, "Uninitialized asset registry");
     khiter_t iter = kh_get(assmap, _asset_registry, id);
     parg_assert(iter != kh_end(_asset_registry), "Unknown token");
-    return kh_value(_asset_registry, iter);
+    parg_buffer* buf = kh_value(_asset_registry, iter);
+    parg_verify(buf, "Asset has been freed", parg_token_to_string(id));
+    return buf;
+}
+
+// Called when an asset buffer is freed, which happens when it has been
+// consumed by a texture or shader.
+void parg_asset_release(parg_token id, parg_buffer* buf)
+{
+    khiter_t iter = kh_get(assmap, _asset_registry, id);
+    if (iter != kh_end(_asset_registry) &&
+        kh_value(_asset_registry, iter) == buf) {
+        kh_value(_asset_registry, iter) = 0;
+    }
 }
 
 sds parg_asset_baseurl()
@@ -88,6 +128,10 @@ sds parg_asset_baseurl()
 
 #if EMSCRIPTEN
 
+void parg_asset_watch(int enabled) {}
+
+int parg_asset_poll() { return 0; }
+
 void parg_asset_set_baseurl(const char* url) { _baseurl = sdsnew(url); }
 
 sds parg_asset_whereami()
@@ -109,6 +153,10 @@ int parg_asset_download(const char* filename, sds targetpath) { return 0; }
 #include <fcntl.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
 #define PAR_EASYCURL_IMPLEMENTATION
 #include <par/par_easycurl.h>
 
@@ -135,4 +183,96 @@ int parg_asset_download(const char* filename, sds targetpath)
     return 0;
 }
 
+#ifdef __linux__
+
+static int _watchfd = -1;
+
+// Re-reads the given asset from disk, then refreshes the buffer, textures,
+// and shader programs that were created from it.  Buffers that are still
+// alive receive the new contents in place so that existing handles stay
+// valid.
+static void reload_asset(parg_token id)
+{
+    khiter_t iter = kh_get(assmap, _asset_registry, id);
+    parg_buffer* old = kh_value(_asset_registry, iter);
+    parg_asset_preload(id);
+    if (old) {
+        parg_buffer* buf = parg_asset_to_buffer(id);
+        parg_buffer_swap(old, buf);
+        iter = kh_get(assmap, _asset_registry, id);
+        kh_value(_asset_registry, iter) = old;
+        parg_buffer_free(buf);
+    }
+    parg_shader_reload_asset(id);
+    parg_texture_reload_asset(id);
+}
+
+void parg_asset_watch(int enabled)
+{
+    if (enabled && _watchfd == -1) {
+        _watchfd = inotify_init1(IN_NONBLOCK);
+        parg_assert(_watchfd != -1, "Unable to initialize inotify");
+        sds dir = parg_asset_whereami();
+        int wd = inotify_add_watch(_watchfd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+        parg_verify(wd != -1, "Unable to watch asset folder", dir);
+    } else if (!enabled && _watchfd != -1) {
+        close(_watchfd);
+        _watchfd = -1;
+    }
+}
+
+int parg_asset_poll()
+{
+    if (_watchfd == -1 || !_asset_registry) {
+        return 0;
+    }
+
+    // Drain all pending events first, since editors often write a file in
+    // several steps; each changed asset is then reloaded only once.
+    char events[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    kvec_t(parg_token) changed;
+    kv_init(changed);
+    ssize_t len;
+    while ((len = read(_watchfd, events, sizeof(events))) > 0) {
+        const struct inotify_event* event;
+        for (char* ptr = events; ptr < events + len;
+            ptr += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event*) ptr;
+            if (!event->len) {
+                continue;
+            }
+            parg_token id = kh_str_hash_func(event->name);
+            if (kh_get(assmap, _asset_registry, id) ==
+                kh_end(_asset_registry)) {
+                continue;
+            }
+            int found = 0;
+            for (int i = 0; i < kv_size(changed) && !found; i++) {
+                found = kv_A(changed, i) == id;
+            }
+            if (!found) {
+                kv_push(parg_token, changed, id);
+            }
+        }
+    }
+    int nchanged = kv_size(changed);
+    for (int i = 0; i < nchanged; i++) {
+        reload_asset(kv_A(changed, i));
+    }
+    kv_destroy(changed);
+    return nchanged;
+}
+
+#else
+
+void parg_asset_watch(int enabled)
+{
+    puts("Asset watching is only supported on Linux.");
+}
+
+int parg_asset_poll() { return 0; }
+
+#endif
+
 #endif
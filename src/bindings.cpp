@@ -2,6 +2,7 @@ extern "C" {
     #include <parg.h>
     #include <parwin.h>
     #include "pargl.h"
+    #include "internal.h"
     void parg_asset_set_baseurl(const char* url);
     void parg_asset_onload(const char* name, parg_buffer* buf);
 }
@@ -30,6 +31,7 @@ static parg_window_fn_exit _dispose = null_dispose;
 static parg_window_fn_input _input = null_input;
 static parg_window_fn_message _message = null_message;
 static parg_buffer* g_buffer;
+static int _redraw = 0;
 
 void parg_window_setargs(int argc, char* argv[])
 {
@@ -49,6 +51,13 @@ void parg_window_oninput(parg_window_fn_input fn) { _input = fn; }
 
 void parg_window_onmessage(parg_window_fn_message fn) { _message = fn; }
 
+void parg_window_request_redraw() { _redraw = 1; }
+
+void parg_window_set_maxfps(float fps)
+{
+    EM_ASM_ARGS({ Module.parg_window_maxfps = $0; }, fps);
+}
+
 int parg_window_exec(float winwidth, float winheight, int vsync, int aa)
 {
     _winwidth = winwidth;
@@ -75,7 +84,10 @@ static void init(emscripten::val args)
 
 static void draw()
 {
+    parg_profile_phase_begin(PARG_PHASE_DRAW);
     _draw();
+    parg_profile_phase_end(PARG_PHASE_DRAW);
+    parg_counters_frame();
     #if 0
     GLenum err = glGetError();
     if (err != GL_NO_ERROR) {
@@ -87,7 +99,16 @@ static void draw()
 static int tick(float seconds, float pixscale)
 {
     _pixscale = pixscale;
-    return _tick(_winwidth, _winheight, _pixscale, seconds);
+    parg_profile_frame_begin();
+    parg_profile_phase_begin(PARG_PHASE_TICK);
+    int needs_draw = _tick(_winwidth, _winheight, _pixscale, seconds);
+    parg_profile_phase_end(PARG_PHASE_TICK);
+    parg_profile_phase_begin(PARG_PHASE_UPDATE);
+    needs_draw = parg_window_advance(seconds) || needs_draw;
+    parg_profile_phase_end(PARG_PHASE_UPDATE);
+    needs_draw = needs_draw || _redraw;
+    _redraw = 0;
+    return needs_draw;
 }
 
 static void input(int evt, float x, float y, float z)
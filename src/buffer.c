@@ -10,8 +10,17 @@ struct parg_buffer_s {
     parg_buffer_type memtype;
     GLuint gpuhandle;
     char* gpumapped;
+    int mappedoffset;
+    int mappedbytes;
+    parg_token asset;
 };
 
+static void count_gpu_buffer(int count, int nbytes)
+{
+    _parg_counters.live_buffers += count;
+    _parg_counters.buffer_bytes += count * nbytes;
+}
+
 parg_buffer* parg_buffer_create(void* src, int nbytes, parg_buffer_type memtype)
 {
     parg_buffer* retval = malloc(sizeof(struct parg_buffer_s));
@@ -19,12 +28,17 @@ parg_buffer* parg_buffer_create(void* src, int nbytes, parg_buffer_type memtype)
     retval->memtype = memtype;
     retval->gpuhandle = 0;
     retval->gpumapped = 0;
+    retval->mappedbytes = 0;
+    retval->asset = 0;
     if (parg_buffer_gpu_check(retval)) {
         glGenBuffers(1, &retval->gpuhandle);
         GLenum target = memtype == PARG_GPU_ARRAY ? GL_ARRAY_BUFFER
             : GL_ELEMENT_ARRAY_BUFFER;
         glBindBuffer(target, retval->gpuhandle);
         glBufferData(target, nbytes, src, GL_STATIC_DRAW);
+        count_gpu_buffer(1, nbytes);
+        _parg_counters.buffer_uploads++;
+        _parg_counters.uploaded_bytes += nbytes;
     } else {
         retval->data = malloc(nbytes);
         memcpy(retval->data, src, nbytes);
@@ -47,8 +61,15 @@ parg_buffer* parg_buffer_alloc(int nbytes, parg_buffer_type memtype)
     retval->memtype = memtype;
     retval->gpuhandle = 0;
     retval->gpumapped = 0;
+    retval->mappedbytes = 0;
+    retval->asset = 0;
     if (parg_buffer_gpu_check(retval)) {
         glGenBuffers(1, &retval->gpuhandle);
+        GLenum target = memtype == PARG_GPU_ARRAY ? GL_ARRAY_BUFFER
+            : GL_ELEMENT_ARRAY_BUFFER;
+        glBindBuffer(target, retval->gpuhandle);
+        glBufferData(target, nbytes, 0, GL_DYNAMIC_DRAW);
+        count_gpu_buffer(1, nbytes);
     }
     return retval;
 }
@@ -70,14 +91,32 @@ void parg_buffer_free(parg_buffer* buf)
     if (!buf) {
         return;
     }
+    if (buf->asset) {
+        parg_asset_release(buf->asset, buf);
+    }
     if (parg_buffer_gpu_check(buf)) {
         glDeleteBuffers(1, &buf->gpuhandle);
+        count_gpu_buffer(-1, buf->nbytes);
     } else {
         free(buf->data);
     }
     free(buf);
 }
 
+void parg_buffer_tag_asset(parg_buffer* buf, parg_token id)
+{
+    buf->asset = id;
+}
+
+void parg_buffer_swap(parg_buffer* a, parg_buffer* b)
+{
+    parg_assert(!parg_buffer_gpu_check(a) && !parg_buffer_gpu_check(b),
+        "CPU buffers required");
+    PARG_SWAP(char*, a->data, b->data);
+    PARG_SWAP(int, a->nbytes, b->nbytes);
+    PARG_SWAP(parg_buffer_type, a->memtype, b->memtype);
+}
+
 int parg_buffer_length(parg_buffer* buf)
 {
     parg_assert(buf, "Null buffer");
@@ -93,6 +132,19 @@ void* parg_buffer_lock(parg_buffer* buf, parg_buffer_mode access)
     return buf->data;
 }
 
+void* parg_buffer_lock_range(
+    parg_buffer* buf, int offset, int nbytes, parg_buffer_mode access)
+{
+    parg_assert(offset + nbytes <= buf->nbytes, "Range is out of bounds");
+    if (access == PARG_WRITE && parg_buffer_gpu_check(buf)) {
+        buf->gpumapped = malloc(nbytes);
+        buf->mappedoffset = offset;
+        buf->mappedbytes = nbytes;
+        return buf->gpumapped;
+    }
+    return buf->data + offset;
+}
+
 void parg_buffer_unlock(parg_buffer* buf)
 {
     if (buf->gpumapped) {
@@ -100,12 +152,124 @@ void parg_buffer_unlock(parg_buffer* buf)
             ? GL_ARRAY_BUFFER
             : GL_ELEMENT_ARRAY_BUFFER;
         glBindBuffer(target, buf->gpuhandle);
-        glBufferData(target, buf->nbytes, buf->gpumapped, GL_STATIC_DRAW);
+        _parg_counters.buffer_uploads++;
+        _parg_counters.uploaded_bytes +=
+            buf->mappedbytes ? buf->mappedbytes : buf->nbytes;
+        if (buf->mappedbytes) {
+            glBufferSubData(target, buf->mappedoffset, buf->mappedbytes,
+                buf->gpumapped);
+            buf->mappedbytes = 0;
+        } else {
+            glBufferData(target, buf->nbytes, buf->gpumapped, GL_STATIC_DRAW);
+        }
         free(buf->gpumapped);
         buf->gpumapped = 0;
     }
 }
 
+// Batch kernels run on worker threads once the element count reaches a few
+// grains.
+#define BATCH_GRAIN 16384
+
+typedef struct {
+    float* dst;
+    float* lo;
+    const float* a;
+    const float* b;
+    const double* src;
+    Matrix4 mat;
+} batch_job;
+
+static void transform_range(void* context, int begin, int end)
+{
+    batch_job* job = context;
+    M4MulP3Array(job->dst + begin * 3, &job->mat, job->a + begin * 3,
+        end - begin);
+}
+
+static void normalize_range(void* context, int begin, int end)
+{
+    batch_job* job = context;
+    V3NormalizeArray(job->dst + begin * 3, job->a + begin * 3, end - begin);
+}
+
+static void cross_range(void* context, int begin, int end)
+{
+    batch_job* job = context;
+    V3CrossArray(job->dst + begin * 3, job->a + begin * 3, job->b + begin * 3,
+        end - begin);
+}
+
+static void split_range(void* context, int begin, int end)
+{
+    batch_job* job = context;
+    DSplitArray(job->dst + begin, job->lo + begin, job->src + begin,
+        end - begin);
+}
+
+static int batch_count(parg_buffer* dst, parg_buffer* src)
+{
+    parg_assert(!parg_buffer_gpu_check(src), "CPU source buffer required");
+    parg_assert(parg_buffer_length(dst) >= parg_buffer_length(src),
+        "Destination buffer is too small");
+    return parg_buffer_length(src) / (sizeof(float) * 3);
+}
+
+void parg_buffer_transform(parg_buffer* dst, parg_buffer* src, Matrix4 mat)
+{
+    batch_job job = {0};
+    int count = batch_count(dst, src);
+    job.mat = mat;
+    job.a = parg_buffer_lock(src, PARG_READ);
+    job.dst = parg_buffer_lock(dst, PARG_WRITE);
+    parg_parallel_for(count, BATCH_GRAIN, transform_range, &job);
+    parg_buffer_unlock(dst);
+    parg_buffer_unlock(src);
+}
+
+void parg_buffer_normalize(parg_buffer* dst, parg_buffer* src)
+{
+    batch_job job = {0};
+    int count = batch_count(dst, src);
+    job.a = parg_buffer_lock(src, PARG_READ);
+    job.dst = parg_buffer_lock(dst, PARG_WRITE);
+    parg_parallel_for(count, BATCH_GRAIN, normalize_range, &job);
+    parg_buffer_unlock(dst);
+    parg_buffer_unlock(src);
+}
+
+void parg_buffer_cross(parg_buffer* dst, parg_buffer* a, parg_buffer* b)
+{
+    batch_job job = {0};
+    int count = batch_count(dst, a);
+    parg_assert(!parg_buffer_gpu_check(b), "CPU source buffer required");
+    parg_assert(parg_buffer_length(b) == parg_buffer_length(a),
+        "Source buffers differ in length");
+    job.a = parg_buffer_lock(a, PARG_READ);
+    job.b = parg_buffer_lock(b, PARG_READ);
+    job.dst = parg_buffer_lock(dst, PARG_WRITE);
+    parg_parallel_for(count, BATCH_GRAIN, cross_range, &job);
+    parg_buffer_unlock(dst);
+    parg_buffer_unlock(b);
+    parg_buffer_unlock(a);
+}
+
+parg_buffer* parg_buffer_from_doubles(
+    const double* src, int count, parg_buffer** lowpart)
+{
+    int nbytes = sizeof(float) * count;
+    parg_buffer* retval = parg_buffer_alloc(nbytes, PARG_GPU_ARRAY);
+    *lowpart = parg_buffer_alloc(nbytes, PARG_GPU_ARRAY);
+    batch_job job = {0};
+    job.src = src;
+    job.dst = parg_buffer_lock(retval, PARG_WRITE);
+    job.lo = parg_buffer_lock(*lowpart, PARG_WRITE);
+    parg_parallel_for(count, BATCH_GRAIN * 3, split_range, &job);
+    parg_buffer_unlock(*lowpart);
+    parg_buffer_unlock(retval);
+    return retval;
+}
+
 parg_buffer* parg_buffer_from_file(const char* filepath)
 {
     FILE* f = fopen(filepath, "rb");
@@ -10,10 +10,21 @@ void parg_draw_clear()
     glClear(planes);
 }
 
-void parg_draw_one_quad() { glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); }
+static void count_draw(int ntriangles)
+{
+    _parg_counters.draws++;
+    _parg_counters.triangles += ntriangles;
+}
+
+void parg_draw_one_quad()
+{
+    count_draw(2);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
 void parg_draw_triangles(int start, int count)
 {
+    count_draw(count);
     glDrawArrays(GL_TRIANGLES, start * 3, count * 3);
 }
 
@@ -21,6 +32,7 @@ void parg_draw_triangles_u16(int start, int count)
 {
     long offset = start * 3 * sizeof(unsigned short);
     const GLvoid* ptr = (const GLvoid*) offset;
+    count_draw(count);
     glDrawElements(GL_TRIANGLES, count * 3, GL_UNSIGNED_SHORT, ptr);
 }
 
@@ -33,6 +45,7 @@ void parg_draw_wireframe_triangles_u16(int start, int count)
     glEnable(GL_POLYGON_OFFSET_LINE);
     long offset = start * 3 * sizeof(unsigned short);
     const GLvoid* ptr = (const GLvoid*) offset;
+    count_draw(count);
     glDrawElements(GL_TRIANGLES, count * 3, GL_UNSIGNED_SHORT, ptr);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     glDisable(GL_POLYGON_OFFSET_LINE);
@@ -42,15 +55,19 @@ void parg_draw_wireframe_triangles_u16(int start, int count)
 void parg_draw_lines(int nsegments)
 {
     glLineWidth(2);
+    count_draw(0);
     glDrawArrays(GL_LINES, 0, nsegments * 2);
 }
 
-void parg_draw_points(int npoints)
+void parg_draw_points(int npoints) { parg_draw_points_range(0, npoints); }
+
+void parg_draw_points_range(int start, int count)
 {
 #if defined(GL_PROGRAM_POINT_SIZE)
     glEnable(GL_PROGRAM_POINT_SIZE);
 #elif defined(GL_VERTEX_PROGRAM_POINT_SIZE)
     glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
 #endif
-    glDrawArrays(GL_POINTS, 0, npoints);
+    count_draw(0);
+    glDrawArrays(GL_POINTS, start, count);
 }
@@ -16,6 +16,7 @@ struct parg_framebuffer_s {
     GLuint tex;
     GLuint fbo;
     GLuint depth;
+    int nbytes;
 };
 
 static GLint pushed_fbo = 0;
@@ -70,6 +71,11 @@ parg_framebuffer* parg_framebuffer_create_empty(
     framebuffer->tex = tex;
     framebuffer->fbo = fbo;
     framebuffer->depth = depth;
+    int texelsize = (format == GL_RGBA ? 4 : 3) *
+        (type == GL_FLOAT ? 4 : type == GL_UNSIGNED_BYTE ? 1 : 2);
+    framebuffer->nbytes = width * height * (texelsize + (depth ? 2 : 0));
+    _parg_counters.live_framebuffers++;
+    _parg_counters.framebuffer_bytes += framebuffer->nbytes;
     return framebuffer;
 }
 
@@ -85,6 +91,8 @@ parg_framebuffer* parg_framebuffer_create(
     }
     parg_framebuffer* fbo = parg_framebuffer_create_empty(width, height, flags);
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, type, src);
+    _parg_counters.texture_uploads++;
+    _parg_counters.uploaded_bytes += nbytes;
     return fbo;
 }
 
@@ -92,6 +100,11 @@ void parg_framebuffer_free(parg_framebuffer* framebuffer)
 {
     glDeleteTextures(1, &framebuffer->tex);
     glDeleteFramebuffers(1, &framebuffer->fbo);
+    if (framebuffer->depth) {
+        glDeleteRenderbuffers(1, &framebuffer->depth);
+    }
+    _parg_counters.live_framebuffers--;
+    _parg_counters.framebuffer_bytes -= framebuffer->nbytes;
     free(framebuffer);
 }
 
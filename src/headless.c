@@ -0,0 +1,290 @@
+#include <parg.h>
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include "internal.h"
+#include "pargl.h"
+#include "lodepng.h"
+
+// EGL and OSMesa are loaded at runtime, so neither is needed to build parg
+// or to run it with a window.  EGL is tried first since it can drive a GPU
+// as well as llvmpipe; it prefers the surfaceless platform, which needs no
+// display server.  OSMesa always renders on the CPU.  Both hand out contexts
+// whose default framebuffer is never drawn to; frames go to an FBO instead.
+//
+// parg calls GL directly, so the entry points that the process links
+// against must dispatch to the new context.  That holds for EGL with a
+// GLVND libGL, but OSMesa needs the process to link against or preload
+// libOSMesa in place of libGL.  A backend whose context cannot be reached
+// that way is reported as a failure rather than rendering nothing.
+
+#define EGL_DEFAULT_DISPLAY ((void*) 0)
+#define EGL_NO_DISPLAY ((void*) 0)
+#define EGL_NO_CONTEXT ((void*) 0)
+#define EGL_NO_SURFACE ((void*) 0)
+#define EGL_ALPHA_SIZE 0x3021
+#define EGL_BLUE_SIZE 0x3022
+#define EGL_GREEN_SIZE 0x3023
+#define EGL_RED_SIZE 0x3024
+#define EGL_DEPTH_SIZE 0x3025
+#define EGL_SURFACE_TYPE 0x3033
+#define EGL_NONE 0x3038
+#define EGL_RENDERABLE_TYPE 0x3040
+#define EGL_EXTENSIONS 0x3055
+#define EGL_HEIGHT 0x3056
+#define EGL_WIDTH 0x3057
+#define EGL_OPENGL_API 0x30A2
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#define EGL_PBUFFER_BIT 0x0001
+#define EGL_OPENGL_BIT 0x0008
+#define OSMESA_RGBA 0x1908
+
+#define READBACK_BUFFERS 3
+
+typedef struct {
+    void* (*GetProcAddress)(const char*);
+    void* (*GetDisplay)(void*);
+    void* (*GetPlatformDisplayEXT)(unsigned, void*, const int*);
+    unsigned (*Initialize)(void*, int*, int*);
+    const char* (*QueryString)(void*, int);
+    unsigned (*ChooseConfig)(void*, const int*, void**, int, int*);
+    unsigned (*BindAPI)(unsigned);
+    void* (*CreateContext)(void*, void*, void*, const int*);
+    void* (*CreatePbufferSurface)(void*, void*, const int*);
+    unsigned (*MakeCurrent)(void*, void*, void*, void*);
+    unsigned (*DestroyContext)(void*, void*);
+    unsigned (*DestroySurface)(void*, void*);
+    unsigned (*Terminate)(void*);
+} egl_api;
+
+typedef struct {
+    void* (*CreateContextExt)(GLenum, GLint, GLint, GLint, void*);
+    GLboolean (*MakeCurrent)(void*, void*, GLenum, GLsizei, GLsizei);
+    void (*DestroyContext)(void*);
+} osmesa_api;
+
+struct parg_headless_s {
+    void* library;
+    void* context;
+    void* display;
+    void* surface;
+    void* pixels;
+    egl_api egl;
+    osmesa_api osmesa;
+};
+
+struct parg_readback_s {
+    int width;
+    int height;
+    int next;
+    GLuint pbos[READBACK_BUFFERS];
+    sds paths[READBACK_BUFFERS];
+};
+
+static int load(void* library, void* fnptr, const char* prefix,
+    const char* name)
+{
+    char symbol[64];
+    snprintf(symbol, sizeof(symbol), "%s%s", prefix, name);
+    *(void**) fnptr = dlsym(library, symbol);
+    return *(void**) fnptr != 0;
+}
+
+static int create_egl(parg_headless* hl)
+{
+    egl_api* egl = &hl->egl;
+    hl->library = dlopen("libEGL.so.1", RTLD_NOW | RTLD_GLOBAL);
+    void* lib = hl->library;
+    if (!lib || !load(lib, &egl->GetProcAddress, "egl", "GetProcAddress") ||
+        !load(lib, &egl->GetDisplay, "egl", "GetDisplay") ||
+        !load(lib, &egl->Initialize, "egl", "Initialize") ||
+        !load(lib, &egl->QueryString, "egl", "QueryString") ||
+        !load(lib, &egl->ChooseConfig, "egl", "ChooseConfig") ||
+        !load(lib, &egl->BindAPI, "egl", "BindAPI") ||
+        !load(lib, &egl->CreateContext, "egl", "CreateContext") ||
+        !load(lib, &egl->CreatePbufferSurface, "egl",
+            "CreatePbufferSurface") ||
+        !load(lib, &egl->MakeCurrent, "egl", "MakeCurrent") ||
+        !load(lib, &egl->DestroyContext, "egl", "DestroyContext") ||
+        !load(lib, &egl->DestroySurface, "egl", "DestroySurface") ||
+        !load(lib, &egl->Terminate, "egl", "Terminate")) {
+        return 0;
+    }
+    const char* exts = egl->QueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    *(void**) &egl->GetPlatformDisplayEXT =
+        egl->GetProcAddress("eglGetPlatformDisplayEXT");
+    if (exts && strstr(exts, "EGL_MESA_platform_surfaceless") &&
+        egl->GetPlatformDisplayEXT) {
+        hl->display = egl->GetPlatformDisplayEXT(
+            EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+    }
+    if (!hl->display) {
+        hl->display = egl->GetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (!hl->display || !egl->Initialize(hl->display, 0, 0)) {
+        hl->display = 0;
+        return 0;
+    }
+
+    // Without surfaceless contexts, a tiny pbuffer stands in for the
+    // default framebuffer.
+    exts = egl->QueryString(hl->display, EGL_EXTENSIONS);
+    int surfaceless = exts && strstr(exts, "EGL_KHR_surfaceless_context");
+    const int attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT, EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 16, EGL_NONE};
+    const int pbuffer[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    void* config;
+    int nconfigs = 0;
+    if (!egl->ChooseConfig(hl->display, attribs, &config, 1, &nconfigs) ||
+        !nconfigs || !egl->BindAPI(EGL_OPENGL_API)) {
+        return 0;
+    }
+    hl->context =
+        egl->CreateContext(hl->display, config, EGL_NO_CONTEXT, 0);
+    if (!hl->context) {
+        return 0;
+    }
+    if (!surfaceless) {
+        hl->surface =
+            egl->CreatePbufferSurface(hl->display, config, pbuffer);
+    }
+    return egl->MakeCurrent(
+        hl->display, hl->surface, hl->surface, hl->context);
+}
+
+static int create_osmesa(parg_headless* hl, int width, int height)
+{
+    static const char* names[] = {
+        "libOSMesa.so.8", "libOSMesa.so.6", "libOSMesa.so"};
+    for (int i = 0; i < 3 && !hl->library; i++) {
+        hl->library = dlopen(names[i], RTLD_NOW | RTLD_GLOBAL);
+    }
+    osmesa_api* osmesa = &hl->osmesa;
+    void* lib = hl->library;
+    if (!lib || !load(lib, &osmesa->CreateContextExt, "OSMesa",
+                    "CreateContextExt") ||
+        !load(lib, &osmesa->MakeCurrent, "OSMesa", "MakeCurrent") ||
+        !load(lib, &osmesa->DestroyContext, "OSMesa", "DestroyContext")) {
+        return 0;
+    }
+    hl->context = osmesa->CreateContextExt(OSMESA_RGBA, 16, 0, 0, 0);
+    if (!hl->context) {
+        return 0;
+    }
+    hl->pixels = malloc(width * height * 4);
+    return osmesa->MakeCurrent(
+        hl->context, hl->pixels, GL_UNSIGNED_BYTE, width, height);
+}
+
+// Checks that parg's GL calls reach the context that was just made current.
+static int is_reachable()
+{
+    return glGetString(GL_VERSION) != 0;
+}
+
+parg_headless* parg_headless_create(const char* backend, int width, int height)
+{
+    int any = !backend || 0 == strcmp(backend, "auto");
+    if (any || 0 == strcmp(backend, "egl")) {
+        parg_headless* hl = calloc(sizeof(struct parg_headless_s), 1);
+        if (create_egl(hl) && is_reachable()) {
+            return hl;
+        }
+        parg_headless_free(hl);
+    }
+    if (any || 0 == strcmp(backend, "osmesa")) {
+        parg_headless* hl = calloc(sizeof(struct parg_headless_s), 1);
+        if (create_osmesa(hl, width, height) && is_reachable()) {
+            return hl;
+        }
+        parg_headless_free(hl);
+    }
+    return 0;
+}
+
+void parg_headless_free(parg_headless* hl)
+{
+    if (!hl) {
+        return;
+    }
+    egl_api* egl = &hl->egl;
+    if (hl->display) {
+        egl->MakeCurrent(
+            hl->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (hl->surface) {
+            egl->DestroySurface(hl->display, hl->surface);
+        }
+        if (hl->context) {
+            egl->DestroyContext(hl->display, hl->context);
+        }
+        egl->Terminate(hl->display);
+    } else if (hl->context) {
+        hl->osmesa.DestroyContext(hl->context);
+    }
+    if (hl->library) {
+        dlclose(hl->library);
+    }
+    free(hl->pixels);
+    free(hl);
+}
+
+parg_readback* parg_readback_create(int width, int height)
+{
+    parg_readback* rb = calloc(sizeof(struct parg_readback_s), 1);
+    rb->width = width;
+    rb->height = height;
+    glGenBuffers(READBACK_BUFFERS, rb->pbos);
+    for (int i = 0; i < READBACK_BUFFERS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbos[i]);
+        glBufferData(
+            GL_PIXEL_PACK_BUFFER, width * height * 4, 0, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return rb;
+}
+
+// Maps a pending readback, which waits for its copy if it is still in
+// flight, and writes it out with the first row at the top.
+static void finish_readback(parg_readback* rb, int slot)
+{
+    if (!rb->paths[slot]) {
+        return;
+    }
+    int rowsize = rb->width * 4;
+    unsigned char* image = malloc(rowsize * rb->height);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbos[slot]);
+    void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    memcpy(image, pixels, rowsize * rb->height);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    parg_texture_fliprows(image, rowsize, rb->height);
+    lodepng_encode32_file(rb->paths[slot], image, rb->width, rb->height);
+    free(image);
+    sdsfree(rb->paths[slot]);
+    rb->paths[slot] = 0;
+}
+
+void parg_readback_push(parg_readback* rb, const char* filepath)
+{
+    int slot = rb->next;
+    rb->next = (slot + 1) % READBACK_BUFFERS;
+    finish_readback(rb, slot);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbos[slot]);
+    glReadPixels(0, 0, rb->width, rb->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    rb->paths[slot] = sdsnew(filepath);
+}
+
+void parg_readback_free(parg_readback* rb)
+{
+    if (!rb) {
+        return;
+    }
+    for (int i = 0; i < READBACK_BUFFERS; i++) {
+        finish_readback(rb, (rb->next + i) % READBACK_BUFFERS);
+    }
+    glDeleteBuffers(READBACK_BUFFERS, rb->pbos);
+    free(rb);
+}
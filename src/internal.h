@@ -14,6 +14,7 @@ struct parg_mesh_s {
     parg_buffer* normals;
     parg_buffer* indices;
     int ntriangles;
+    DPoint3 origin;
 };
 
 void parg_load_obj(parg_mesh* mesh, parg_buffer* buffer);
@@ -25,6 +26,70 @@ sds parg_asset_baseurl();
 int parg_asset_fileexists(sds fullpath);
 int parg_asset_download(const char* filename, sds targetpath);
 parg_buffer* parg_asset_to_buffer(parg_token id);
+void parg_asset_release(parg_token id, parg_buffer* buf);
+void parg_buffer_tag_asset(parg_buffer* buf, parg_token id);
+void parg_buffer_swap(parg_buffer* a, parg_buffer* b);
+int parg_shader_reload_asset(parg_token id);
+int parg_texture_reload_asset(parg_token id);
+
+// Compressed textures are stored as a header of {width, height, codec,
+// nlevels, hash} followed by the blocks of each mip level.
+#define PARG_TEXTURE_HEADER 5
+parg_buffer* parg_texture_encode(const void* rgba, int width, int height,
+    parg_texture_codec codec, parg_mipmap_filter filter, uint32_t hash);
+int parg_texture_codec_nbytes(parg_texture_codec codec, int width, int height);
+uint32_t parg_texture_hash(const void* data, int nbytes);
+uint16_t parg_texture_half(float value);
+
+// Each returns a malloc'd level that is half the size of the source.
+void* parg_mipmap_u8(const void* src, int width, int height, int ncomps,
+    parg_mipmap_filter filter);
+void* parg_mipmap_f32(const void* src, int width, int height, int ncomps,
+    parg_mipmap_filter filter);
+
+// Decodes a PNG to RGBA8, optionally with the last row first.  Returns a
+// lodepng error code.
+unsigned parg_png_decode(unsigned char** out, unsigned* width,
+    unsigned* height, const unsigned char* in, size_t insize, int bottomup);
+
+// Large images are also baked as horizontal strips, each its own PNG, so
+// that they can be inflated in parallel.  Encoding returns null for images
+// too short to split, and decoding fails for bakes of a different source,
+// as identified by hash.
+parg_buffer* parg_png_encode_strips(
+    const unsigned char* rgba, unsigned width, unsigned height, uint32_t hash);
+unsigned parg_png_decode_strips(unsigned char** out, unsigned* width,
+    unsigned* height, parg_buffer* strips, uint32_t hash, int bottomup);
+
+// Splits [0, count) into contiguous ranges and runs them on worker threads,
+// returning when all are done.  Runs serially for small counts.
+typedef void (*parg_range_fn)(void* context, int begin, int end);
+void parg_parallel_for(int count, int grain, parg_range_fn fn, void* context);
+int parg_parallel_threads();
+
+// Fixed-step scheduler behind parg_window_onupdate, shared by the desktop
+// and web windows.  Advancing runs as many steps as the wall-clock time
+// since the previous call covers and returns nonzero if any of them changed
+// the simulation.  Simulate runs steps without regard to the clock until
+// the given time, and wait shortens an idle timeout to the next step.
+int parg_window_advance(double now);
+void parg_window_simulate(float seconds);
+double parg_window_wait(double timeout);
+
+// Offscreen GL contexts for rendering without a window, from EGL or OSMesa
+// loaded at runtime.  The backend is "egl", "osmesa", or "auto" to try them
+// in that order.  Returns 0 if none is available.
+typedef struct parg_headless_s parg_headless;
+parg_headless* parg_headless_create(const char* backend, int width, int height);
+void parg_headless_free(parg_headless*);
+
+// Reads the bound framebuffer into a ring of pixel pack buffers and writes
+// each frame as a PNG once its slot comes around again, so that copies
+// overlap with rendering later frames.  Freeing writes the remaining ones.
+typedef struct parg_readback_s parg_readback;
+parg_readback* parg_readback_create(int width, int height);
+void parg_readback_push(parg_readback*, const char* filepath);
+void parg_readback_free(parg_readback*);
 
 // This takes two human-readable strings: the key and the metadata. The key
 // should not be generated by sprintf because it is used as a grouping key in
@@ -8,7 +8,7 @@
 
 parg_mesh* parg_mesh_create(float* pts, int npts, uint16_t* tris, int ntris)
 {
-    parg_mesh* surf = malloc(sizeof(struct parg_mesh_s));
+    parg_mesh* surf = calloc(sizeof(struct parg_mesh_s), 1);
     surf->coords =
         parg_buffer_create(pts, npts * sizeof(float) * 3, PARG_GPU_ARRAY);
     surf->uvs = 0;
@@ -62,7 +62,7 @@ Point3 knot_fn(float s, float t)
 
 parg_mesh* parg_mesh_knot(int slices, int stacks, float major, float minor)
 {
-    parg_mesh* surf = malloc(sizeof(struct parg_mesh_s));
+    parg_mesh* surf = calloc(sizeof(struct parg_mesh_s), 1);
     float ds = 1.0f / slices;
     float dt = 1.0f / stacks;
     int vertexCount = slices * stacks * 3;
@@ -73,20 +73,25 @@ parg_mesh* parg_mesh_knot(int slices, int stacks, float major, float minor)
         parg_buffer_alloc(vertexCount * vertexStride, PARG_GPU_ARRAY);
     surf->uvs = 0;
     Point3* position = (Point3*) parg_buffer_lock(surf->coords, PARG_WRITE);
-    Vector3* normal = (Vector3*) parg_buffer_lock(surf->normals, PARG_WRITE);
+    Vector3* tangents = malloc(sizeof(Vector3) * vertexCount * 2);
+    Vector3* du = tangents;
+    Vector3* dv = tangents + vertexCount;
     for (float s = 0; s < 1 - ds / 2; s += ds) {
         for (float t = 0; t < 1 - dt / 2; t += dt) {
             const float E = 0.01f;
             Point3 p = knot_fn(s, t);
-            Vector3 u = P3Sub(knot_fn(s + E, t), p);
-            Vector3 v = P3Sub(knot_fn(s, t + E), p);
-            Vector3 n = V3Normalize(V3Cross(u, v));
+            *du++ = P3Sub(knot_fn(s + E, t), p);
+            *dv++ = P3Sub(knot_fn(s, t + E), p);
             *position++ = p;
-            *normal++ = n;
         }
     }
     parg_buffer_unlock(surf->coords);
+    float* normal = parg_buffer_lock(surf->normals, PARG_WRITE);
+    int npoints = du - tangents;
+    V3CrossArray(normal, &tangents->x, &tangents[vertexCount].x, npoints);
+    V3NormalizeArray(normal, normal, npoints);
     parg_buffer_unlock(surf->normals);
+    free(tangents);
 
     surf->ntriangles = slices * stacks * 2;
     int indexCount = surf->ntriangles * 3;
@@ -120,7 +125,7 @@ parg_mesh* parg_mesh_knot(int slices, int stacks, float major, float minor)
 
 parg_mesh* parg_mesh_torus(int slices, int stacks, float major, float minor)
 {
-    parg_mesh* surf = malloc(sizeof(struct parg_mesh_s));
+    parg_mesh* surf = calloc(sizeof(struct parg_mesh_s), 1);
     float dphi = PARG_TWOPI / stacks;
     float dtheta = PARG_TWOPI / slices;
     int vertexCount = slices * stacks * 3;
@@ -140,7 +145,10 @@ parg_mesh* parg_mesh_torus(int slices, int stacks, float major, float minor)
 
     surf->normals =
         parg_buffer_alloc(vertexCount * vertexStride, PARG_GPU_ARRAY);
-    Vector3* normal = (Vector3*) parg_buffer_lock(surf->normals, PARG_WRITE);
+    int npoints = slices * stacks;
+    Vector3* tangents = malloc(sizeof(Vector3) * npoints * 2);
+    Vector3* du = tangents;
+    Vector3* dv = tangents + npoints;
     for (int slice = 0; slice < slices; slice++) {
         float theta = slice * dtheta;
         for (int stack = 0; stack < stacks; stack++) {
@@ -148,13 +156,15 @@ parg_mesh* parg_mesh_torus(int slices, int stacks, float major, float minor)
             Point3 p = torus_fn(major, minor, phi, theta);
             Point3 p1 = torus_fn(major, minor, phi, theta + 0.01);
             Point3 p2 = torus_fn(major, minor, phi + 0.01, theta);
-            Vector3 du = P3Sub(p2, p);
-            Vector3 dv = P3Sub(p1, p);
-            *normal = V3Normalize(V3Cross(du, dv));
-            ++normal;
+            *du++ = P3Sub(p2, p);
+            *dv++ = P3Sub(p1, p);
         }
     }
+    float* normal = parg_buffer_lock(surf->normals, PARG_WRITE);
+    V3CrossArray(normal, &tangents->x, &tangents[npoints].x, npoints);
+    V3NormalizeArray(normal, normal, npoints);
     parg_buffer_unlock(surf->normals);
+    free(tangents);
 
     surf->ntriangles = slices * stacks * 2;
     int indexCount = surf->ntriangles * 3;
@@ -188,7 +198,7 @@ parg_mesh* parg_mesh_torus(int slices, int stacks, float major, float minor)
 
 parg_mesh* parg_mesh_aar(parg_aar rect)
 {
-    parg_mesh* surf = malloc(sizeof(struct parg_mesh_s));
+    parg_mesh* surf = calloc(sizeof(struct parg_mesh_s), 1);
     surf->normals = 0;
     surf->indices = 0;
     surf->ntriangles = 2;
@@ -228,7 +238,7 @@ parg_mesh* parg_mesh_rectangle(float width, float height)
 
 parg_mesh* parg_mesh_sierpinski(float width, int depth)
 {
-    parg_mesh* surf = malloc(sizeof(struct parg_mesh_s));
+    parg_mesh* surf = calloc(sizeof(struct parg_mesh_s), 1);
     surf->normals = 0;
     surf->indices = 0;
     surf->uvs = 0;
@@ -320,6 +330,10 @@ parg_buffer* parg_mesh_index(parg_mesh* m) { return m->indices; }
 
 int parg_mesh_ntriangles(parg_mesh* m) { return m->ntriangles; }
 
+void parg_mesh_set_origin(parg_mesh* m, DPoint3 origin) { m->origin = origin; }
+
+DPoint3 parg_mesh_origin(parg_mesh* m) { return m->origin; }
+
 parg_mesh* parg_mesh_from_asset(parg_token id)
 {
     parg_mesh* surf = calloc(sizeof(struct parg_mesh_s), 1);
@@ -0,0 +1,428 @@
+#include <parg.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "internal.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+// CPU mip generation.  Each call produces the next level from a 2x2
+// footprint, or from an 8x8 one for the Kaiser filter, splitting the
+// destination rows across threads.
+
+#define MIPMAP_GRAIN 32
+
+// The Kaiser filter is a sinc at half the source rate, windowed to eight
+// taps that are centered between the two texels a box filter averages.
+// Its negative lobes keep more detail than a box but can ring, so u8
+// results are clamped.
+#define KAISER_TAPS 8
+#define KAISER_BETA 4.0
+#define KAISER_LEFT (KAISER_TAPS / 2 - 1)
+
+typedef struct {
+    const void* src;
+    void* dst;
+    int width;
+    int height;
+    int ncomps;
+    parg_mipmap_filter filter;
+} mipmap_job;
+
+static uint16_t _to_linear[256];
+static uint8_t _from_linear[4096];
+static float _kaiser[KAISER_TAPS];
+
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; k++) {
+        term *= (x * x) / (4.0 * k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+static void init_kaiser_weights()
+{
+    if (_kaiser[0]) {
+        return;
+    }
+    double weights[KAISER_TAPS], sum = 0;
+    for (int k = 0; k < KAISER_TAPS; k++) {
+        double t = k - KAISER_LEFT - 0.5;
+        double x = PARG_PI * t / 2;
+        double r = t / (KAISER_TAPS / 2);
+        double window = bessel_i0(KAISER_BETA * sqrt(1 - r * r)) /
+            bessel_i0(KAISER_BETA);
+        weights[k] = sin(x) / x * window;
+        sum += weights[k];
+    }
+    for (int k = 0; k < KAISER_TAPS; k++) {
+        _kaiser[k] = weights[k] / sum;
+    }
+}
+
+static void init_gamma_tables()
+{
+    if (_to_linear[255]) {
+        return;
+    }
+    for (int i = 0; i < 256; i++) {
+        _to_linear[i] = 0.5 + 65535.0 * pow(i / 255.0, 2.2);
+    }
+    for (int i = 0; i < 4096; i++) {
+        _from_linear[i] = 0.5 + 255.0 * pow((i + 0.5) / 4096.0, 1.0 / 2.2);
+    }
+}
+
+// Returns the number of color channels that should be gamma-corrected;
+// single-channel textures are uploaded as ALPHA.
+static int color_channels(int ncomps)
+{
+    return ncomps == 1 ? 0 : (ncomps == 2 ? 1 : 3);
+}
+
+#ifdef __SSE2__
+static int rgba8_simd(const uint8_t* row0, const uint8_t* row1, uint8_t* out,
+    int dstwidth, parg_mipmap_filter filter)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i two = _mm_set1_epi16(2);
+    int x = 0;
+    for (; x + 2 <= dstwidth; x += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (row0 + x * 8));
+        __m128i b = _mm_loadu_si128((const __m128i*) (row1 + x * 8));
+        __m128i result;
+        if (filter == PARG_MIPMAP_MAX) {
+            __m128i m = _mm_max_epu8(a, b);
+            m = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+            result = _mm_shuffle_epi32(m, _MM_SHUFFLE(3, 1, 2, 0));
+        } else {
+            __m128i lo = _mm_add_epi16(
+                _mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i hi = _mm_add_epi16(
+                _mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+            hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+            __m128i sum = _mm_unpacklo_epi64(lo, hi);
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+            result = _mm_packus_epi16(sum, sum);
+        }
+        _mm_storel_epi64((__m128i*) (out + x * 4), result);
+    }
+    return x;
+}
+
+static int f32_simd(const float* row0, const float* row1, float* out,
+    int dstwidth, int ncomps, parg_mipmap_filter filter)
+{
+    int domax = filter == PARG_MIPMAP_MAX;
+    __m128 quarter = _mm_set1_ps(0.25f);
+    int x = 0;
+#ifdef __AVX__
+    // Gathers the left and right halves of each 2x2 footprint into separate
+    // registers, two destination texels or eight pixels at a time.
+    __m256 quarter8 = _mm256_set1_ps(0.25f);
+    int step = ncomps == 4 ? 2 : 8;
+    for (; (ncomps == 4 || ncomps == 1) && x + step <= dstwidth; x += step) {
+        const float* a = row0 + x * 2 * ncomps;
+        const float* b = row1 + x * 2 * ncomps;
+        __m256 s0 = domax
+            ? _mm256_max_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b))
+            : _mm256_add_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b));
+        __m256 s1 = domax
+            ? _mm256_max_ps(_mm256_loadu_ps(a + 8), _mm256_loadu_ps(b + 8))
+            : _mm256_add_ps(_mm256_loadu_ps(a + 8), _mm256_loadu_ps(b + 8));
+        __m256 lo = _mm256_permute2f128_ps(s0, s1, 0x20);
+        __m256 hi = _mm256_permute2f128_ps(s0, s1, 0x31);
+        __m256 left = lo, right = hi;
+        if (ncomps == 1) {
+            left = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+            right = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+        }
+        __m256 r = domax ? _mm256_max_ps(left, right)
+            : _mm256_mul_ps(_mm256_add_ps(left, right), quarter8);
+        _mm256_storeu_ps(out + x * ncomps, r);
+    }
+#endif
+    if (ncomps == 4) {
+        for (; x < dstwidth; x++) {
+            __m128 a = _mm_loadu_ps(row0 + x * 8);
+            __m128 b = _mm_loadu_ps(row0 + x * 8 + 4);
+            __m128 c = _mm_loadu_ps(row1 + x * 8);
+            __m128 d = _mm_loadu_ps(row1 + x * 8 + 4);
+            __m128 r = domax ? _mm_max_ps(_mm_max_ps(a, b), _mm_max_ps(c, d))
+                : _mm_mul_ps(
+                    _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d)), quarter);
+            _mm_storeu_ps(out + x * 4, r);
+        }
+    } else if (ncomps == 1) {
+        for (; x + 4 <= dstwidth; x += 4) {
+            __m128 a0 = _mm_loadu_ps(row0 + x * 2);
+            __m128 a1 = _mm_loadu_ps(row0 + x * 2 + 4);
+            __m128 b0 = _mm_loadu_ps(row1 + x * 2);
+            __m128 b1 = _mm_loadu_ps(row1 + x * 2 + 4);
+            __m128 s0 = domax ? _mm_max_ps(a0, b0) : _mm_add_ps(a0, b0);
+            __m128 s1 = domax ? _mm_max_ps(a1, b1) : _mm_add_ps(a1, b1);
+            __m128 even = _mm_shuffle_ps(s0, s1, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 odd = _mm_shuffle_ps(s0, s1, _MM_SHUFFLE(3, 1, 3, 1));
+            __m128 r = domax ? _mm_max_ps(even, odd)
+                : _mm_mul_ps(_mm_add_ps(even, odd), quarter);
+            _mm_storeu_ps(out + x, r);
+        }
+    }
+    return x;
+}
+#endif
+
+static void u8_rows(void* context, int begin, int end)
+{
+    mipmap_job* job = context;
+    int w = job->width, h = job->height, n = job->ncomps;
+    int dw = PARG_MAX(w / 2, 1);
+    int ncolors = color_channels(n);
+    const uint8_t* src = job->src;
+    for (int y = begin; y < end; y++) {
+        const uint8_t* row0 = src + PARG_MIN(y * 2, h - 1) * w * n;
+        const uint8_t* row1 = src + PARG_MIN(y * 2 + 1, h - 1) * w * n;
+        uint8_t* out = (uint8_t*) job->dst + y * dw * n;
+        int x = 0;
+#ifdef __SSE2__
+        if (n == 4 && w > 1 && job->filter != PARG_MIPMAP_GAMMA) {
+            x = rgba8_simd(row0, row1, out, dw, job->filter);
+        }
+#endif
+        for (; x < dw; x++) {
+            int x0 = PARG_MIN(x * 2, w - 1) * n;
+            int x1 = PARG_MIN(x * 2 + 1, w - 1) * n;
+            for (int c = 0; c < n; c++) {
+                int a = row0[x0 + c], b = row0[x1 + c];
+                int d = row1[x0 + c], e = row1[x1 + c];
+                if (job->filter == PARG_MIPMAP_MAX) {
+                    out[x * n + c] = PARG_MAX(PARG_MAX(a, b), PARG_MAX(d, e));
+                } else if (job->filter == PARG_MIPMAP_GAMMA && c < ncolors) {
+                    int sum = _to_linear[a] + _to_linear[b] + _to_linear[d] +
+                        _to_linear[e];
+                    out[x * n + c] = _from_linear[sum >> 6];
+                } else {
+                    out[x * n + c] = (a + b + d + e + 2) >> 2;
+                }
+            }
+        }
+    }
+}
+
+static void f32_rows(void* context, int begin, int end)
+{
+    mipmap_job* job = context;
+    int w = job->width, h = job->height, n = job->ncomps;
+    int dw = PARG_MAX(w / 2, 1);
+    const float* src = job->src;
+    for (int y = begin; y < end; y++) {
+        const float* row0 = src + PARG_MIN(y * 2, h - 1) * w * n;
+        const float* row1 = src + PARG_MIN(y * 2 + 1, h - 1) * w * n;
+        float* out = (float*) job->dst + y * dw * n;
+        int x = 0;
+#ifdef __SSE2__
+        if (w > 1) {
+            x = f32_simd(row0, row1, out, dw, n, job->filter);
+        }
+#endif
+        for (; x < dw; x++) {
+            int x0 = PARG_MIN(x * 2, w - 1) * n;
+            int x1 = PARG_MIN(x * 2 + 1, w - 1) * n;
+            for (int c = 0; c < n; c++) {
+                float a = row0[x0 + c], b = row0[x1 + c];
+                float d = row1[x0 + c], e = row1[x1 + c];
+                out[x * n + c] = job->filter == PARG_MIPMAP_MAX
+                    ? PARG_MAX(PARG_MAX(a, b), PARG_MAX(d, e))
+                    : 0.25f * (a + b + d + e);
+            }
+        }
+    }
+}
+
+// Adds a weighted source row into a float row.
+static void accumulate_u8(
+    float* dst, const uint8_t* src, float weight, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+#ifdef __AVX__
+    __m256 w8 = _mm256_set1_ps(weight);
+#else
+    __m128 w4 = _mm_set1_ps(weight);
+#endif
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((const __m128i*) (src + i)), zero);
+        __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+        __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero));
+#ifdef __AVX__
+        __m256 v8 = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+        __m256 d = _mm256_loadu_ps(dst + i);
+        d = _mm256_add_ps(d, _mm256_mul_ps(v8, w8));
+        _mm256_storeu_ps(dst + i, d);
+#else
+        _mm_storeu_ps(dst + i,
+            _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(lo, w4)));
+        _mm_storeu_ps(dst + i + 4,
+            _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_mul_ps(hi, w4)));
+#endif
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] += src[i] * weight;
+    }
+}
+
+static void accumulate_f32(
+    float* dst, const float* src, float weight, int count)
+{
+    int i = 0;
+#ifdef __AVX__
+    __m256 w8 = _mm256_set1_ps(weight);
+    for (; i + 8 <= count; i += 8) {
+        __m256 d = _mm256_loadu_ps(dst + i);
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(src + i), w8));
+        _mm256_storeu_ps(dst + i, d);
+    }
+#endif
+#ifdef __SSE2__
+    __m128 w4 = _mm_set1_ps(weight);
+    for (; i + 4 <= count; i += 4) {
+        __m128 d = _mm_loadu_ps(dst + i);
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(src + i), w4));
+        _mm_storeu_ps(dst + i, d);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] += src[i] * weight;
+    }
+}
+
+// Filters the source rows under one destination row into a float row that
+// is padded on either side with copies of the edge texels, so that the
+// horizontal taps never need clamping.
+static void kaiser_vertical(mipmap_job* job, int y, float* row, int elemsize)
+{
+    int w = job->width, h = job->height, n = job->ncomps;
+    float* body = row + KAISER_LEFT * n;
+    memset(body, 0, w * n * sizeof(float));
+    for (int k = 0; k < KAISER_TAPS; k++) {
+        int sy = PARG_CLAMP(y * 2 - KAISER_LEFT + k, 0, h - 1);
+        const char* src = (const char*) job->src + sy * w * n * elemsize;
+        if (elemsize == 1) {
+            accumulate_u8(body, (const uint8_t*) src, _kaiser[k], w * n);
+        } else {
+            accumulate_f32(body, (const float*) src, _kaiser[k], w * n);
+        }
+    }
+    for (int x = 0; x < KAISER_LEFT; x++) {
+        memcpy(row + x * n, body, n * sizeof(float));
+    }
+    for (int x = 0; x <= KAISER_LEFT + 1; x++) {
+        memcpy(body + (w + x) * n, body + (w - 1) * n, n * sizeof(float));
+    }
+}
+
+// Applies the horizontal taps to a padded row, returning one float per
+// destination channel.
+static void kaiser_horizontal(const float* row, float* out, int dw, int n)
+{
+    int x = 0;
+#ifdef __SSE2__
+    for (; n == 4 && x < dw; x++) {
+        const float* src = row + x * 2 * 4;
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < KAISER_TAPS; k++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + k * 4),
+                _mm_set1_ps(_kaiser[k])));
+        }
+        _mm_storeu_ps(out + x * 4, sum);
+    }
+#endif
+    for (; x < dw; x++) {
+        for (int c = 0; c < n; c++) {
+            float sum = 0;
+            for (int k = 0; k < KAISER_TAPS; k++) {
+                sum += row[(x * 2 + k) * n + c] * _kaiser[k];
+            }
+            out[x * n + c] = sum;
+        }
+    }
+}
+
+static void kaiser_rows(void* context, int begin, int end, int elemsize)
+{
+    mipmap_job* job = context;
+    int w = job->width, n = job->ncomps;
+    int dw = PARG_MAX(w / 2, 1);
+    float* row = malloc((w + KAISER_TAPS) * n * sizeof(float));
+    float* filtered = elemsize == 1 ? malloc(dw * n * sizeof(float)) : 0;
+    for (int y = begin; y < end; y++) {
+        kaiser_vertical(job, y, row, elemsize);
+        if (elemsize == 1) {
+            uint8_t* out = (uint8_t*) job->dst + y * dw * n;
+            kaiser_horizontal(row, filtered, dw, n);
+            for (int i = 0; i < dw * n; i++) {
+                out[i] = PARG_CLAMP(filtered[i], 0, 255) + 0.5f;
+            }
+        } else {
+            kaiser_horizontal(row, (float*) job->dst + y * dw * n, dw, n);
+        }
+    }
+    free(filtered);
+    free(row);
+}
+
+static void kaiser_u8_rows(void* context, int begin, int end)
+{
+    kaiser_rows(context, begin, end, 1);
+}
+
+static void kaiser_f32_rows(void* context, int begin, int end)
+{
+    kaiser_rows(context, begin, end, sizeof(float));
+}
+
+static void* downsample(mipmap_job* job, int elemsize, parg_range_fn fn)
+{
+    int dw = PARG_MAX(job->width / 2, 1);
+    int dh = PARG_MAX(job->height / 2, 1);
+    job->dst = malloc(dw * dh * job->ncomps * elemsize);
+    parg_parallel_for(dh, MIPMAP_GRAIN, fn, job);
+    return job->dst;
+}
+
+void* parg_mipmap_u8(const void* src, int width, int height, int ncomps,
+    parg_mipmap_filter filter)
+{
+    if (filter == PARG_MIPMAP_GAMMA) {
+        init_gamma_tables();
+    }
+    mipmap_job job = {src, 0, width, height, ncomps, filter};
+    if (filter == PARG_MIPMAP_KAISER) {
+        init_kaiser_weights();
+        return downsample(&job, 1, kaiser_u8_rows);
+    }
+    return downsample(&job, 1, u8_rows);
+}
+
+void* parg_mipmap_f32(const void* src, int width, int height, int ncomps,
+    parg_mipmap_filter filter)
+{
+    mipmap_job job = {src, 0, width, height, ncomps, filter};
+    if (filter == PARG_MIPMAP_KAISER) {
+        init_kaiser_weights();
+        return downsample(&job, sizeof(float), kaiser_f32_rows);
+    }
+    return downsample(&job, sizeof(float), f32_rows);
+}
@@ -0,0 +1,678 @@
+#include <parg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "internal.h"
+#include "kvec.h"
+#include "khash.h"
+
+#define PAR_MSQUARES_IMPLEMENTATION
+#include <par/par_msquares.h>
+
+#if !EMSCRIPTEN
+#include <pthread.h>
+#endif
+
+// The image is split into strips of whole cell rows, and each strip is
+// meshed by par_msquares on its own thread.  Adjacent strips share the row
+// of pixels along their seam, so the vertices on a seam coincide.  Meshing
+// runs on a background thread that owns its own copy of the image and
+// writes each strip's meshes into a back buffer.  Edits go into a second
+// copy of the image, and once the job is idle, the dirty strips are copied
+// over and re-meshed.  Finished strips are swapped into the front buffer on
+// the GL thread, so the meshes that are being drawn never wait for a job.
+//
+// Every strip of every mesh has its own range of the vertex buffer and of
+// the index buffer, with some slack, and is drawn with its own vertex
+// offset.  A re-meshed strip that still fits is rewritten in place; the
+// buffers are laid out again only when one of them overflows.  Strips are
+// welded into a single mesh only when the CPU mesh is requested.
+
+#define STRIPS_PER_THREAD 2
+
+KHASH_MAP_INIT_INT(seam, int)
+
+typedef enum {
+    SOURCE_GRAY,
+    SOURCE_GRAY_MULTI,
+    SOURCE_COLOR,
+    SOURCE_COLOR_MULTI
+} msquares_source;
+
+// One strip of one mesh, with points normalized against the whole image.
+typedef struct {
+    int key;
+    uint32_t color;
+    kvec_t(float) points;
+    kvec_t(uint16_t) triangles;
+    int first;
+    int capacity;
+    int firsttriangle;
+    int trianglecapacity;
+    int stale;
+} msquares_piece;
+
+typedef kvec_t(msquares_piece) msquares_pieces;
+
+typedef struct {
+    int key;
+    uint32_t color;
+    msquares_piece* pieces;
+    kvec_t(float) points;
+    kvec_t(uint16_t) triangles;
+    parg_msquares_mesh mesh;
+    int welded;
+} msquares_output;
+
+struct parg_msquares_s {
+    msquares_source source;
+    void* pixels;
+    void* edited;
+    int width;
+    int height;
+    int cellsize;
+    int bpp;
+    uint32_t color;
+    float threshold;
+    float* thresholds;
+    int nthresholds;
+    int flags;
+    int nstrips;
+    msquares_pieces* built;
+    int* nbuilt;
+    int* dirty;
+    int* work;
+    int nwork;
+    kvec_t(msquares_output) outputs;
+    parg_buffer* coords;
+    parg_buffer* indices;
+    int stale;
+    int relayout;
+    int ready;
+    int running;
+#if !EMSCRIPTEN
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int threaded;
+#endif
+    int done;
+};
+
+static int strip_row(parg_msquares* job, int strip)
+{
+    int nrows = job->height / job->cellsize;
+    return (int) ((int64_t) nrows * strip / job->nstrips) * job->cellsize;
+}
+
+// Returns one past the last pixel row of the strip, which includes the seam
+// that it shares with the next strip.
+static int strip_end(parg_msquares* job, int strip)
+{
+    return strip == job->nstrips - 1 ? job->height
+                                     : strip_row(job, strip + 1) + 1;
+}
+
+// Copies one of par_msquares' meshes into the back buffer.  The strip's
+// coordinates are normalized by the larger of its own dimensions, so they
+// are converted to pixels, snapped to the seams, and then normalized against
+// the whole image.
+static void build_piece(parg_msquares* job, msquares_piece* piece,
+    par_msquares_mesh const* mesh, int y0, int stripheight)
+{
+    float tostrip = PARG_MAX(job->width, stripheight);
+    float toimage = 1.0f / PARG_MAX(job->width, job->height);
+    piece->points.n = piece->triangles.n = 0;
+    parg_assert(mesh->npoints <= 0x10000, "Too many vertices");
+    for (int i = 0; i < mesh->npoints; i++) {
+        const float* src = mesh->points + i * mesh->dim;
+        float x = src[0] * tostrip, y = src[1] * tostrip;
+        if (fabsf(y) < 0.01f) {
+            y = 0;
+        } else if (fabsf(y - (stripheight - 1)) < 0.01f) {
+            y = stripheight - 1;
+        }
+        kv_push(float, piece->points, x * toimage);
+        kv_push(float, piece->points, (y + y0) * toimage);
+        kv_push(float, piece->points, mesh->dim > 2 ? src[2] : 0);
+    }
+    for (int i = 0; i < mesh->ntriangles * 3; i++) {
+        kv_push(uint16_t, piece->triangles, mesh->triangles[i]);
+    }
+}
+
+static void mesh_strips(void* context, int begin, int end)
+{
+    parg_msquares* job = context;
+    int multicolor = job->source == SOURCE_COLOR_MULTI;
+    for (int i = begin; i < end; i++) {
+        int strip = job->work[i];
+        int y0 = strip_row(job, strip);
+        int y1 = strip_end(job, strip);
+        int w = job->width, h = y1 - y0, cs = job->cellsize;
+        int flags = job->flags;
+        float const* gray = (float const*) job->pixels + y0 * w;
+        uint8_t const* rgba = (uint8_t const*) job->pixels + y0 * w * job->bpp;
+        par_msquares_meshlist* mlist = 0;
+        switch (job->source) {
+        case SOURCE_GRAY:
+            mlist = par_msquares_grayscale(
+                gray, w, h, cs, job->threshold, flags);
+            break;
+        case SOURCE_GRAY_MULTI:
+            mlist = par_msquares_grayscale_multi(
+                gray, w, h, cs, job->thresholds, job->nthresholds, flags);
+            break;
+        case SOURCE_COLOR:
+            mlist = par_msquares_color(
+                rgba, w, h, cs, job->color, job->bpp, flags);
+            break;
+        case SOURCE_COLOR_MULTI:
+            mlist = par_msquares_color_multi(rgba, w, h, cs, job->bpp, flags);
+            break;
+        }
+
+        // Pieces beyond nbuilt keep their storage for the next edit.
+        msquares_pieces* built = job->built + strip;
+        int nmeshes = par_msquares_get_count(mlist);
+        while (kv_size(*built) < nmeshes) {
+            msquares_piece piece = {0};
+            kv_push(msquares_piece, *built, piece);
+        }
+        for (int m = 0; m < nmeshes; m++) {
+            par_msquares_mesh const* mesh = par_msquares_get_mesh(mlist, m);
+            msquares_piece* piece = &kv_A(*built, m);
+            piece->key = multicolor ? (int) mesh->color : m;
+            piece->color = mesh->color;
+            build_piece(job, piece, mesh, y0, h);
+        }
+        job->nbuilt[strip] = nmeshes;
+        par_msquares_free(mlist);
+    }
+}
+
+static void* run_job(void* arg)
+{
+    parg_msquares* job = arg;
+    parg_parallel_for(job->nwork, 1, mesh_strips, job);
+#if !EMSCRIPTEN
+    pthread_mutex_lock(&job->lock);
+    job->done = 1;
+    pthread_mutex_unlock(&job->lock);
+#else
+    job->done = 1;
+#endif
+    return 0;
+}
+
+// Copies the dirty strips of the edited image into the job's image and
+// starts re-meshing them.  Only called while no job is running.
+static void launch(parg_msquares* job)
+{
+    int pixelsize = job->bpp ? job->bpp : sizeof(float);
+    int rowsize = job->width * pixelsize;
+    job->nwork = 0;
+    for (int strip = 0; strip < job->nstrips; strip++) {
+        if (!job->dirty[strip]) {
+            continue;
+        }
+        int y0 = strip_row(job, strip), y1 = strip_end(job, strip);
+        memcpy((char*) job->pixels + y0 * rowsize,
+            (const char*) job->edited + y0 * rowsize, (y1 - y0) * rowsize);
+        job->work[job->nwork++] = strip;
+        job->dirty[strip] = 0;
+    }
+    if (!job->nwork) {
+        return;
+    }
+    job->done = 0;
+    job->running = 1;
+#if EMSCRIPTEN
+    run_job(job);
+#else
+    job->threaded = !pthread_create(&job->thread, 0, run_job, job);
+    if (!job->threaded) {
+        run_job(job);
+    }
+#endif
+}
+
+static msquares_output* find_output(parg_msquares* job, int key)
+{
+    for (int i = 0; i < kv_size(job->outputs); i++) {
+        if (kv_A(job->outputs, i).key == key) {
+            return &kv_A(job->outputs, i);
+        }
+    }
+    msquares_output output = {0};
+    output.key = key;
+    output.pieces = calloc(sizeof(msquares_piece), job->nstrips);
+    kv_push(msquares_output, job->outputs, output);
+    job->relayout = 1;
+    return &kv_A(job->outputs, kv_size(job->outputs) - 1);
+}
+
+// Moves the finished strips from the back buffer to the front buffer.  The
+// storage of the replaced pieces goes back to the worker for reuse.
+static void swap_strips(parg_msquares* job)
+{
+#if !EMSCRIPTEN
+    if (job->threaded) {
+        pthread_join(job->thread, 0);
+    }
+#endif
+    for (int i = 0; i < job->nwork; i++) {
+        int strip = job->work[i];
+        for (int o = 0; o < kv_size(job->outputs); o++) {
+            msquares_piece* piece = kv_A(job->outputs, o).pieces + strip;
+            piece->points.n = piece->triangles.n = 0;
+            piece->stale = 1;
+        }
+        for (int m = 0; m < job->nbuilt[strip]; m++) {
+            msquares_piece* src = &kv_A(job->built[strip], m);
+            msquares_output* out = find_output(job, src->key);
+            msquares_piece* dst = out->pieces + strip;
+            out->color = src->color;
+            msquares_piece tmp = *dst;
+            dst->points = src->points;
+            dst->triangles = src->triangles;
+            src->points = tmp.points;
+            src->triangles = tmp.triangles;
+        }
+    }
+    for (int o = 0; o < kv_size(job->outputs); o++) {
+        kv_A(job->outputs, o).welded = 0;
+    }
+    job->stale = 1;
+    job->ready = 1;
+    job->running = 0;
+}
+
+static int job_done(parg_msquares* job)
+{
+#if EMSCRIPTEN
+    return job->done;
+#else
+    pthread_mutex_lock(&job->lock);
+    int done = job->done;
+    pthread_mutex_unlock(&job->lock);
+    return done;
+#endif
+}
+
+// Swaps in finished strips and starts on edits that arrived in the meantime.
+// This blocks only while the job has never finished, since until then there
+// is nothing to draw.
+static void poll(parg_msquares* job)
+{
+    if (job->running && (!job->ready || job_done(job))) {
+        swap_strips(job);
+        launch(job);
+    }
+}
+
+static parg_msquares* start_job(parg_msquares* job, const void* pixels,
+    int nbytes)
+{
+    job->pixels = malloc(nbytes);
+    job->edited = malloc(nbytes);
+    memcpy(job->edited, pixels, nbytes);
+    int nrows = job->height / job->cellsize;
+    int nstrips = parg_parallel_threads() * STRIPS_PER_THREAD;
+    job->nstrips = PARG_CLAMP(nstrips, 1, PARG_MAX(nrows, 1));
+    // The walls that CONNECT adds around the boundary of each strip would
+    // show up along the seams, so those meshes are built in one piece.
+    if (job->flags & PAR_MSQUARES_CONNECT) {
+        job->nstrips = 1;
+    }
+    job->built = calloc(sizeof(msquares_pieces), job->nstrips);
+    job->nbuilt = calloc(sizeof(int), job->nstrips);
+    job->dirty = malloc(sizeof(int) * job->nstrips);
+    job->work = malloc(sizeof(int) * job->nstrips);
+    for (int strip = 0; strip < job->nstrips; strip++) {
+        job->dirty[strip] = 1;
+    }
+#if !EMSCRIPTEN
+    pthread_mutex_init(&job->lock, 0);
+#endif
+    launch(job);
+    return job;
+}
+
+static parg_msquares* create_job(msquares_source source, int width,
+    int height, int cellsize, int flags)
+{
+    parg_msquares* job = calloc(sizeof(struct parg_msquares_s), 1);
+    job->source = source;
+    job->width = width;
+    job->height = height;
+    job->cellsize = cellsize;
+    job->flags = flags;
+    return job;
+}
+
+parg_msquares* parg_msquares_grayscale(const float* data, int width,
+    int height, int cellsize, float threshold, int flags)
+{
+    parg_msquares* job =
+        create_job(SOURCE_GRAY, width, height, cellsize, flags);
+    job->threshold = threshold;
+    return start_job(job, data, width * height * sizeof(float));
+}
+
+parg_msquares* parg_msquares_grayscale_multi(const float* data, int width,
+    int height, int cellsize, const float* thresholds, int nthresholds,
+    int flags)
+{
+    parg_msquares* job =
+        create_job(SOURCE_GRAY_MULTI, width, height, cellsize, flags);
+    job->thresholds = malloc(sizeof(float) * nthresholds);
+    memcpy(job->thresholds, thresholds, sizeof(float) * nthresholds);
+    job->nthresholds = nthresholds;
+    return start_job(job, data, width * height * sizeof(float));
+}
+
+parg_msquares* parg_msquares_color(const parg_byte* data, int width,
+    int height, int cellsize, uint32_t color, int bpp, int flags)
+{
+    parg_msquares* job =
+        create_job(SOURCE_COLOR, width, height, cellsize, flags);
+    job->color = color;
+    job->bpp = bpp;
+    return start_job(job, data, width * height * bpp);
+}
+
+parg_msquares* parg_msquares_color_multi(const parg_byte* data, int width,
+    int height, int cellsize, int bpp, int flags)
+{
+    parg_msquares* job =
+        create_job(SOURCE_COLOR_MULTI, width, height, cellsize, flags);
+    job->bpp = bpp;
+    return start_job(job, data, width * height * bpp);
+}
+
+void parg_msquares_edit(parg_msquares* job, const void* data, int x, int y,
+    int width, int height)
+{
+    int pixelsize = job->bpp ? job->bpp : sizeof(float);
+    int rowsize = job->width * pixelsize;
+    x = PARG_CLAMP(x, 0, job->width);
+    y = PARG_CLAMP(y, 0, job->height);
+    width = PARG_MIN(width, job->width - x);
+    height = PARG_MIN(height, job->height - y);
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    for (int row = y; row < y + height; row++) {
+        int offset = row * rowsize + x * pixelsize;
+        memcpy((char*) job->edited + offset, (const char*) data + offset,
+            width * pixelsize);
+    }
+    for (int strip = 0; strip < job->nstrips; strip++) {
+        if (strip_row(job, strip) < y + height && y < strip_end(job, strip)) {
+            job->dirty[strip] = 1;
+        }
+    }
+    if (job->running && job_done(job)) {
+        poll(job);
+    }
+    if (!job->running) {
+        launch(job);
+    }
+}
+
+int parg_msquares_done(parg_msquares* job)
+{
+    if (job->running && job_done(job)) {
+        poll(job);
+    }
+    return !job->running;
+}
+
+int parg_msquares_count(parg_msquares* job)
+{
+    poll(job);
+    return kv_size(job->outputs);
+}
+
+uint32_t parg_msquares_get_color(parg_msquares* job, int mesh)
+{
+    poll(job);
+    return kv_A(job->outputs, mesh).color;
+}
+
+// Vertices on a seam are keyed by their x coordinate in sixteenths of a
+// pixel.
+static int seam_key(float x) { return (int) lroundf(x * 16); }
+
+// Concatenates the strips of one mesh, welding the vertices along the lower
+// seam of each strip to the upper seam of the previous strip.
+static void weld_output(parg_msquares* job, msquares_output* out)
+{
+    float topixels = PARG_MAX(job->width, job->height);
+    khash_t(seam)* below = kh_init(seam);
+    khash_t(seam)* above = kh_init(seam);
+    int* remap = 0;
+    out->points.n = out->triangles.n = 0;
+    for (int strip = 0; strip < job->nstrips; strip++) {
+        msquares_piece* piece = out->pieces + strip;
+        int npoints = kv_size(piece->points) / 3;
+        int y0 = strip_row(job, strip), y1 = strip_end(job, strip);
+        remap = realloc(remap, sizeof(int) * PARG_MAX(npoints, 1));
+        for (int i = 0; i < npoints; i++) {
+            const float* src = piece->points.a + i * 3;
+            float x = src[0] * topixels, y = src[1] * topixels;
+            int ret;
+            if (y0 > 0 && fabsf(y - y0) < 0.01f) {
+                khiter_t it = kh_get(seam, below, seam_key(x));
+                if (it != kh_end(below)) {
+                    remap[i] = kh_value(below, it);
+                    continue;
+                }
+            }
+            remap[i] = kv_size(out->points) / 3;
+            kv_push(float, out->points, src[0]);
+            kv_push(float, out->points, src[1]);
+            kv_push(float, out->points, src[2]);
+            if (fabsf(y - (y1 - 1)) < 0.01f) {
+                khiter_t it = kh_put(seam, above, seam_key(x), &ret);
+                kh_value(above, it) = remap[i];
+            }
+        }
+        parg_assert(kv_size(out->points) / 3 <= 0x10000, "Too many vertices");
+        for (int i = 0; i < kv_size(piece->triangles); i++) {
+            kv_push(uint16_t, out->triangles,
+                remap[kv_A(piece->triangles, i)]);
+        }
+
+        // The upper seam of this strip is the lower seam of the next one.
+        khash_t(seam)* swap = below;
+        below = above;
+        above = swap;
+        kh_clear(seam, above);
+    }
+    free(remap);
+    kh_destroy(seam, below);
+    kh_destroy(seam, above);
+    parg_msquares_mesh* mesh = &out->mesh;
+    mesh->points = out->points.a;
+    mesh->npoints = kv_size(out->points) / 3;
+    mesh->triangles = out->triangles.a;
+    mesh->ntriangles = kv_size(out->triangles) / 3;
+    mesh->color = out->color;
+    out->welded = 1;
+}
+
+parg_msquares_mesh* parg_msquares_get_mesh(parg_msquares* job, int mesh)
+{
+    poll(job);
+    msquares_output* out = &kv_A(job->outputs, mesh);
+    if (!out->welded) {
+        weld_output(job, out);
+    }
+    return &out->mesh;
+}
+
+static int with_slack(int count) { return count + count / 4 + 16; }
+
+// Gives every piece a range with slack and writes all of them.
+static void layout(parg_msquares* job)
+{
+    int npoints = 0, ntriangles = 0;
+    for (int o = 0; o < kv_size(job->outputs); o++) {
+        for (int strip = 0; strip < job->nstrips; strip++) {
+            msquares_piece* piece = kv_A(job->outputs, o).pieces + strip;
+            piece->first = npoints;
+            piece->capacity = with_slack(kv_size(piece->points) / 3);
+            piece->firsttriangle = ntriangles;
+            piece->trianglecapacity =
+                with_slack(kv_size(piece->triangles) / 3);
+            npoints += piece->capacity;
+            ntriangles += piece->trianglecapacity;
+        }
+    }
+    parg_buffer_free(job->coords);
+    parg_buffer_free(job->indices);
+    job->coords = parg_buffer_alloc(npoints * 3 * sizeof(float),
+        PARG_GPU_ARRAY);
+    job->indices = parg_buffer_alloc(ntriangles * 3 * sizeof(uint16_t),
+        PARG_GPU_ELEMENTS);
+    float* coords = parg_buffer_lock(job->coords, PARG_WRITE);
+    uint16_t* indices = parg_buffer_lock(job->indices, PARG_WRITE);
+    for (int o = 0; o < kv_size(job->outputs); o++) {
+        for (int strip = 0; strip < job->nstrips; strip++) {
+            msquares_piece* piece = kv_A(job->outputs, o).pieces + strip;
+            memcpy(coords + piece->first * 3, piece->points.a,
+                sizeof(float) * kv_size(piece->points));
+            memcpy(indices + piece->firsttriangle * 3, piece->triangles.a,
+                sizeof(uint16_t) * kv_size(piece->triangles));
+            piece->stale = 0;
+        }
+    }
+    parg_buffer_unlock(job->coords);
+    parg_buffer_unlock(job->indices);
+    job->relayout = 0;
+}
+
+static void write_range(parg_buffer* buf, int offset, const void* data,
+    int nbytes)
+{
+    if (nbytes) {
+        void* dst = parg_buffer_lock_range(buf, offset, nbytes, PARG_WRITE);
+        memcpy(dst, data, nbytes);
+        parg_buffer_unlock(buf);
+    }
+}
+
+// Rewrites the ranges of re-meshed pieces, unless one of them has outgrown
+// its range.
+static void upload(parg_msquares* job)
+{
+    for (int o = 0; o < kv_size(job->outputs) && !job->relayout; o++) {
+        for (int strip = 0; strip < job->nstrips; strip++) {
+            msquares_piece* piece = kv_A(job->outputs, o).pieces + strip;
+            if (piece->stale &&
+                (kv_size(piece->points) / 3 > piece->capacity ||
+                    kv_size(piece->triangles) / 3 > piece->trianglecapacity)) {
+                job->relayout = 1;
+                break;
+            }
+        }
+    }
+    if (job->relayout || !job->coords) {
+        layout(job);
+        job->stale = 0;
+        return;
+    }
+    for (int o = 0; o < kv_size(job->outputs); o++) {
+        for (int strip = 0; strip < job->nstrips; strip++) {
+            msquares_piece* piece = kv_A(job->outputs, o).pieces + strip;
+            if (!piece->stale) {
+                continue;
+            }
+            write_range(job->coords, piece->first * 3 * sizeof(float),
+                piece->points.a, sizeof(float) * kv_size(piece->points));
+            write_range(job->indices,
+                piece->firsttriangle * 3 * sizeof(uint16_t),
+                piece->triangles.a,
+                sizeof(uint16_t) * kv_size(piece->triangles));
+            piece->stale = 0;
+        }
+    }
+    job->stale = 0;
+}
+
+static void draw_pieces(parg_msquares* job, int mesh, parg_token position,
+    void (*draw)(int, int))
+{
+    poll(job);
+    if (job->stale) {
+        upload(job);
+    }
+    msquares_output* out = &kv_A(job->outputs, mesh);
+    parg_varray_bind(job->indices);
+    for (int strip = 0; strip < job->nstrips; strip++) {
+        msquares_piece* piece = out->pieces + strip;
+        int ntriangles = kv_size(piece->triangles) / 3;
+        if (ntriangles) {
+            parg_varray_enable(job->coords, position, 3, PARG_FLOAT, 0,
+                piece->first * 3 * sizeof(float));
+            draw(piece->firsttriangle, ntriangles);
+        }
+    }
+}
+
+void parg_msquares_draw(parg_msquares* job, int mesh, parg_token position)
+{
+    draw_pieces(job, mesh, position, parg_draw_triangles_u16);
+}
+
+void parg_msquares_draw_wireframe(
+    parg_msquares* job, int mesh, parg_token position)
+{
+    draw_pieces(job, mesh, position, parg_draw_wireframe_triangles_u16);
+}
+
+static void free_piece(msquares_piece* piece)
+{
+    kv_destroy(piece->points);
+    kv_destroy(piece->triangles);
+}
+
+void parg_msquares_free(parg_msquares* job)
+{
+    if (!job) {
+        return;
+    }
+    if (job->running) {
+        swap_strips(job);
+    }
+#if !EMSCRIPTEN
+    pthread_mutex_destroy(&job->lock);
+#endif
+    for (int o = 0; o < kv_size(job->outputs); o++) {
+        msquares_output* out = &kv_A(job->outputs, o);
+        for (int strip = 0; strip < job->nstrips; strip++) {
+            free_piece(out->pieces + strip);
+        }
+        free(out->pieces);
+        kv_destroy(out->points);
+        kv_destroy(out->triangles);
+    }
+    kv_destroy(job->outputs);
+    for (int strip = 0; strip < job->nstrips; strip++) {
+        for (int m = 0; m < kv_size(job->built[strip]); m++) {
+            free_piece(&kv_A(job->built[strip], m));
+        }
+        kv_destroy(job->built[strip]);
+    }
+    parg_buffer_free(job->coords);
+    parg_buffer_free(job->indices);
+    free(job->built);
+    free(job->nbuilt);
+    free(job->dirty);
+    free(job->work);
+    free(job->thresholds);
+    free(job->pixels);
+    free(job->edited);
+    free(job);
+}
@@ -0,0 +1,72 @@
+#include <parg.h>
+#include "internal.h"
+
+#if !EMSCRIPTEN
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define MAX_THREADS 16
+
+typedef struct {
+    parg_range_fn fn;
+    void* context;
+    int begin;
+    int end;
+} parallel_task;
+
+static int _nthreads = 0;
+
+int parg_parallel_threads()
+{
+#if EMSCRIPTEN
+    return 1;
+#else
+    if (!_nthreads) {
+        long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+        _nthreads = PARG_CLAMP(ncores, 1, MAX_THREADS);
+    }
+    return _nthreads;
+#endif
+}
+
+static void* run_task(void* arg)
+{
+    parallel_task* task = arg;
+    task->fn(task->context, task->begin, task->end);
+    return 0;
+}
+
+void parg_parallel_for(int count, int grain, parg_range_fn fn, void* context)
+{
+    int ntasks = PARG_MIN(parg_parallel_threads(), count / PARG_MAX(grain, 1));
+    if (ntasks <= 1) {
+        fn(context, 0, count);
+        return;
+    }
+#if !EMSCRIPTEN
+    parallel_task tasks[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    int spawned[MAX_THREADS] = {0};
+    for (int i = 0; i < ntasks; i++) {
+        tasks[i].fn = fn;
+        tasks[i].context = context;
+        tasks[i].begin = (int) ((int64_t) count * i / ntasks);
+        tasks[i].end = (int) ((int64_t) count * (i + 1) / ntasks);
+    }
+
+    // The calling thread takes the first range; if a thread cannot be
+    // created, its range runs inline instead.
+    for (int i = 1; i < ntasks; i++) {
+        spawned[i] = !pthread_create(&threads[i], 0, run_task, &tasks[i]);
+    }
+    run_task(&tasks[0]);
+    for (int i = 1; i < ntasks; i++) {
+        if (spawned[i]) {
+            pthread_join(threads[i], 0);
+        } else {
+            run_task(&tasks[i]);
+        }
+    }
+#endif
+}
@@ -7,6 +7,7 @@
 #define PARG_HALF_FLOAT GL_HALF_FLOAT_OES
 #define PARGL_STRING const GLchar* *
 #else
+#define PARG_HALF_FLOAT GL_HALF_FLOAT
 #define PARGL_STRING const GLchar* const *
 #if defined(__APPLE_CC__)
 #include <OpenGL/gl3.h>
@@ -22,3 +23,4 @@ GLuint parg_shader_attrib_get(parg_token);
 GLint parg_shader_uniform_get(parg_token);
 
 extern int _parg_depthtest;
+extern parg_counters _parg_counters;
@@ -0,0 +1,482 @@
+#include <parg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "internal.h"
+#include "lodepng.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// PNG decoding to RGBA8.  Non-interlaced 8-bit gray, gray-alpha, RGB and
+// RGBA images take a fast path: lodepng inflates the IDAT stream, then
+// scanlines are unfiltered and converted to RGBA on worker threads.  Rows
+// that use the None or Sub filters do not depend on the previous row, so
+// they are where independent unfiltering segments can begin.  Everything
+// else is handed to lodepng.
+
+#define CONVERT_GRAIN 64
+
+// Strip bakes are a header of {width, height, nstrips, hash} followed by
+// nstrips + 1 byte offsets and the concatenated strip PNGs.  Strips are
+// encoded without row filters, but with a deflate window that reaches the
+// row above.  That inflates faster than filtered rows and is usually smaller.
+#define STRIP_ROWS 256
+#define STRIP_HEADER 4
+
+enum { FILTER_NONE, FILTER_SUB, FILTER_UP, FILTER_AVG, FILTER_PAETH };
+
+typedef struct {
+    uint8_t* scanlines;
+    const uint8_t* zeros;
+    int* segments;
+    int width;
+    int height;
+    int bpp;
+    int stride;
+    uint8_t* out;
+    int bottomup;
+} png_job;
+
+typedef struct {
+    const uint8_t* rgba;
+    const uint8_t* data;
+    const int* offsets;
+    uint8_t** encoded;
+    size_t* sizes;
+    unsigned* errors;
+    uint8_t* out;
+    int width;
+    int height;
+    int bottomup;
+} strip_job;
+
+static int paeth(int a, int b, int c)
+{
+    int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+static void unfilter_scalar(
+    uint8_t* row, const uint8_t* prev, int length, int bpp, int filter)
+{
+    switch (filter) {
+    case FILTER_SUB:
+        for (int i = bpp; i < length; i++) {
+            row[i] += row[i - bpp];
+        }
+        break;
+    case FILTER_UP:
+        for (int i = 0; i < length; i++) {
+            row[i] += prev[i];
+        }
+        break;
+    case FILTER_AVG:
+        for (int i = 0; i < bpp; i++) {
+            row[i] += prev[i] >> 1;
+        }
+        for (int i = bpp; i < length; i++) {
+            row[i] += (row[i - bpp] + prev[i]) >> 1;
+        }
+        break;
+    case FILTER_PAETH:
+        for (int i = 0; i < bpp; i++) {
+            row[i] += prev[i];
+        }
+        for (int i = bpp; i < length; i++) {
+            row[i] += paeth(row[i - bpp], prev[i], prev[i - bpp]);
+        }
+        break;
+    }
+}
+
+#ifdef __SSE2__
+
+// Pixels are loaded into the low lanes of a register, so 3-byte and 4-byte
+// pixels share the same per-pixel kernels.
+static __m128i load_pixel(const uint8_t* p, int bpp)
+{
+    int v = 0;
+    memcpy(&v, p, bpp);
+    return _mm_cvtsi32_si128(v);
+}
+
+static void store_pixel(uint8_t* p, __m128i v, int bpp)
+{
+    int x = _mm_cvtsi128_si32(v);
+    memcpy(p, &x, bpp);
+}
+
+static __m128i abs_i16(__m128i x)
+{
+    __m128i neg = _mm_cmplt_epi16(x, _mm_setzero_si128());
+    return _mm_add_epi16(_mm_xor_si128(x, neg), _mm_srli_epi16(neg, 15));
+}
+
+static __m128i select_si128(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void unfilter_simd(
+    uint8_t* row, const uint8_t* prev, int length, int bpp, int filter)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i a = zero, c = zero;
+    int i = 0;
+    switch (filter) {
+    case FILTER_SUB:
+        for (; i < length; i += bpp) {
+            a = _mm_add_epi8(load_pixel(row + i, bpp), a);
+            store_pixel(row + i, a, bpp);
+        }
+        break;
+    case FILTER_UP:
+        for (; i + 16 <= length; i += 16) {
+            __m128i d = _mm_loadu_si128((const __m128i*) (row + i));
+            __m128i b = _mm_loadu_si128((const __m128i*) (prev + i));
+            _mm_storeu_si128((__m128i*) (row + i), _mm_add_epi8(d, b));
+        }
+        unfilter_scalar(row + i, prev + i, length - i, bpp, filter);
+        break;
+    case FILTER_AVG:
+        for (__m128i one = _mm_set1_epi8(1); i < length; i += bpp) {
+            __m128i b = load_pixel(prev + i, bpp);
+            __m128i avg = _mm_avg_epu8(a, b);
+            avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(load_pixel(row + i, bpp), avg);
+            store_pixel(row + i, a, bpp);
+        }
+        break;
+    case FILTER_PAETH:
+        for (; i < length; i += bpp) {
+            __m128i b = _mm_unpacklo_epi8(load_pixel(prev + i, bpp), zero);
+            __m128i a16 = _mm_unpacklo_epi8(a, zero);
+            __m128i pa = _mm_sub_epi16(b, c);
+            __m128i pb = _mm_sub_epi16(a16, c);
+            __m128i pc = abs_i16(_mm_add_epi16(pa, pb));
+            pa = abs_i16(pa);
+            pb = abs_i16(pb);
+            __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            __m128i nearest = select_si128(_mm_cmpeq_epi16(smallest, pa), a16,
+                select_si128(_mm_cmpeq_epi16(smallest, pb), b, c));
+            a = _mm_add_epi8(load_pixel(row + i, bpp),
+                _mm_packus_epi16(nearest, nearest));
+            store_pixel(row + i, a, bpp);
+            c = b;
+        }
+        break;
+    }
+}
+
+#endif
+
+static void unfilter_segments(void* context, int begin, int end)
+{
+    png_job* job = context;
+    int length = job->stride - 1;
+    for (int s = begin; s < end; s++) {
+        for (int y = job->segments[s]; y < job->segments[s + 1]; y++) {
+            uint8_t* row = job->scanlines + y * job->stride;
+            const uint8_t* prev = y ? row - job->stride + 1 : job->zeros;
+#ifdef __SSE2__
+            if (job->bpp >= 3) {
+                unfilter_simd(row + 1, prev, length, job->bpp, row[0]);
+                continue;
+            }
+#endif
+            unfilter_scalar(row + 1, prev, length, job->bpp, row[0]);
+        }
+    }
+}
+
+static void convert_rows(void* context, int begin, int end)
+{
+    png_job* job = context;
+    int w = job->width;
+    for (int y = begin; y < end; y++) {
+        const uint8_t* src = job->scanlines + y * job->stride + 1;
+        int dsty = job->bottomup ? job->height - 1 - y : y;
+        uint8_t* dst = job->out + dsty * w * 4;
+        switch (job->bpp) {
+        case 4:
+            memcpy(dst, src, w * 4);
+            break;
+        case 3:
+            for (int x = 0; x < w; x++, src += 3, dst += 4) {
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+                dst[3] = 255;
+            }
+            break;
+        case 2:
+            for (int x = 0; x < w; x++, src += 2, dst += 4) {
+                dst[0] = dst[1] = dst[2] = src[0];
+                dst[3] = src[1];
+            }
+            break;
+        default:
+            for (int x = 0; x < w; x++, src++, dst += 4) {
+                dst[0] = dst[1] = dst[2] = src[0];
+                dst[3] = 255;
+            }
+            break;
+        }
+    }
+}
+
+// Concatenates the payloads of all IDAT chunks, returning zero if the chunk
+// stream is malformed.  Images with a tRNS color key also return zero, since
+// lodepng_inspect stops at IHDR and the fast conversion assumes opaque
+// pixels.
+static uint8_t* gather_idat(const uint8_t* in, size_t insize, size_t* nbytes)
+{
+    const uint8_t* end = in + insize;
+    const uint8_t* chunk = in + 8;
+    uint8_t* idat = 0;
+    *nbytes = 0;
+    while (chunk + 12 <= end) {
+        size_t length = lodepng_chunk_length(chunk);
+        if (length > (size_t) (end - chunk) - 12) {
+            break;
+        }
+        if (lodepng_chunk_type_equals(chunk, "IDAT")) {
+            idat = realloc(idat, *nbytes + length);
+            memcpy(idat + *nbytes, lodepng_chunk_data_const(chunk), length);
+            *nbytes += length;
+        } else if (lodepng_chunk_type_equals(chunk, "tRNS")) {
+            break;
+        } else if (lodepng_chunk_type_equals(chunk, "IEND")) {
+            return idat;
+        }
+        chunk = lodepng_chunk_next_const(chunk);
+    }
+    free(idat);
+    return 0;
+}
+
+// Decodes into job->out, which is allocated if null.  Strips pass a single
+// thread since they are already decoded in parallel.
+static unsigned decode_fast(
+    png_job* job, const uint8_t* in, size_t insize, int nthreads)
+{
+    size_t idatsize;
+    uint8_t* idat = gather_idat(in, insize, &idatsize);
+    if (!idat) {
+        return 1;
+    }
+    int height = job->height;
+    job->stride = job->width * job->bpp + 1;
+    size_t rawsize = 0;
+    unsigned err = lodepng_zlib_decompress(&job->scanlines, &rawsize, idat,
+        idatsize, &lodepng_default_decompress_settings);
+    free(idat);
+    if (err || rawsize != (size_t) job->stride * height) {
+        free(job->scanlines);
+        return err ? err : 1;
+    }
+
+    // Split the image at independent rows into roughly one segment per
+    // thread.
+    int target = PARG_MAX(height / nthreads, 1);
+    job->segments = malloc(sizeof(int) * (height + 1));
+    int nsegments = 0;
+    for (int y = 0; y < height; y++) {
+        int filter = job->scanlines[y * job->stride];
+        if (filter > FILTER_PAETH) {
+            free(job->segments);
+            free(job->scanlines);
+            return 1;
+        }
+        int independent = filter == FILTER_NONE || filter == FILTER_SUB;
+        if (y == 0 ||
+            (independent && y >= job->segments[nsegments - 1] + target)) {
+            job->segments[nsegments++] = y;
+        }
+    }
+    job->segments[nsegments] = height;
+    job->zeros = calloc(job->stride, 1);
+    if (!job->out) {
+        job->out = malloc(job->width * height * 4);
+    }
+    if (nthreads > 1) {
+        parg_parallel_for(nsegments, 1, unfilter_segments, job);
+        parg_parallel_for(height, CONVERT_GRAIN, convert_rows, job);
+    } else {
+        unfilter_segments(job, 0, nsegments);
+        convert_rows(job, 0, height);
+    }
+    free((void*) job->zeros);
+    free(job->segments);
+    free(job->scanlines);
+    return 0;
+}
+
+// Returns the bytes per pixel of a PNG that can take the fast path, or zero.
+static int inspect_fast(unsigned* width, unsigned* height,
+    const unsigned char* in, size_t insize)
+{
+    LodePNGState state;
+    lodepng_state_init(&state);
+    unsigned err = lodepng_inspect(width, height, &state, in, insize);
+    const LodePNGColorMode* color = &state.info_png.color;
+    static const int bpps[7] = {1, 0, 3, 0, 2, 0, 4};
+    int bpp = color->colortype <= 6 ? bpps[color->colortype] : 0;
+    int fast = !err && bpp && color->bitdepth == 8 &&
+        !state.info_png.interlace_method;
+    lodepng_state_cleanup(&state);
+    return fast ? bpp : 0;
+}
+
+unsigned parg_png_decode(unsigned char** out, unsigned* width,
+    unsigned* height, const unsigned char* in, size_t insize, int bottomup)
+{
+    int bpp = inspect_fast(width, height, in, insize);
+    png_job job = {0};
+    job.width = *width;
+    job.height = *height;
+    job.bpp = bpp;
+    job.bottomup = bottomup;
+    if (bpp && !decode_fast(&job, in, insize, parg_parallel_threads())) {
+        *out = job.out;
+        return 0;
+    }
+    unsigned err =
+        lodepng_decode_memory(out, width, height, in, insize, LCT_RGBA, 8);
+    if (!err && bottomup) {
+        parg_texture_fliprows(*out, *width * 4, *height);
+    }
+    return err;
+}
+
+static void encode_strips(void* context, int begin, int end)
+{
+    strip_job* job = context;
+    for (int s = begin; s < end; s++) {
+        int y = s * STRIP_ROWS;
+        int rows = PARG_MIN(STRIP_ROWS, job->height - y);
+        LodePNGState state;
+        lodepng_state_init(&state);
+        state.encoder.auto_convert = 0;
+        state.encoder.filter_strategy = LFS_ZERO;
+        unsigned window = 2048;
+        while (window < job->width * 4 && window < 32768) {
+            window *= 2;
+        }
+        state.encoder.zlibsettings.windowsize = window;
+        job->errors[s] = lodepng_encode(&job->encoded[s], &job->sizes[s],
+            job->rgba + y * job->width * 4, job->width, rows, &state);
+        lodepng_state_cleanup(&state);
+    }
+}
+
+static void decode_strips(void* context, int begin, int end)
+{
+    strip_job* job = context;
+    for (int s = begin; s < end; s++) {
+        int y = s * STRIP_ROWS;
+        int rows = PARG_MIN(STRIP_ROWS, job->height - y);
+        const uint8_t* in = job->data + job->offsets[s];
+        size_t insize = job->offsets[s + 1] - job->offsets[s];
+        unsigned width, height;
+        png_job strip = {0};
+        strip.bpp = inspect_fast(&width, &height, in, insize);
+        if (!strip.bpp || width != job->width || height != rows) {
+            job->errors[s] = 1;
+            continue;
+        }
+        strip.width = width;
+        strip.height = rows;
+        strip.bottomup = job->bottomup;
+        int dsty = job->bottomup ? job->height - y - rows : y;
+        strip.out = job->out + dsty * width * 4;
+        job->errors[s] = decode_fast(&strip, in, insize, 1);
+    }
+}
+
+parg_buffer* parg_png_encode_strips(
+    const unsigned char* rgba, unsigned width, unsigned height, uint32_t hash)
+{
+    int nstrips = (height + STRIP_ROWS - 1) / STRIP_ROWS;
+    if (nstrips < 2) {
+        return 0;
+    }
+    strip_job job = {0};
+    job.rgba = rgba;
+    job.width = width;
+    job.height = height;
+    job.encoded = calloc(nstrips, sizeof(uint8_t*));
+    job.sizes = calloc(nstrips, sizeof(size_t));
+    job.errors = calloc(nstrips, sizeof(unsigned));
+    parg_parallel_for(nstrips, 1, encode_strips, &job);
+    int nbytes = (STRIP_HEADER + nstrips + 1) * sizeof(int);
+    int failed = 0;
+    for (int s = 0; s < nstrips; s++) {
+        nbytes += job.sizes[s];
+        failed |= job.errors[s];
+    }
+    parg_buffer* buf = 0;
+    if (!failed) {
+        buf = parg_buffer_alloc(nbytes, PARG_CPU);
+        int* header = parg_buffer_lock(buf, PARG_WRITE);
+        header[0] = width;
+        header[1] = height;
+        header[2] = nstrips;
+        header[3] = hash;
+        int* offsets = header + STRIP_HEADER;
+        uint8_t* data = (uint8_t*) (offsets + nstrips + 1);
+        offsets[0] = 0;
+        for (int s = 0; s < nstrips; s++) {
+            memcpy(data + offsets[s], job.encoded[s], job.sizes[s]);
+            offsets[s + 1] = offsets[s] + job.sizes[s];
+        }
+        parg_buffer_unlock(buf);
+    }
+    for (int s = 0; s < nstrips; s++) {
+        free(job.encoded[s]);
+    }
+    free(job.encoded);
+    free(job.sizes);
+    free(job.errors);
+    return buf;
+}
+
+unsigned parg_png_decode_strips(unsigned char** out, unsigned* width,
+    unsigned* height, parg_buffer* strips, uint32_t hash, int bottomup)
+{
+    const int* header = parg_buffer_lock(strips, PARG_READ);
+    int nbytes = parg_buffer_length(strips);
+    int nstrips = nbytes >= STRIP_HEADER * (int) sizeof(int) ? header[2] : 0;
+    int tablesize = (STRIP_HEADER + nstrips + 1) * sizeof(int);
+    strip_job job = {0};
+    job.offsets = header + STRIP_HEADER;
+    job.data = (const uint8_t*) (job.offsets + nstrips + 1);
+    int valid = nstrips > 0 && header[3] == (int) hash &&
+        nstrips == (header[1] + STRIP_ROWS - 1) / STRIP_ROWS &&
+        tablesize <= nbytes && job.offsets[nstrips] <= nbytes - tablesize;
+    if (!valid) {
+        parg_buffer_unlock(strips);
+        return 1;
+    }
+    job.width = header[0];
+    job.height = header[1];
+    job.bottomup = bottomup;
+    job.out = malloc(job.width * job.height * 4);
+    job.errors = calloc(nstrips, sizeof(unsigned));
+    parg_parallel_for(nstrips, 1, decode_strips, &job);
+    unsigned err = 0;
+    for (int s = 0; s < nstrips; s++) {
+        err = err ? err : job.errors[s];
+    }
+    free(job.errors);
+    parg_buffer_unlock(strips);
+    if (err) {
+        free(job.out);
+        return err;
+    }
+    *out = job.out;
+    *width = job.width;
+    *height = job.height;
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include <parg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "kvec.h"
+
+// Points are split into levels by rank.  Level k holds the rank band that
+// lies between the thresholds of levels k - 1 and k, and each threshold is
+// four times the previous one.  So every level adds roughly the same number
+// of points per tile as its parent, at twice the resolution.  Within a level,
+// points are sorted by tile (row-major) and then by rank.  That lets a query
+// draw the rank prefix of each visible tile with a single range.
+
+#define MAX_LEVELS 12
+
+typedef struct {
+    uint32_t cell;
+    float rank;
+    int index;
+} pc_item;
+
+struct parg_pointcloud_s {
+    Vector2 mapsize;
+    int nlevels;
+    float bands[MAX_LEVELS];
+    int levelbase[MAX_LEVELS + 1];
+    int* cellstart;
+    float* ranks;
+    kvec_t(int) ranges;
+};
+
+static int compare_items(const void* a, const void* b)
+{
+    const pc_item* pa = a;
+    const pc_item* pb = b;
+    if (pa->cell != pb->cell) {
+        return pa->cell < pb->cell ? -1 : 1;
+    }
+    return (pa->rank > pb->rank) - (pa->rank < pb->rank);
+}
+
+static int tile_coord(float v, float extent, int n)
+{
+    int t = (v / extent + 0.5f) * n;
+    return PARG_CLAMP(t, 0, n - 1);
+}
+
+parg_pointcloud* parg_pointcloud_create(
+    float* pts, int npts, Vector2 mapsize, int leafsize)
+{
+    parg_pointcloud* pc = calloc(sizeof(struct parg_pointcloud_s), 1);
+    pc->mapsize = mapsize;
+    float minrank = FLT_MAX, maxrank = -FLT_MAX;
+    for (int i = 0; i < npts; i++) {
+        minrank = PARG_MIN(minrank, pts[i * 3 + 2]);
+        maxrank = PARG_MAX(maxrank, pts[i * 3 + 2]);
+    }
+
+    // Choose the rank bands so that the root holds about one leaf's worth
+    // of points; the last band always reaches the maximum rank.
+    double fraction = (double) leafsize / PARG_MAX(npts, 1);
+    int nlevels = 0;
+    while (nlevels < MAX_LEVELS) {
+        pc->bands[nlevels++] = minrank + (maxrank - minrank) * fraction;
+        if (fraction >= 1) {
+            break;
+        }
+        fraction *= 4;
+    }
+    pc->bands[nlevels - 1] = FLT_MAX;
+    pc->nlevels = nlevels;
+    for (int k = 0; k < nlevels; k++) {
+        pc->levelbase[k + 1] = pc->levelbase[k] + (1 << k) * (1 << k);
+    }
+
+    float extent = PARG_MAX(mapsize.x, mapsize.y);
+    pc_item* items = malloc(sizeof(pc_item) * npts);
+    for (int i = 0; i < npts; i++) {
+        const float* pt = pts + i * 3;
+        int k = 0;
+        while (pt[2] >= pc->bands[k]) {
+            k++;
+        }
+        int n = 1 << k;
+        int tx = tile_coord(pt[0], extent, n);
+        int ty = tile_coord(pt[1], extent, n);
+        items[i].cell = pc->levelbase[k] + ty * n + tx;
+        items[i].rank = pt[2];
+        items[i].index = i;
+    }
+    qsort(items, npts, sizeof(pc_item), compare_items);
+
+    int ncells = pc->levelbase[nlevels];
+    pc->cellstart = calloc(ncells + 1, sizeof(int));
+    pc->ranks = malloc(sizeof(float) * npts);
+    float* sorted = malloc(sizeof(float) * 3 * npts);
+    for (int i = 0; i < npts; i++) {
+        memcpy(sorted + i * 3, pts + items[i].index * 3, sizeof(float) * 3);
+        pc->ranks[i] = items[i].rank;
+        pc->cellstart[items[i].cell + 1]++;
+    }
+    for (int i = 0; i < ncells; i++) {
+        pc->cellstart[i + 1] += pc->cellstart[i];
+    }
+    memcpy(pts, sorted, sizeof(float) * 3 * npts);
+    free(sorted);
+    free(items);
+    return pc;
+}
+
+static int upper_bound(const float* ranks, int begin, int end, float rank)
+{
+    while (begin < end) {
+        int mid = begin + (end - begin) / 2;
+        if (ranks[mid] < rank) {
+            begin = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return begin;
+}
+
+static void emit_range(parg_pointcloud* pc, int begin, int end)
+{
+    int n = kv_size(pc->ranges);
+    if (n && kv_A(pc->ranges, n - 2) + kv_A(pc->ranges, n - 1) == begin) {
+        kv_A(pc->ranges, n - 1) += end - begin;
+        return;
+    }
+    kv_push(int, pc->ranges, begin);
+    kv_push(int, pc->ranges, end - begin);
+}
+
+int parg_pointcloud_query(parg_pointcloud* pc, parg_aar viewport,
+    float maxrank, const int** ranges)
+{
+    pc->ranges.n = 0;
+    *ranges = pc->ranges.a;
+    float extent = PARG_MAX(pc->mapsize.x, pc->mapsize.y);
+    float half = extent * 0.5f;
+    if (viewport.right < -half || viewport.left > half ||
+        viewport.top < -half || viewport.bottom > half) {
+        return 0;
+    }
+    for (int k = 0; k < pc->nlevels; k++) {
+        if (k > 0 && maxrank <= pc->bands[k - 1]) {
+            break;
+        }
+        int n = 1 << k;
+        int x0 = tile_coord(viewport.left, extent, n);
+        int y0 = tile_coord(viewport.bottom, extent, n);
+        int x1 = tile_coord(viewport.right, extent, n);
+        int y1 = tile_coord(viewport.top, extent, n);
+        int partial = maxrank < pc->bands[k];
+        for (int y = y0; y <= y1; y++) {
+            const int* cells = pc->cellstart + pc->levelbase[k] + y * n;
+            for (int x = x0; x <= x1; x++) {
+                int begin = cells[x], end = cells[x + 1];
+                if (partial) {
+                    end = upper_bound(pc->ranks, begin, end, maxrank);
+                }
+                if (end > begin) {
+                    emit_range(pc, begin, end);
+                }
+            }
+        }
+    }
+    *ranges = pc->ranges.a;
+    return kv_size(pc->ranges) / 2;
+}
+
+void parg_pointcloud_free(parg_pointcloud* pc)
+{
+    if (!pc) {
+        return;
+    }
+    free(pc->cellstart);
+    free(pc->ranks);
+    kv_destroy(pc->ranges);
+    free(pc);
+}
@@ -0,0 +1,347 @@
+#include <parg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "internal.h"
+#include "kvec.h"
+#include "khash.h"
+
+#if !EMSCRIPTEN
+#include <pthread.h>
+#endif
+
+// Points are generated one tile at a time on a worker thread, DETAIL levels
+// finer than parg_aar_to_tilerange picks for the viewport, so that each
+// tile spans a quarter to a half of the viewport's extent and few points
+// are drawn off-screen.  Finished tiles are appended to a GPU ring buffer;
+// appending over older tiles evicts them.  While a visible tile is still
+// being generated, its nearest resident ancestor or its resident children
+// are drawn in its place.
+//
+// A tile's share of the viewport's area varies fourfold within a level, so
+// tiles are generated for the largest share their level can have and sorted
+// by rank.  Each tick then draws the rank prefix that matches the tile's
+// current share, which keeps the density on screen steady.
+
+#define MAX_LEVEL 24
+#define MAX_ANCESTORS 4
+#define DETAIL 2
+
+typedef struct {
+    int offset;
+    int count;
+    float share;
+} ps_entry;
+
+typedef struct {
+    uint64_t key;
+    float share;
+} ps_request;
+
+typedef struct {
+    uint64_t key;
+    float share;
+    float* pts;
+    int npts;
+} ps_result;
+
+KHASH_MAP_INIT_INT64(ps_tiles, ps_entry)
+KHASH_SET_INIT_INT64(ps_keys)
+
+struct parg_pointstream_s {
+    Vector2 mapsize;
+    int capacity;
+    int cursor;
+    parg_buffer* buffer;
+    parg_pointstream_generator generator;
+    void* userdata;
+    khash_t(ps_tiles)* resident;
+    khash_t(ps_keys)* pending;
+    kvec_t(ps_request) queue;
+    kvec_t(ps_result) results;
+    kvec_t(uint64_t) drawn;
+    kvec_t(int) ranges;
+    float viewarea;
+#if !EMSCRIPTEN
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t worker;
+    int quit;
+#endif
+};
+
+static uint64_t tile_key(parg_tilename tile)
+{
+    return ((uint64_t) tile.z << 48) | ((uint64_t) tile.y << 24) | tile.x;
+}
+
+static parg_tilename tile_from_key(uint64_t key)
+{
+    parg_tilename tile = {key & 0xffffff, (key >> 24) & 0xffffff, key >> 48};
+    return tile;
+}
+
+static int compare_ranks(const void* a, const void* b)
+{
+    float ra = ((const float*) a)[2];
+    float rb = ((const float*) b)[2];
+    return (ra > rb) - (ra < rb);
+}
+
+static ps_result generate_tile(parg_pointstream* ps, ps_request request)
+{
+    parg_aar rect =
+        parg_aar_from_tilename(tile_from_key(request.key), ps->mapsize);
+    ps_result result = {request.key, request.share, 0, 0};
+    float* pts =
+        ps->generator(rect, request.share, &result.npts, ps->userdata);
+    result.pts = malloc(sizeof(float) * 3 * result.npts);
+    memcpy(result.pts, pts, sizeof(float) * 3 * result.npts);
+    qsort(result.pts, result.npts, sizeof(float) * 3, compare_ranks);
+    return result;
+}
+
+// Returns the fraction of the viewport's area that a tile covers.
+static float tile_share(parg_pointstream* ps, parg_tilename tile)
+{
+    float extent = PARG_MAX(ps->mapsize.x, ps->mapsize.y);
+    float tilesize = extent / (1 << tile.z);
+    return tilesize * tilesize / ps->viewarea;
+}
+
+#if !EMSCRIPTEN
+static void* worker_main(void* arg)
+{
+    parg_pointstream* ps = arg;
+    pthread_mutex_lock(&ps->lock);
+    while (!ps->quit) {
+        if (!kv_size(ps->queue)) {
+            pthread_cond_wait(&ps->wake, &ps->lock);
+            continue;
+        }
+        ps_request request = kv_pop(ps->queue);
+        pthread_mutex_unlock(&ps->lock);
+        ps_result result = generate_tile(ps, request);
+        pthread_mutex_lock(&ps->lock);
+        kv_push(ps_result, ps->results, result);
+    }
+    pthread_mutex_unlock(&ps->lock);
+    return 0;
+}
+#endif
+
+parg_pointstream* parg_pointstream_create(Vector2 mapsize, int capacity,
+    parg_pointstream_generator generator, void* userdata)
+{
+    parg_pointstream* ps = calloc(sizeof(struct parg_pointstream_s), 1);
+    ps->mapsize = mapsize;
+    ps->capacity = capacity;
+    ps->generator = generator;
+    ps->userdata = userdata;
+    int nbytes = capacity * sizeof(float) * 3;
+    ps->buffer = parg_buffer_alloc(nbytes, PARG_GPU_ARRAY);
+    ps->resident = kh_init(ps_tiles);
+    ps->pending = kh_init(ps_keys);
+#if !EMSCRIPTEN
+    pthread_mutex_init(&ps->lock, 0);
+    pthread_cond_init(&ps->wake, 0);
+    pthread_create(&ps->worker, 0, worker_main, ps);
+#endif
+    return ps;
+}
+
+// Copies a finished tile into the ring buffer, evicting the tiles that it
+// overwrites.
+static void append_tile(parg_pointstream* ps, ps_result result)
+{
+    int count = PARG_MIN(result.npts, ps->capacity);
+    if (ps->cursor + count > ps->capacity) {
+        ps->cursor = 0;
+    }
+    int begin = ps->cursor, end = ps->cursor + count;
+    for (khiter_t it = kh_begin(ps->resident); it != kh_end(ps->resident);
+         ++it) {
+        if (!kh_exist(ps->resident, it)) {
+            continue;
+        }
+        ps_entry entry = kh_value(ps->resident, it);
+        if (entry.offset < end && begin < entry.offset + entry.count) {
+            kh_del(ps_tiles, ps->resident, it);
+        }
+    }
+    if (count) {
+        int stride = sizeof(float) * 3;
+        void* dst = parg_buffer_lock_range(
+            ps->buffer, begin * stride, count * stride, PARG_WRITE);
+        memcpy(dst, result.pts, count * stride);
+        parg_buffer_unlock(ps->buffer);
+    }
+    int ret;
+    khiter_t it = kh_put(ps_tiles, ps->resident, result.key, &ret);
+    kh_value(ps->resident, it) = (ps_entry){begin, count, result.share};
+    ps->cursor = end;
+}
+
+// Adds the range for the rank prefix of a resident tile unless it has
+// already been added, and returns 0 if the tile is not resident.
+static int draw_tile(parg_pointstream* ps, parg_tilename tile)
+{
+    uint64_t key = tile_key(tile);
+    khiter_t it = kh_get(ps_tiles, ps->resident, key);
+    if (it == kh_end(ps->resident)) {
+        return 0;
+    }
+    for (int i = 0; i < kv_size(ps->drawn); i++) {
+        if (kv_A(ps->drawn, i) == key) {
+            return 1;
+        }
+    }
+    kv_push(uint64_t, ps->drawn, key);
+    ps_entry entry = kh_value(ps->resident, it);
+    float fraction = PARG_MIN(tile_share(ps, tile) / entry.share, 1);
+    int count = ceilf(entry.count * fraction);
+    if (count) {
+        kv_push(int, ps->ranges, entry.offset);
+        kv_push(int, ps->ranges, count);
+    }
+    return 1;
+}
+
+static void draw_fallback(parg_pointstream* ps, parg_tilename tile)
+{
+    parg_tilename parent = tile;
+    for (int i = 0; i < MAX_ANCESTORS && parent.z > 0; i++) {
+        parent.x /= 2;
+        parent.y /= 2;
+        parent.z--;
+        if (draw_tile(ps, parent)) {
+            return;
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        parg_tilename child = {tile.x * 2 + i % 2, tile.y * 2 + i / 2,
+            tile.z + 1};
+        draw_tile(ps, child);
+    }
+}
+
+static int same_ranges(const int* a, int na, const int* b, int nb)
+{
+    return na == nb && !memcmp(a, b, sizeof(int) * na);
+}
+
+int parg_pointstream_tick(parg_pointstream* ps, parg_aar viewport)
+{
+    parg_tilerange range;
+    parg_aar_to_tilerange(viewport, ps->mapsize, &range);
+    int z = PARG_CLAMP(range.mintile.z + DETAIL, 0, MAX_LEVEL);
+    int ntiles = 1 << z;
+    float extent = PARG_MAX(ps->mapsize.x, ps->mapsize.y);
+    float tilesize = extent / ntiles;
+    int x0 = PARG_MAX((viewport.left + extent * 0.5) / tilesize, 0);
+    int y0 = PARG_MAX((viewport.bottom + extent * 0.5) / tilesize, 0);
+    int x1 = PARG_MIN((viewport.right + extent * 0.5) / tilesize, ntiles - 1);
+    int y1 = PARG_MIN((viewport.top + extent * 0.5) / tilesize, ntiles - 1);
+
+    // The smallest viewport that picks this level is 2^(DETAIL - 1) tiles
+    // across its larger side, which is where a tile's share peaks.  Levels
+    // that are clamped can exceed that, so the current share is a floor.
+    float width = parg_aar_width(viewport);
+    float height = parg_aar_height(viewport);
+    ps->viewarea = width * height;
+    float across = 1 << (DETAIL - 1);
+    float aspect = PARG_MAX(width, height) / PARG_MIN(width, height);
+    parg_tilename level = {0, 0, z};
+    float share = PARG_MAX(aspect / (across * across), tile_share(ps, level));
+
+#if EMSCRIPTEN
+    if (kv_size(ps->queue)) {
+        kv_push(ps_result, ps->results, generate_tile(ps, kv_pop(ps->queue)));
+    }
+#else
+    pthread_mutex_lock(&ps->lock);
+#endif
+    int nappended = kv_size(ps->results);
+    for (int i = 0; i < nappended; i++) {
+        ps_result result = kv_A(ps->results, i);
+        kh_del(ps_keys, ps->pending, kh_get(ps_keys, ps->pending, result.key));
+        append_tile(ps, result);
+        free(result.pts);
+    }
+    ps->results.n = 0;
+
+    // Requests that no worker has picked up yet are dropped, and the ones
+    // that are still visible get queued again below.
+    for (int i = 0; i < kv_size(ps->queue); i++) {
+        khiter_t it = kh_get(ps_keys, ps->pending, kv_A(ps->queue, i).key);
+        kh_del(ps_keys, ps->pending, it);
+    }
+    ps->queue.n = 0;
+
+    int* previous = malloc(sizeof(int) * kv_size(ps->ranges));
+    int nprevious = kv_size(ps->ranges);
+    memcpy(previous, ps->ranges.a, sizeof(int) * nprevious);
+    ps->ranges.n = 0;
+    ps->drawn.n = 0;
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            parg_tilename tile = {x, y, z};
+            if (draw_tile(ps, tile)) {
+                continue;
+            }
+            draw_fallback(ps, tile);
+            int ret;
+            kh_put(ps_keys, ps->pending, tile_key(tile), &ret);
+            if (ret) {
+                ps_request request = {tile_key(tile), share};
+                kv_push(ps_request, ps->queue, request);
+            }
+        }
+    }
+#if !EMSCRIPTEN
+    pthread_cond_signal(&ps->wake);
+    pthread_mutex_unlock(&ps->lock);
+#endif
+    int changed = nappended > 0 ||
+        !same_ranges(previous, nprevious, ps->ranges.a, kv_size(ps->ranges));
+    free(previous);
+    return changed;
+}
+
+parg_buffer* parg_pointstream_buffer(parg_pointstream* ps)
+{
+    return ps->buffer;
+}
+
+int parg_pointstream_ranges(parg_pointstream* ps, const int** ranges)
+{
+    *ranges = ps->ranges.a;
+    return kv_size(ps->ranges) / 2;
+}
+
+void parg_pointstream_free(parg_pointstream* ps)
+{
+    if (!ps) {
+        return;
+    }
+#if !EMSCRIPTEN
+    pthread_mutex_lock(&ps->lock);
+    ps->quit = 1;
+    pthread_cond_signal(&ps->wake);
+    pthread_mutex_unlock(&ps->lock);
+    pthread_join(ps->worker, 0);
+    pthread_mutex_destroy(&ps->lock);
+    pthread_cond_destroy(&ps->wake);
+#endif
+    for (int i = 0; i < kv_size(ps->results); i++) {
+        free(kv_A(ps->results, i).pts);
+    }
+    kv_destroy(ps->results);
+    kv_destroy(ps->queue);
+    kv_destroy(ps->drawn);
+    kv_destroy(ps->ranges);
+    kh_destroy(ps_tiles, ps->resident);
+    kh_destroy(ps_keys, ps->pending);
+    parg_buffer_free(ps->buffer);
+    free(ps);
+}
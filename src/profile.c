@@ -0,0 +1,361 @@
+#include <parg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "internal.h"
+#include "pargl.h"
+
+// Frames live in a ring, and each ring slot owns a pair of GPU timestamp
+// queries per scope.  Queries are read back in order as they complete,
+// which is usually a frame or two later, and the results are mapped onto
+// the CPU clock with an offset that is measured when profiling starts.
+
+#if EMSCRIPTEN
+#define glGenQueries glGenQueriesEXT
+#define glDeleteQueries glDeleteQueriesEXT
+#define glQueryCounter glQueryCounterEXT
+#define glGetQueryObjectiv glGetQueryObjectivEXT
+#define glGetQueryObjectui64v glGetQueryObjectui64vEXT
+#define glGetInteger64v glGetInteger64vEXT
+#define GL_TIMESTAMP GL_TIMESTAMP_EXT
+#define GL_QUERY_RESULT GL_QUERY_RESULT_EXT
+#define GL_QUERY_RESULT_AVAILABLE GL_QUERY_RESULT_AVAILABLE_EXT
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+#endif
+
+#define MAX_FRAMES 256
+
+// The HUD shows one bar per drawn frame, two pixels wide, and its full
+// height corresponds to this many seconds.
+#define HUD_FRAMES 120
+#define HUD_HEIGHT 100
+#define HUD_SECONDS (1.0 / 30.0)
+
+static const char* PHASE_NAMES[PARG_PHASE_COUNT] = {
+    "tick", "update", "draw", "swap", "events"};
+
+static const float PHASE_COLORS[PARG_PHASE_COUNT][3] = {{0.2, 0.6, 1.0},
+    {0.7, 0.4, 1.0}, {0.3, 0.9, 0.3}, {1.0, 0.6, 0.1}, {0.4, 0.4, 0.4}};
+
+parg_counters _parg_counters = {0};
+static parg_counters _snapshot = {0};
+
+static int _enabled = 0;
+static int _gputimers = 0;
+static double _gpuoffset = 0;
+static parg_profile_frame* _frames = 0;
+static GLuint (*_queries)[PARG_PROFILE_MAXSCOPES * 2] = 0;
+static int _nframes = 0;
+static int _resolved = 0;
+static int _inframe = 0;
+static int _stack[PARG_PROFILE_MAXSCOPES];
+static int _depth = 0;
+
+double parg_profile_now()
+{
+#if EMSCRIPTEN
+    return emscripten_get_now() * 0.001;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static int has_extension(const char* desktop, const char* webgl)
+{
+    const char* exts = (const char*) glGetString(GL_EXTENSIONS);
+    return exts && (strstr(exts, desktop) || strstr(exts, webgl));
+}
+
+void parg_profile_enable(int enabled)
+{
+    _enabled = enabled;
+    if (!enabled || _frames) {
+        return;
+    }
+    _frames = calloc(MAX_FRAMES, sizeof(parg_profile_frame));
+    _queries = calloc(MAX_FRAMES, sizeof(*_queries));
+}
+
+static parg_profile_frame* current_frame()
+{
+    return _frames + (_nframes - 1) % MAX_FRAMES;
+}
+
+void parg_profile_frame_begin()
+{
+    if (!_enabled) {
+        return;
+    }
+    parg_profile_frame_end();
+
+    // Frames whose queries never completed are dropped when their slot is
+    // reused.
+    _resolved = PARG_MAX(_resolved, _nframes + 1 - MAX_FRAMES);
+    parg_profile_frame* frame = _frames + _nframes % MAX_FRAMES;
+    memset(frame, 0, sizeof(parg_profile_frame));
+    frame->index = _nframes++;
+    frame->begin = parg_profile_now();
+    _inframe = 1;
+    _depth = 0;
+}
+
+void parg_profile_frame_end()
+{
+    if (!_enabled || !_inframe) {
+        return;
+    }
+    current_frame()->end = parg_profile_now();
+    _inframe = 0;
+}
+
+void parg_profile_phase_begin(parg_phase phase)
+{
+    if (_enabled && _inframe) {
+        parg_profile_frame* frame = current_frame();
+        double now = parg_profile_now();
+        if (!frame->phase_begin[phase]) {
+            frame->phase_begin[phase] = now;
+        }
+        frame->phase_time[phase] -= now;
+    }
+}
+
+void parg_profile_phase_end(parg_phase phase)
+{
+    if (_enabled && _inframe) {
+        current_frame()->phase_time[phase] += parg_profile_now();
+    }
+}
+
+static void sync_gpu_clock()
+{
+    GLint64 gputime;
+    glGetInteger64v(GL_TIMESTAMP, &gputime);
+    _gpuoffset = parg_profile_now() - gputime * 1e-9;
+}
+
+// Reads back the GPU timestamps of completed frames, oldest first.
+static void resolve_queries()
+{
+#if EMSCRIPTEN
+    // A disjoint event, such as a power state change, makes every query in
+    // flight meaningless.  Those frames keep their GPU times unset.
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) {
+        _resolved = _nframes - 1;
+        sync_gpu_clock();
+        return;
+    }
+#endif
+    for (; _resolved < _nframes - 1; _resolved++) {
+        parg_profile_frame* frame = _frames + _resolved % MAX_FRAMES;
+        GLuint* queries = _queries[_resolved % MAX_FRAMES];
+        for (int i = 0; i < frame->nscopes; i++) {
+            GLint available = 0;
+            glGetQueryObjectiv(
+                queries[i * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                return;
+            }
+        }
+        for (int i = 0; i < frame->nscopes; i++) {
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(queries[i * 2], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+            frame->scopes[i].gpu_begin = begin * 1e-9 + _gpuoffset;
+            frame->scopes[i].gpu_end = end * 1e-9 + _gpuoffset;
+        }
+    }
+}
+
+static void query_timestamp(int scope, int end)
+{
+    GLuint* query = &_queries[(_nframes - 1) % MAX_FRAMES][scope * 2 + end];
+    if (!*query) {
+        glGenQueries(1, query);
+    }
+    glQueryCounter(*query, GL_TIMESTAMP);
+}
+
+void parg_profile_push(parg_token name)
+{
+    if (!_enabled || !_inframe) {
+        return;
+    }
+    parg_profile_frame* frame = current_frame();
+    if (!_gputimers) {
+        _gputimers = has_extension("ARB_timer_query", "disjoint_timer_query")
+            ? 1 : -1;
+        if (_gputimers > 0) {
+            sync_gpu_clock();
+        }
+    }
+    if (_gputimers > 0 && !frame->nscopes) {
+        resolve_queries();
+    }
+    parg_assert(_depth < PARG_PROFILE_MAXSCOPES, "Scopes are nested too deep");
+    int index = frame->nscopes;
+    _stack[_depth++] = index;
+    if (index == PARG_PROFILE_MAXSCOPES) {
+        return;
+    }
+    frame->nscopes++;
+    parg_profile_scope* scope = frame->scopes + index;
+    scope->name = name;
+    scope->depth = _depth - 1;
+    scope->cpu_begin = parg_profile_now();
+    scope->gpu_begin = scope->gpu_end = -1;
+    if (_gputimers > 0) {
+        query_timestamp(index, 0);
+    }
+}
+
+void parg_profile_pop()
+{
+    if (!_enabled || !_inframe) {
+        return;
+    }
+    parg_assert(_depth > 0, "Unbalanced profile scopes");
+    int index = _stack[--_depth];
+    if (index == PARG_PROFILE_MAXSCOPES) {
+        return;
+    }
+    current_frame()->scopes[index].cpu_end = parg_profile_now();
+    if (_gputimers > 0) {
+        query_timestamp(index, 1);
+    }
+}
+
+void parg_counters_frame()
+{
+    _snapshot = _parg_counters;
+    if (_enabled && _inframe) {
+        current_frame()->drawn = 1;
+        current_frame()->counters = _snapshot;
+    }
+    parg_counters* c = &_parg_counters;
+    c->draws = c->triangles = c->program_binds = c->state_changes = 0;
+    c->buffer_uploads = c->texture_uploads = 0;
+    c->uploaded_bytes = 0;
+}
+
+void parg_counters_snapshot(parg_counters* dst) { *dst = _snapshot; }
+
+static void fill_rect(int x, int y, int width, int height, const float* rgb)
+{
+    if (width > 0 && height > 0) {
+        glScissor(x, y, width, height);
+        glClearColor(rgb[0], rgb[1], rgb[2], 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+}
+
+// Bars are scissored clears, which keeps the HUD free of shaders and
+// buffers.  The frame being drawn is incomplete, so it is left out.
+void parg_profile_draw_hud()
+{
+    static const float background[3] = {0, 0, 0};
+    static const float marker[3] = {1, 0.2, 0.2};
+    if (!_enabled || !_inframe) {
+        return;
+    }
+    GLint viewport[4], box[4];
+    GLfloat clearcolor[4];
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_SCISSOR_BOX, box);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearcolor);
+    glEnable(GL_SCISSOR_TEST);
+    int x0 = viewport[0], y0 = viewport[1];
+    fill_rect(x0, y0, HUD_FRAMES * 2, HUD_HEIGHT, background);
+    int x = x0 + HUD_FRAMES * 2;
+    int oldest = PARG_MAX(0, _nframes - MAX_FRAMES);
+    for (int i = _nframes - 2; i >= oldest && x > x0; i--) {
+        parg_profile_frame* frame = _frames + i % MAX_FRAMES;
+        if (!frame->drawn) {
+            continue;
+        }
+        x -= 2;
+        int y = y0;
+        for (int p = 0; p < PARG_PHASE_COUNT; p++) {
+            int height = frame->phase_time[p] / HUD_SECONDS * HUD_HEIGHT + 0.5;
+            height = PARG_MIN(height, y0 + HUD_HEIGHT - y);
+            fill_rect(x, y, 2, height, PHASE_COLORS[p]);
+            y += height;
+        }
+    }
+    fill_rect(x0, y0 + HUD_HEIGHT / 2, HUD_FRAMES * 2, 1, marker);
+    glClearColor(clearcolor[0], clearcolor[1], clearcolor[2], clearcolor[3]);
+    glScissor(box[0], box[1], box[2], box[3]);
+    if (!scissor) {
+        glDisable(GL_SCISSOR_TEST);
+    }
+}
+
+int parg_profile_frames(parg_profile_frame* dst, int maxframes)
+{
+    int nframes = PARG_MIN(PARG_MIN(_nframes, MAX_FRAMES), maxframes);
+    for (int i = 0; i < nframes; i++) {
+        int index = _nframes - nframes + i;
+        dst[i] = _frames[index % MAX_FRAMES];
+    }
+    return nframes;
+}
+
+static void write_event(FILE* f, const char* name, int tid, double begin,
+    double duration, int* first)
+{
+    fprintf(f, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+        "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+        *first ? "" : ",", name, tid, begin * 1e6, duration * 1e6);
+    *first = 0;
+}
+
+void parg_profile_write_trace(const char* filepath)
+{
+    FILE* f = fopen(filepath, "w");
+    parg_verify(f, "Unable to open file", filepath);
+    fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", f);
+    int first = 1;
+    int nframes = PARG_MIN(_nframes, MAX_FRAMES);
+    for (int i = _nframes - nframes; i < _nframes; i++) {
+        parg_profile_frame* frame = _frames + i % MAX_FRAMES;
+        if (!frame->end) {
+            continue;
+        }
+        write_event(f, "frame", 1, frame->begin, frame->end - frame->begin,
+            &first);
+        for (int p = 0; p < PARG_PHASE_COUNT; p++) {
+            if (frame->phase_begin[p]) {
+                write_event(f, PHASE_NAMES[p], 2, frame->phase_begin[p],
+                    frame->phase_time[p], &first);
+            }
+        }
+        for (int s = 0; s < frame->nscopes; s++) {
+            parg_profile_scope* scope = frame->scopes + s;
+            const char* name = parg_token_to_string(scope->name);
+            write_event(f, name, 3, scope->cpu_begin,
+                scope->cpu_end - scope->cpu_begin, &first);
+            if (scope->gpu_begin >= 0) {
+                write_event(f, name, 4, scope->gpu_begin,
+                    scope->gpu_end - scope->gpu_begin, &first);
+            }
+        }
+        if (frame->drawn) {
+            parg_counters* c = &frame->counters;
+            fprintf(f, ",\n{\"name\": \"counters\", \"ph\": \"C\", "
+                "\"pid\": 1, \"ts\": %.3f, \"args\": {\"draws\": %d, "
+                "\"triangles\": %d, \"uploaded_bytes\": %lld}}",
+                frame->end * 1e6, c->draws, c->triangles,
+                (long long) c->uploaded_bytes);
+        }
+    }
+    fputs("\n],\n\"metadata\": {\"threads\": "
+        "[\"frames\", \"phases\", \"cpu scopes\", \"gpu scopes\"]}}\n", f);
+    fclose(f);
+}
@@ -0,0 +1,243 @@
+#include <parg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "kvec.h"
+
+// The quadtree follows the slippy tile scheme: the root is tile 0 of a square
+// that encompasses the map, and each child is one of the four tiles at the
+// next level.  Items are sorted by the Morton code of their tile at the
+// deepest level, which makes every node a contiguous run of items.  Node
+// bounds are the union of the items they contain, so triangles that
+// straddle tile boundaries are never culled incorrectly.
+
+#define MAX_DEPTH 12
+#define LEAF_SIZE 256
+
+typedef struct {
+    parg_aar bounds;
+    int begin;
+    int end;
+    int children;
+} qt_node;
+
+typedef struct {
+    uint32_t code;
+    int index;
+} qt_item;
+
+struct parg_quadtree_s {
+    kvec_t(qt_node) nodes;
+    kvec_t(int) ranges;
+};
+
+static uint32_t spread_bits(uint32_t x)
+{
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+static uint32_t morton_code(float x, float y, Vector2 mapsize)
+{
+    float e = PARG_MAX(mapsize.x, mapsize.y);
+    int n = 1 << MAX_DEPTH;
+    int tx = (x / e + 0.5f) * n;
+    int ty = (y / e + 0.5f) * n;
+    tx = PARG_CLAMP(tx, 0, n - 1);
+    ty = PARG_CLAMP(ty, 0, n - 1);
+    return spread_bits(tx) | (spread_bits(ty) << 1);
+}
+
+static int compare_items(const void* a, const void* b)
+{
+    uint32_t ca = ((const qt_item*) a)->code;
+    uint32_t cb = ((const qt_item*) b)->code;
+    return (ca > cb) - (ca < cb);
+}
+
+// Returns the first item in [begin, end) whose code is at least the given
+// code.
+static int lower_bound(const qt_item* items, int begin, int end, uint32_t code)
+{
+    while (begin < end) {
+        int mid = begin + (end - begin) / 2;
+        if (items[mid].code < code) {
+            begin = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return begin;
+}
+
+static parg_aar empty_bounds()
+{
+    parg_aar rect = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    return rect;
+}
+
+// Appends the children of the given node, whose items all share the given
+// code prefix at the given depth.
+static void subdivide(parg_quadtree* qt, const qt_item* items,
+    const parg_aar* itembounds, int node, uint32_t prefix, int depth)
+{
+    qt_node parent = kv_A(qt->nodes, node);
+    if (depth == MAX_DEPTH || parent.end - parent.begin <= LEAF_SIZE) {
+        parg_aar bounds = empty_bounds();
+        for (int i = parent.begin; i < parent.end; i++) {
+            bounds = parg_aar_encompass(bounds, itembounds[i]);
+        }
+        kv_A(qt->nodes, node).bounds = bounds;
+        return;
+    }
+    int shift = 2 * (MAX_DEPTH - depth - 1);
+    int first = kv_size(qt->nodes);
+    int begin = parent.begin;
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+        uint32_t next = prefix | ((quadrant + 1) << shift);
+        int end = quadrant == 3 ? parent.end
+                                : lower_bound(items, begin, parent.end, next);
+        qt_node child = {empty_bounds(), begin, end, -1};
+        kv_push(qt_node, qt->nodes, child);
+        begin = end;
+    }
+    kv_A(qt->nodes, node).children = first;
+    parg_aar bounds = empty_bounds();
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+        int child = first + quadrant;
+        if (kv_A(qt->nodes, child).begin < kv_A(qt->nodes, child).end) {
+            subdivide(qt, items, itembounds, child,
+                prefix | (quadrant << shift), depth + 1);
+            bounds = parg_aar_encompass(bounds, kv_A(qt->nodes, child).bounds);
+        }
+    }
+    kv_A(qt->nodes, node).bounds = bounds;
+}
+
+static parg_quadtree* build(qt_item* items, parg_aar* itembounds, int count)
+{
+    parg_quadtree* qt = calloc(sizeof(struct parg_quadtree_s), 1);
+    qt_node root = {empty_bounds(), 0, count, -1};
+    kv_push(qt_node, qt->nodes, root);
+    subdivide(qt, items, itembounds, 0, 0, 0);
+    return qt;
+}
+
+parg_quadtree* parg_quadtree_from_points(
+    float* pts, int npts, int stride, Vector2 mapsize)
+{
+    qt_item* items = malloc(sizeof(qt_item) * npts);
+    for (int i = 0; i < npts; i++) {
+        const float* pt = pts + i * stride;
+        items[i].code = morton_code(pt[0], pt[1], mapsize);
+        items[i].index = i;
+    }
+    qsort(items, npts, sizeof(qt_item), compare_items);
+    float* sorted = malloc(sizeof(float) * stride * npts);
+    parg_aar* itembounds = malloc(sizeof(parg_aar) * npts);
+    for (int i = 0; i < npts; i++) {
+        const float* pt = pts + items[i].index * stride;
+        memcpy(sorted + i * stride, pt, sizeof(float) * stride);
+        parg_aar rect = {pt[0], pt[1], pt[0], pt[1]};
+        itembounds[i] = rect;
+    }
+    memcpy(pts, sorted, sizeof(float) * stride * npts);
+    free(sorted);
+    parg_quadtree* qt = build(items, itembounds, npts);
+    free(itembounds);
+    free(items);
+    return qt;
+}
+
+parg_quadtree* parg_quadtree_from_triangles(const float* pts, int stride,
+    uint16_t* tris, int ntris, Vector2 mapsize)
+{
+    qt_item* items = malloc(sizeof(qt_item) * ntris);
+    parg_aar* trianglebounds = malloc(sizeof(parg_aar) * ntris);
+    for (int i = 0; i < ntris; i++) {
+        parg_aar rect = empty_bounds();
+        for (int j = 0; j < 3; j++) {
+            const float* pt = pts + tris[i * 3 + j] * stride;
+            parg_aar corner = {pt[0], pt[1], pt[0], pt[1]};
+            rect = parg_aar_encompass(rect, corner);
+        }
+        trianglebounds[i] = rect;
+        items[i].code = morton_code((rect.left + rect.right) * 0.5f,
+            (rect.bottom + rect.top) * 0.5f, mapsize);
+        items[i].index = i;
+    }
+    qsort(items, ntris, sizeof(qt_item), compare_items);
+    uint16_t* sorted = malloc(sizeof(uint16_t) * 3 * ntris);
+    parg_aar* itembounds = malloc(sizeof(parg_aar) * ntris);
+    for (int i = 0; i < ntris; i++) {
+        memcpy(sorted + i * 3, tris + items[i].index * 3, sizeof(uint16_t) * 3);
+        itembounds[i] = trianglebounds[items[i].index];
+    }
+    memcpy(tris, sorted, sizeof(uint16_t) * 3 * ntris);
+    free(sorted);
+    free(trianglebounds);
+    parg_quadtree* qt = build(items, itembounds, ntris);
+    free(itembounds);
+    free(items);
+    return qt;
+}
+
+static int overlaps(parg_aar a, parg_aar b)
+{
+    return a.left <= b.right && b.left <= a.right && a.bottom <= b.top &&
+        b.bottom <= a.top;
+}
+
+static int contains(parg_aar outer, parg_aar inner)
+{
+    return outer.left <= inner.left && outer.right >= inner.right &&
+        outer.bottom <= inner.bottom && outer.top >= inner.top;
+}
+
+static void emit_range(parg_quadtree* qt, int begin, int end)
+{
+    int n = kv_size(qt->ranges);
+    if (n && kv_A(qt->ranges, n - 2) + kv_A(qt->ranges, n - 1) == begin) {
+        kv_A(qt->ranges, n - 1) += end - begin;
+        return;
+    }
+    kv_push(int, qt->ranges, begin);
+    kv_push(int, qt->ranges, end - begin);
+}
+
+static void query_node(parg_quadtree* qt, int index, parg_aar viewport)
+{
+    qt_node node = kv_A(qt->nodes, index);
+    if (node.begin == node.end || !overlaps(node.bounds, viewport)) {
+        return;
+    }
+    if (node.children < 0 || contains(viewport, node.bounds)) {
+        emit_range(qt, node.begin, node.end);
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        query_node(qt, node.children + i, viewport);
+    }
+}
+
+int parg_quadtree_query(
+    parg_quadtree* qt, parg_aar viewport, const int** ranges)
+{
+    qt->ranges.n = 0;
+    query_node(qt, 0, viewport);
+    *ranges = qt->ranges.a;
+    return kv_size(qt->ranges) / 2;
+}
+
+void parg_quadtree_free(parg_quadtree* qt)
+{
+    if (!qt) {
+        return;
+    }
+    kv_destroy(qt->nodes);
+    kv_destroy(qt->ranges);
+    free(qt);
+}
@@ -1,212 +1,449 @@
 #include <parg.h>
 #include "internal.h"
 #include "pargl.h"
+#include <stdlib.h>
 #include <string.h>
 #include "kvec.h"
 #include "khash.h"
 
-// Mapping from tokens to sds strings.
-KHASH_MAP_INIT_INT(smap, sds)
-
 // Mapping from tokens to OpenGL handles.
 KHASH_MAP_INIT_INT(glmap, GLuint)
 
 // Mapping from tokens to integer slots.
 KHASH_MAP_INIT_INT(imap, int)
 
-static khash_t(smap)* _vshader_registry = 0;
-static khash_t(smap)* _fshader_registry = 0;
+// A run of source text within a library, or a reference to another chunk.
+typedef struct {
+    int offset;
+    int length;
+    int line;
+    parg_token include;
+} shader_piece;
+
+typedef kvec_t(shader_piece) piecevec;
+
+typedef struct {
+    piecevec pieces;
+} shader_chunk;
+
+// Mapping from chunk names to chunks.
+KHASH_MAP_INIT_INT(chunkmap, shader_chunk*)
+
+// Each loaded buffer becomes a library that owns a single copy of its text.
+// Chunks are recorded as offsets into this text and never copied.
+typedef struct {
+    sds text;
+    shader_chunk* prefix;
+    khash_t(chunkmap)* chunks;
+    parg_token asset;
+} shader_library;
+
+typedef kvec_t(shader_library*) libraryvec;
+
+// A feature flag that selects a specialized variant of a program.
+typedef struct {
+    sds name;
+    parg_token token;
+    int shift;
+    int nbits;
+} shader_feature;
+
+typedef kvec_t(shader_feature) featurevec;
+
+// A program declaration, which is assembled into GLSL only when bound.
+typedef struct {
+    shader_library* library;
+    parg_token vshader;
+    parg_token fshader;
+    sds defines;
+    featurevec features;
+} shader_decl;
+
+// A linked program variant, tracked for least-recently-used eviction.
+typedef struct {
+    parg_token program;
+    uint32_t mask;
+} shader_variant;
+
+typedef kvec_t(shader_variant) variantvec;
+
+typedef kvec_t(parg_token) tokenvec;
+
+// Mapping from program tokens to the uniform keys gathered for them.
+KHASH_MAP_INIT_INT(unifmap, tokenvec*)
+
+// Mapping from program tokens to declarations.
+KHASH_MAP_INIT_INT(declmap, shader_decl*)
+
+// Mapping from program tokens paired with feature masks to linked variants.
+KHASH_MAP_INIT_INT64(variantmap, GLuint)
+
+// Mapping from variant handles paired with uniform tokens to locations.
+KHASH_MAP_INIT_INT64(varunifmap, GLint)
+
+static khash_t(declmap)* _decl_registry = 0;
+static khash_t(chunkmap)* _chunk_registry = 0;
 static khash_t(glmap)* _program_registry = 0;
 static khash_t(imap)* _attr_registry = 0;
 static khash_t(imap)* _unif_registry = 0;
+static khash_t(unifmap)* _unif_lists = 0;
+static khash_t(variantmap)* _variant_registry = 0;
+static khash_t(varunifmap)* _variant_unifs = 0;
+static libraryvec _libraries = {0, 0, 0};
+static variantvec _variant_cache = {0, 0, 0};
 static GLuint _current_program = 0;
 static parg_token _current_program_token = 0;
+static uint32_t _current_features = 0;
 
 #define MAX_SHADER_SPEW 1024
+#define MAX_SHADER_VARIANTS 32
+#define MAX_FEATURE_BITS 32
 #define MAX_UNIFORM_LEN 128
+#define MAX_INCLUDE_DEPTH 16
+#define PROGRAM_DIRECTIVE "@program "
+#define ATTRIBUTE_KEYWORD "attribute "
+#define INCLUDE_DIRECTIVE "#include"
 #define kv_last(vec) kv_A(vec, kv_size(vec) - 1)
-#define chunk_body kv_last(chunk_bodies)
 
-typedef kvec_t (sds) sdsvec;
+typedef kvec_t(sds) sdsvec;
+typedef kvec_t(const GLchar*) strvec;
+typedef kvec_t(GLint) lenvec;
 
-static int kv_find(sdsvec keys, sds key)
+static shader_chunk* chunk_create(
+    shader_library* lib, parg_token name, int offset, int line)
 {
-    for (int p = 0; p < kv_size(keys); p++) {
-        if (0 == strcmp(kv_A(keys, p), key)) {
-            return p;
-        }
+    shader_chunk* chunk = malloc(sizeof(shader_chunk));
+    kv_init(chunk->pieces);
+    shader_piece piece = {offset, 0, line, 0};
+    kv_push(shader_piece, chunk->pieces, piece);
+    int ret;
+    khiter_t iter = kh_put(chunkmap, lib->chunks, name, &ret);
+    kh_value(lib->chunks, iter) = chunk;
+    return chunk;
+}
+
+static sds trimmed_sds(const char* str, int len)
+{
+    sds retval = sdsnewlen(str, len);
+    return sdstrim(retval, " \t\r");
+}
+
+static void register_attribute(const char* line, int len)
+{
+    int nwords;
+    sds aline = sdsnewlen(line, len);
+    aline = sdstrim(aline, "; \t\r");
+    sds* words = sdssplitlen(aline, sdslen(aline), " \t", 1, &nwords);
+    parg_token tok = parg_token_from_string(words[nwords - 1]);
+    sdsfreesplitres(words, nwords);
+    sdsfree(aline);
+    khiter_t iter = kh_get(imap, _attr_registry, tok);
+    if (iter == kh_end(_attr_registry)) {
+        int newslot = kh_size(_attr_registry);
+        int ret;
+        iter = kh_put(imap, _attr_registry, tok, &ret);
+        kh_value(_attr_registry, iter) = newslot;
     }
-    return -1;
 }
 
-void parg_shader_load_from_buffer(parg_buffer* buf)
+static void free_decl(shader_decl* decl)
 {
-    const sds ATTRIBUTE = sdsnew("attribute ");
-    const sds PROGRAM = sdsnew("@program ");
-    const sds PREFIX = sdsnew("_prefix");
-#if defined(__APPLE__) && defined(__MACH__)
-    const sds OSX_PREFIX = sdsnew("#version 120\n");
-#endif
+    for (int f = 0; f < kv_size(decl->features); f++) {
+        sdsfree(kv_A(decl->features, f).name);
+    }
+    kv_destroy(decl->features);
+    sdsfree(decl->defines);
+    free(decl);
+}
+
+static void register_program(shader_library* lib, sds argstring)
+{
+    // Extract the command arguments; anything after the first three is a
+    // preprocessor symbol of the form NAME or NAME=VALUE, or a feature flag.
+    // Feature flags are written as NAME? for booleans and NAME?N for integers
+    // that occupy N bits; each combination of feature values is compiled into
+    // its own variant.
+    int nargs;
+    sds* args = sdssplitlen(argstring, sdslen(argstring), ",", 1, &nargs);
+    for (int a = 0; a < nargs; a++) {
+        sdstrim(args[a], " \t\r");
+    }
+    parg_verify(nargs >= 3, "@program should have 3 args", argstring);
+    shader_decl* decl = malloc(sizeof(shader_decl));
+    decl->library = lib;
+    decl->vshader = parg_token_from_string(args[1]);
+    decl->fshader = parg_token_from_string(args[2]);
+    decl->defines = sdsempty();
+    kv_init(decl->features);
+    int nbits = 0;
+    for (int a = 3; a < nargs; a++) {
+        char* question = strchr(args[a], '?');
+        if (question) {
+            shader_feature feature;
+            feature.name = sdsnewlen(args[a], question - args[a]);
+            feature.token = parg_token_from_string(feature.name);
+            feature.shift = nbits;
+            feature.nbits = question[1] ? atoi(question + 1) : 1;
+            nbits += feature.nbits;
+            parg_verify(nbits <= MAX_FEATURE_BITS, "Too many feature bits",
+                argstring);
+            kv_push(shader_feature, decl->features, feature);
+            continue;
+        }
+        int nparts;
+        sds* parts = sdssplitlen(args[a], sdslen(args[a]), "=", 1, &nparts);
+        decl->defines = sdscatprintf(decl->defines, "#define %s %s\n",
+            parts[0], nparts > 1 ? parts[1] : "1");
+        sdsfreesplitres(parts, nparts);
+    }
+    khiter_t iter = kh_get(chunkmap, lib->chunks, decl->vshader);
+    parg_verify(iter != kh_end(lib->chunks), "No such vshader", args[1]);
+    iter = kh_get(chunkmap, lib->chunks, decl->fshader);
+    parg_verify(iter != kh_end(lib->chunks), "No such fshader", args[2]);
+
+    parg_token program_name = parg_token_from_string(args[0]);
+    sdsfreesplitres(args, nargs);
+    int ret;
+    iter = kh_put(declmap, _decl_registry, program_name, &ret);
+    if (!ret) {
+        free_decl(kh_value(_decl_registry, iter));
+    }
+    kh_value(_decl_registry, iter) = decl;
+}
 
-    if (!_vshader_registry) {
-        _vshader_registry = kh_init(smap);
-        _fshader_registry = kh_init(smap);
+static shader_library* load_library(parg_buffer* buf, parg_token asset)
+{
+    if (!_decl_registry) {
+        _decl_registry = kh_init(declmap);
+        _chunk_registry = kh_init(chunkmap);
         _attr_registry = kh_init(imap);
         _unif_registry = kh_init(imap);
+        _unif_lists = kh_init(unifmap);
     }
 
-    sdsvec program_args;
-    kv_init(program_args);
-    sdsvec chunk_bodies;
-    kv_init(chunk_bodies);
-    sdsvec chunk_names;
-    kv_init(chunk_names);
-
-    // Split the buffer into a list of codelines.
+    // Make a single copy of the text; everything else refers into it.
     int len = parg_buffer_length(buf);
-    int nlines;
     char* contents = parg_buffer_lock(buf, PARG_READ);
-    sds* lines = sdssplitlen(contents, len, "\n", 1, &nlines);
+    while (len > 0 && contents[len - 1] == 0) {
+        len--;
+    }
+    shader_library* lib = malloc(sizeof(shader_library));
+    lib->text = sdsnewlen(contents, len);
+    lib->chunks = kh_init(chunkmap);
+    lib->asset = asset;
+    kv_push(shader_library*, _libraries, lib);
     parg_buffer_unlock(buf);
 
-    // Group codelines into chunks and stash all @program lines.
-    kv_push(sds, chunk_names, sdsdup(PREFIX));
-    kv_push(sds, chunk_bodies, sdsempty());
-    for (int j = 0; j < nlines; j++) {
-        sds line = lines[j];
-        if (sdslen(line) > 2 && line[0] == '-' && line[1] == '-') {
-            sds chunkname = sdsdup(line);
-            sdsrange(chunkname, 2, -1);
-            chunkname = sdstrim(chunkname, " \t");
-            kv_push(sds, chunk_names, chunkname);
-            kv_push(sds, chunk_bodies, sdsempty());
-            chunk_body = sdscatprintf(chunk_body, "#line %d\n", j + 1);
+    // Scan the text in a single pass, recording chunk boundaries, include
+    // references, @program lines, and attribute declarations.
+    const char* text = lib->text;
+    const int progdir_len = strlen(PROGRAM_DIRECTIVE);
+    const int attrkw_len = strlen(ATTRIBUTE_KEYWORD);
+    const int incdir_len = strlen(INCLUDE_DIRECTIVE);
+    sdsvec program_args;
+    kv_init(program_args);
+    shader_chunk* chunk = lib->prefix =
+        chunk_create(lib, parg_token_from_string("_prefix"), 0, 0);
+    int lineno = 0;
+    for (int pos = 0; pos < len;) {
+        const char* line = text + pos;
+        const char* eol = memchr(line, '\n', len - pos);
+        int linelen = eol ? eol - line : len - pos;
+        int next = pos + linelen + 1;
+        shader_piece* piece = &kv_last(chunk->pieces);
+        lineno++;
+        if (linelen > 2 && line[0] == '-' && line[1] == '-') {
+            piece->length = pos - piece->offset;
+            sds name = trimmed_sds(line + 2, linelen - 2);
+            chunk = chunk_create(lib, parg_token_from_string(name), next,
+                lineno);
+            sdsfree(name);
+            pos = next;
             continue;
         }
-        chunk_body = sdscatsds(chunk_body, line);
-        chunk_body = sdscat(chunk_body, "\n");
-        char* program = strstr(line, PROGRAM);
-        if (program) {
-            kv_push(sds, program_args, sdsnew(program + sdslen(PROGRAM)));
+        if (linelen > incdir_len && line[0] == '#' &&
+            !strncmp(line, INCLUDE_DIRECTIVE, incdir_len)) {
+            piece->length = pos - piece->offset;
+            sds name = trimmed_sds(line + incdir_len, linelen - incdir_len);
+            name = sdstrim(name, "\"<>");
+            shader_piece include = {0, 0, 0, parg_token_from_string(name)};
+            shader_piece resume = {next, 0, lineno, 0};
+            kv_push(shader_piece, chunk->pieces, include);
+            kv_push(shader_piece, chunk->pieces, resume);
+            sdsfree(name);
+            pos = next;
+            continue;
         }
-        char* attr = strstr(line, ATTRIBUTE);
-        if (attr == line) {
-            int nwords;
-            sds aline = sdsnew(attr + sdslen(ATTRIBUTE));
-            aline = sdstrim(aline, "; \t");
-            sds* words = sdssplitlen(aline, sdslen(aline), " \t", 1, &nwords);
-            sds attr = sdsdup(words[nwords - 1]);
-            sdsfreesplitres(words, nwords);
-            sdsfree(aline);
-            parg_token tok = parg_token_from_string(attr);
-            khiter_t iter = kh_get(imap, _attr_registry, tok);
-            if (iter == kh_end(_attr_registry)) {
-                int newslot = kh_size(_attr_registry);
-                int ret;
-                iter = kh_put(imap, _attr_registry, tok, &ret);
-                kh_value(_attr_registry, iter) = newslot;
-            }
-            sdsfree(attr);
+        if (linelen > attrkw_len &&
+            !strncmp(line, ATTRIBUTE_KEYWORD, attrkw_len)) {
+            register_attribute(line + attrkw_len, linelen - attrkw_len);
         }
+        const char* at = memchr(line, '@', linelen);
+        if (at && linelen - (at - line) > progdir_len &&
+            !strncmp(at, PROGRAM_DIRECTIVE, progdir_len)) {
+            at += progdir_len;
+            kv_push(sds, program_args, sdsnewlen(at, line + linelen - at));
+        }
+        pos = next;
     }
-    sdsfreesplitres(lines, nlines);
-    sds prefix_body = kv_A(chunk_bodies, 0);
-
-    // Go back through the @program lines and populate the registry.
-    for (int p = 0; p < kv_size(program_args); p++) {
-        sds argstring = kv_A(program_args, p);
+    shader_piece* piece = &kv_last(chunk->pieces);
+    piece->length = len - piece->offset;
 
-        // Extract the three command arguments.
-        int nargs = sdslen(argstring);
-        sds* args = sdssplitlen(argstring, nargs, ",", 1, &nargs);
-        for (int a = 0; a < nargs; a++) {
-            sdstrim(args[a], " \t");
+    // Publish the chunks so that other libraries can include them.
+    for (khiter_t iter = kh_begin(lib->chunks); iter != kh_end(lib->chunks);
+        ++iter) {
+        if (kh_exist(lib->chunks, iter)) {
+            int ret;
+            parg_token name = kh_key(lib->chunks, iter);
+            khiter_t dst = kh_put(chunkmap, _chunk_registry, name, &ret);
+            kh_value(_chunk_registry, dst) = kh_value(lib->chunks, iter);
         }
-        parg_assert(nargs == 3, "@program should have 3 args");
-
-        // Build the vshader and fshader strings.
-        int vshader_index = kv_find(chunk_names, args[1]);
-        int fshader_index = kv_find(chunk_names, args[2]);
-        parg_verify(vshader_index > 0, "No such vshader", args[1]);
-        parg_verify(fshader_index > 0, "No such fshader", args[2]);
-        sds vshader_body = kv_A(chunk_bodies, vshader_index);
-        sds fshader_body = kv_A(chunk_bodies, fshader_index);
-        vshader_body = sdscat(sdsdup(prefix_body), vshader_body);
-#if EMSCRIPTEN
-        sds qualified_prefix =
-            sdscatsds(sdsnew("precision highp float;\n"), prefix_body);
-        fshader_body = sdscat(qualified_prefix, fshader_body);
-#else
-        fshader_body = sdscat(sdsdup(prefix_body), fshader_body);
-#if defined(__APPLE__) && defined(__MACH__)
-        sds tmp = fshader_body;
-        fshader_body = sdscatsds(sdsdup(OSX_PREFIX), fshader_body);
-        sdsfree(tmp);
-#endif
-#endif
-        parg_token program_name = parg_token_from_string(args[0]);
-        sdsfreesplitres(args, nargs);
-        sdsfree(argstring);
-
-        // Insert the vshader and fshader strings into the registries.
-        int ret;
-        khiter_t iter;
-        iter = kh_put(smap, _vshader_registry, program_name, &ret);
-        kh_value(_vshader_registry, iter) = vshader_body;
-        iter = kh_put(smap, _fshader_registry, program_name, &ret);
-        kh_value(_fshader_registry, iter) = fshader_body;
     }
 
+    // Go back through the @program lines and populate the registry.
+    for (int p = 0; p < kv_size(program_args); p++) {
+        register_program(lib, kv_A(program_args, p));
+        sdsfree(kv_A(program_args, p));
+    }
     kv_destroy(program_args);
-    kv_destroy(chunk_bodies);
-    kv_destroy(chunk_names);
-
-    sdsfree(ATTRIBUTE);
-    sdsfree(PROGRAM);
-    sdsfree(PREFIX);
+    return lib;
 }
 
+void parg_shader_load_from_buffer(parg_buffer* buf) { load_library(buf, 0); }
+
 void parg_shader_load_from_asset(parg_token id)
 {
     parg_buffer* buf = parg_buffer_from_asset(id);
-    parg_shader_load_from_buffer(buf);
+    load_library(buf, id);
     parg_buffer_free(buf);
 }
 
 GLuint parg_shader_attrib(parg_token tok) { return 0; }
 
-static GLuint compile_program(parg_token tok)
+static shader_chunk* find_chunk(shader_library* lib, parg_token name)
 {
-    khiter_t iter;
+    khiter_t iter = kh_get(chunkmap, lib->chunks, name);
+    if (iter != kh_end(lib->chunks)) {
+        return kh_value(lib->chunks, iter);
+    }
+    iter = kh_get(chunkmap, _chunk_registry, name);
+    parg_verify(iter != kh_end(_chunk_registry), "No such chunk",
+        parg_token_to_string(name));
+    return kh_value(_chunk_registry, iter);
+}
 
-    iter = kh_get(smap, _vshader_registry, tok);
-    parg_verify(iter != kh_end(_vshader_registry), "No vshader",
-        parg_token_to_string(tok));
-    sds vshader_body = kh_value(_vshader_registry, iter);
-    PARGL_STRING vshader_ptr = (PARGL_STRING) &vshader_body;
+// Gathers pointers to the pieces of a chunk (recursing into includes) so that
+// they can be handed directly to glShaderSource without concatenation.
+static void gather_pieces(shader_library* lib, shader_chunk* chunk,
+    strvec* strings, lenvec* lengths, sdsvec* scratch, int depth)
+{
+    parg_assert(depth < MAX_INCLUDE_DEPTH, "Shader includes are too deep");
+    for (int p = 0; p < kv_size(chunk->pieces); p++) {
+        shader_piece piece = kv_A(chunk->pieces, p);
+        if (piece.include) {
+            shader_chunk* included = find_chunk(lib, piece.include);
+            gather_pieces(
+                lib, included, strings, lengths, scratch, depth + 1);
+            continue;
+        }
+        if (!piece.length) {
+            continue;
+        }
+        if (piece.line) {
+            sds directive = sdscatprintf(sdsempty(), "#line %d\n", piece.line);
+            kv_push(sds, *scratch, directive);
+            kv_push(const GLchar*, *strings, directive);
+            kv_push(GLint, *lengths, sdslen(directive));
+        }
+        kv_push(const GLchar*, *strings, lib->text + piece.offset);
+        kv_push(GLint, *lengths, piece.length);
+    }
+}
 
-    iter = kh_get(smap, _fshader_registry, tok);
-    parg_verify(iter != kh_end(_fshader_registry), "No fshader",
-        parg_token_to_string(tok));
-    sds fshader_body = kh_value(_fshader_registry, iter);
-    PARGL_STRING fshader_ptr = (PARGL_STRING) &fshader_body;
+static GLuint compile_shader(parg_token tok, shader_decl* decl,
+    sds features, GLenum type, parg_token body)
+{
+    strvec strings;
+    lenvec lengths;
+    sdsvec scratch;
+    kv_init(strings);
+    kv_init(lengths);
+    kv_init(scratch);
+    if (type == GL_FRAGMENT_SHADER) {
+#if EMSCRIPTEN
+        kv_push(const GLchar*, strings, "precision highp float;\n");
+        kv_push(GLint, lengths, -1);
+#elif defined(__APPLE__) && defined(__MACH__)
+        kv_push(const GLchar*, strings, "#version 120\n");
+        kv_push(GLint, lengths, -1);
+#endif
+    }
+    kv_push(const GLchar*, strings, decl->defines);
+    kv_push(GLint, lengths, sdslen(decl->defines));
+    kv_push(const GLchar*, strings, features);
+    kv_push(GLint, lengths, sdslen(features));
+    shader_library* lib = decl->library;
+    gather_pieces(lib, lib->prefix, &strings, &lengths, &scratch, 0);
+    gather_pieces(
+        lib, find_chunk(lib, body), &strings, &lengths, &scratch, 0);
 
     GLchar spew[MAX_SHADER_SPEW];
     GLint compile_success = 0;
-
-    GLuint vs_handle = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs_handle, 1, vshader_ptr, 0);
-    glCompileShader(vs_handle);
-    glGetShaderiv(vs_handle, GL_COMPILE_STATUS, &compile_success);
-    glGetShaderInfoLog(vs_handle, MAX_SHADER_SPEW, 0, spew);
+    GLuint handle = glCreateShader(type);
+    glShaderSource(handle, kv_size(strings), (PARGL_STRING) strings.a,
+        lengths.a);
+    glCompileShader(handle);
+    glGetShaderiv(handle, GL_COMPILE_STATUS, &compile_success);
+    glGetShaderInfoLog(handle, MAX_SHADER_SPEW, 0, spew);
     parg_verify(compile_success, parg_token_to_string(tok), spew);
 
-    GLuint fs_handle = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs_handle, 1, fshader_ptr, 0);
-    glCompileShader(fs_handle);
-    glGetShaderiv(fs_handle, GL_COMPILE_STATUS, &compile_success);
-    glGetShaderInfoLog(fs_handle, MAX_SHADER_SPEW, 0, spew);
-    parg_verify(compile_success, parg_token_to_string(tok), spew);
+    for (int i = 0; i < kv_size(scratch); i++) {
+        sdsfree(kv_A(scratch, i));
+    }
+    kv_destroy(scratch);
+    kv_destroy(strings);
+    kv_destroy(lengths);
+    return handle;
+}
+
+static shader_decl* find_decl(parg_token tok)
+{
+    parg_assert(_decl_registry, "No shaders have been loaded");
+    khiter_t iter = kh_get(declmap, _decl_registry, tok);
+    parg_verify(iter != kh_end(_decl_registry), "No program declaration",
+        parg_token_to_string(tok));
+    return kh_value(_decl_registry, iter);
+}
+
+// Boolean features are defined only when enabled so that shaders can test
+// them with #ifdef, while integer features are always defined.
+static sds feature_defines(shader_decl* decl, uint32_t mask)
+{
+    sds defines = sdsempty();
+    for (int f = 0; f < kv_size(decl->features); f++) {
+        shader_feature feature = kv_A(decl->features, f);
+        uint32_t fmask = (uint32_t)(((uint64_t) 1 << feature.nbits) - 1);
+        uint32_t value = (mask >> feature.shift) & fmask;
+        if (feature.nbits > 1 || value) {
+            defines = sdscatprintf(
+                defines, "#define %s %u\n", feature.name, value);
+        }
+    }
+    return defines;
+}
+
+static GLuint compile_program(parg_token tok, uint32_t mask)
+{
+    khiter_t iter;
+    shader_decl* decl = find_decl(tok);
+    sds features = feature_defines(decl, mask);
+
+    GLchar spew[MAX_SHADER_SPEW];
+    GLuint vs_handle =
+        compile_shader(tok, decl, features, GL_VERTEX_SHADER, decl->vshader);
+    GLuint fs_handle = compile_shader(
+        tok, decl, features, GL_FRAGMENT_SHADER, decl->fshader);
+    sdsfree(features);
 
     GLuint program_handle = glCreateProgram();
     glAttachShader(program_handle, vs_handle);
@@ -229,6 +466,10 @@ static GLuint compile_program(parg_token tok)
     glGetProgramInfoLog(program_handle, MAX_SHADER_SPEW, 0, spew);
     parg_verify(link_success, parg_token_to_string(tok), spew);
 
+    // The shader objects are no longer needed once the program is linked.
+    glDeleteShader(vs_handle);
+    glDeleteShader(fs_handle);
+
     return program_handle;
 }
 
@@ -237,17 +478,24 @@ static void gather_uniforms(parg_token ptoken, GLuint phandle)
     int nuniforms;
     glGetProgramiv(phandle, GL_ACTIVE_UNIFORMS, &nuniforms);
     char uname[MAX_UNIFORM_LEN];
+    int ret;
+    khiter_t iter = kh_put(unifmap, _unif_lists, ptoken, &ret);
+    if (ret) {
+        kh_value(_unif_lists, iter) = calloc(sizeof(tokenvec), 1);
+    }
+    tokenvec* keys = kh_value(_unif_lists, iter);
+    keys->n = 0;
     while (nuniforms--) {
         GLint size;
         GLenum type;
-        int ret;
         glGetActiveUniform(
             phandle, nuniforms, MAX_UNIFORM_LEN, 0, &size, &type, uname);
         GLint loc = glGetUniformLocation(phandle, uname);
         parg_token utoken = parg_token_from_string(uname);
         parg_token combined_token = ptoken ^ utoken;
-        khiter_t iter = kh_put(imap, _unif_registry, combined_token, &ret);
+        iter = kh_put(imap, _unif_registry, combined_token, &ret);
         kh_value(_unif_registry, iter) = loc;
+        kv_push(parg_token, *keys, combined_token);
     }
 }
 
@@ -259,8 +507,39 @@ GLuint parg_shader_attrib_get(parg_token tok)
     return kh_value(_attr_registry, iter);
 }
 
+static uint64_t variant_key(uint32_t high, uint32_t low)
+{
+    return ((uint64_t) high << 32) | low;
+}
+
+static void gather_variant_uniforms(GLuint phandle)
+{
+    int nuniforms;
+    glGetProgramiv(phandle, GL_ACTIVE_UNIFORMS, &nuniforms);
+    char uname[MAX_UNIFORM_LEN];
+    while (nuniforms--) {
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(
+            phandle, nuniforms, MAX_UNIFORM_LEN, 0, &size, &type, uname);
+        parg_token utoken = parg_token_from_string(uname);
+        int ret;
+        khiter_t iter = kh_put(varunifmap, _variant_unifs,
+            variant_key(phandle, utoken), &ret);
+        kh_value(_variant_unifs, iter) = glGetUniformLocation(phandle, uname);
+    }
+}
+
 GLint parg_shader_uniform_get(parg_token utoken)
 {
+    if (_current_features) {
+        khiter_t iter = kh_get(varunifmap, _variant_unifs,
+            variant_key(_current_program, utoken));
+        if (iter == kh_end(_variant_unifs)) {
+            return -1;
+        }
+        return kh_value(_variant_unifs, iter);
+    }
     parg_token ptoken = _current_program_token;
     parg_token combined_token = ptoken ^ utoken;
     khiter_t iter = kh_get(imap, _unif_registry, combined_token);
@@ -270,34 +549,240 @@ GLint parg_shader_uniform_get(parg_token utoken)
     return kh_value(_unif_registry, iter);
 }
 
-void parg_shader_bind(parg_token tok)
+// Deletes a linked variant along with the locations of its uniforms.
+static void forget_variant(parg_token tok, uint32_t mask)
+{
+    khiter_t iter =
+        kh_get(variantmap, _variant_registry, variant_key(tok, mask));
+    if (iter == kh_end(_variant_registry)) {
+        return;
+    }
+    GLuint program = kh_value(_variant_registry, iter);
+    glDeleteProgram(program);
+    kh_del(variantmap, _variant_registry, iter);
+    if (program == _current_program) {
+        _current_program = 0;
+        _current_program_token = 0;
+        _current_features = 0;
+    }
+    for (iter = kh_begin(_variant_unifs); iter != kh_end(_variant_unifs);
+        ++iter) {
+        if (kh_exist(_variant_unifs, iter) &&
+            kh_key(_variant_unifs, iter) >> 32 == program) {
+            kh_del(varunifmap, _variant_unifs, iter);
+        }
+    }
+}
+
+// Deletes a linked program along with its entries in the uniform registry.
+static void forget_program(parg_token key)
+{
+    if (!_program_registry) {
+        return;
+    }
+    khiter_t iter = kh_get(glmap, _program_registry, key);
+    if (iter == kh_end(_program_registry)) {
+        return;
+    }
+    GLuint program = kh_value(_program_registry, iter);
+    glDeleteProgram(program);
+    kh_del(glmap, _program_registry, iter);
+    if (program == _current_program) {
+        _current_program = 0;
+        _current_program_token = 0;
+    }
+    iter = kh_get(unifmap, _unif_lists, key);
+    if (iter != kh_end(_unif_lists)) {
+        tokenvec* keys = kh_value(_unif_lists, iter);
+        for (int u = 0; u < kv_size(*keys); u++) {
+            khiter_t uiter = kh_get(imap, _unif_registry, kv_A(*keys, u));
+            if (uiter != kh_end(_unif_registry)) {
+                kh_del(imap, _unif_registry, uiter);
+            }
+        }
+        kv_destroy(*keys);
+        free(keys);
+        kh_del(unifmap, _unif_lists, iter);
+    }
+}
+
+static void evict_variant(int index)
+{
+    shader_variant variant = kv_A(_variant_cache, index);
+    forget_variant(variant.program, variant.mask);
+    int nafter = kv_size(_variant_cache) - index - 1;
+    memmove(_variant_cache.a + index, _variant_cache.a + index + 1,
+        nafter * sizeof(shader_variant));
+    _variant_cache.n--;
+}
+
+// Moves the given variant to the back of the cache, evicting the
+// least-recently bound variant if the cache is full.
+static void touch_variant(parg_token program, uint32_t mask)
+{
+    for (int v = kv_size(_variant_cache) - 1; v >= 0; v--) {
+        shader_variant variant = kv_A(_variant_cache, v);
+        if (variant.program == program && variant.mask == mask) {
+            int nafter = kv_size(_variant_cache) - v - 1;
+            memmove(_variant_cache.a + v, _variant_cache.a + v + 1,
+                nafter * sizeof(shader_variant));
+            kv_last(_variant_cache) = variant;
+            return;
+        }
+    }
+    if (kv_size(_variant_cache) == MAX_SHADER_VARIANTS) {
+        evict_variant(0);
+    }
+    shader_variant variant = {program, mask};
+    kv_push(shader_variant, _variant_cache, variant);
+}
+
+uint32_t parg_shader_feature(parg_token program, parg_token feature, int value)
+{
+    shader_decl* decl = find_decl(program);
+    for (int f = 0; f < kv_size(decl->features); f++) {
+        shader_feature candidate = kv_A(decl->features, f);
+        if (candidate.token == feature) {
+            uint32_t fmask = (uint32_t)(((uint64_t) 1 << candidate.nbits) - 1);
+            return ((uint32_t) value & fmask) << candidate.shift;
+        }
+    }
+    parg_verify(0, "No such feature", parg_token_to_string(feature));
+    return 0;
+}
+
+// Each variant is keyed by its feature mask alongside the program token,
+// while the base program keeps the plain token.
+static GLuint find_variant(parg_token tok, uint32_t features)
+{
+    if (!_variant_registry) {
+        _variant_registry = kh_init(variantmap);
+        _variant_unifs = kh_init(varunifmap);
+    }
+    int ret;
+    khiter_t iter = kh_put(
+        variantmap, _variant_registry, variant_key(tok, features), &ret);
+    if (ret) {
+        GLuint program = compile_program(tok, features);
+        kh_value(_variant_registry, iter) = program;
+        gather_variant_uniforms(program);
+    }
+    touch_variant(tok, features);
+    return kh_value(_variant_registry, iter);
+}
+
+static GLuint find_program(parg_token tok)
 {
     if (!_program_registry) {
         _program_registry = kh_init(glmap);
     }
-    khiter_t iter = kh_get(glmap, _program_registry, tok);
-    GLuint program = 0;
     int ret;
-    if (iter == kh_end(_program_registry)) {
-        program = compile_program(tok);
-        iter = kh_put(glmap, _program_registry, tok, &ret);
+    khiter_t iter = kh_put(glmap, _program_registry, tok, &ret);
+    if (ret) {
+        GLuint program = compile_program(tok, 0);
         kh_value(_program_registry, iter) = program;
         gather_uniforms(tok, program);
-    } else {
-        program = kh_value(_program_registry, iter);
     }
+    return kh_value(_program_registry, iter);
+}
+
+void parg_shader_bind_variant(parg_token tok, uint32_t features)
+{
+    GLuint program =
+        features ? find_variant(tok, features) : find_program(tok);
     parg_verify(program, "No program", parg_token_to_string(tok));
     glUseProgram(program);
+    _parg_counters.program_binds++;
     _current_program = program;
     _current_program_token = tok;
+    _current_features = features;
 }
 
+void parg_shader_bind(parg_token tok) { parg_shader_bind_variant(tok, 0); }
+
 void parg_shader_free(parg_token tok)
 {
-    khiter_t iter = kh_get(glmap, _program_registry, tok);
-    if (iter != kh_end(_program_registry)) {
-        GLuint program = kh_value(_program_registry, iter);
-        glDeleteProgram(program);
-        kh_del(glmap, _program_registry, iter);
+    for (int v = kv_size(_variant_cache) - 1; v >= 0; v--) {
+        if (kv_A(_variant_cache, v).program == tok) {
+            evict_variant(v);
+        }
+    }
+    forget_program(tok);
+}
+
+static void free_library(shader_library* lib)
+{
+    for (khiter_t iter = kh_begin(lib->chunks); iter != kh_end(lib->chunks);
+        ++iter) {
+        if (!kh_exist(lib->chunks, iter)) {
+            continue;
+        }
+        shader_chunk* chunk = kh_value(lib->chunks, iter);
+        parg_token name = kh_key(lib->chunks, iter);
+        khiter_t global = kh_get(chunkmap, _chunk_registry, name);
+        if (global != kh_end(_chunk_registry) &&
+            kh_value(_chunk_registry, global) == chunk) {
+            kh_del(chunkmap, _chunk_registry, global);
+        }
+        kv_destroy(chunk->pieces);
+        free(chunk);
+    }
+    kh_destroy(chunkmap, lib->chunks);
+    sdsfree(lib->text);
+    free(lib);
+}
+
+// Re-parses a shader asset that has changed on disk.  Only the programs
+// declared by that asset are deleted; they get re-linked when next bound.
+int parg_shader_reload_asset(parg_token id)
+{
+    libraryvec stale;
+    kv_init(stale);
+    for (int i = kv_size(_libraries) - 1; i >= 0; i--) {
+        shader_library* lib = kv_A(_libraries, i);
+        if (lib->asset == id) {
+            kv_push(shader_library*, stale, lib);
+            memmove(_libraries.a + i, _libraries.a + i + 1,
+                (kv_size(_libraries) - i - 1) * sizeof(shader_library*));
+            _libraries.n--;
+        }
+    }
+    if (!kv_size(stale)) {
+        kv_destroy(stale);
+        return 0;
+    }
+    parg_shader_load_from_asset(id);
+
+    // Drop the linked programs for everything this asset declares, and forget
+    // declarations that no longer exist in the new version of the file.
+    tokenvec programs;
+    kv_init(programs);
+    for (khiter_t iter = kh_begin(_decl_registry);
+        iter != kh_end(_decl_registry); ++iter) {
+        if (!kh_exist(_decl_registry, iter)) {
+            continue;
+        }
+        parg_token program = kh_key(_decl_registry, iter);
+        shader_decl* decl = kh_value(_decl_registry, iter);
+        int removed = 0;
+        for (int i = 0; i < kv_size(stale) && !removed; i++) {
+            removed = decl->library == kv_A(stale, i);
+        }
+        if (removed || decl->library->asset == id) {
+            kv_push(parg_token, programs, program);
+        }
+        if (removed) {
+            free_decl(decl);
+            kh_del(declmap, _decl_registry, iter);
+        }
+    }
+    for (int p = 0; p < kv_size(programs); p++) {
+        parg_shader_free(kv_A(programs, p));
+    }
+    for (int i = 0; i < kv_size(stale); i++) {
+        free_library(kv_A(stale, i));
     }
+    kv_destroy(programs);
+    kv_destroy(stale);
+    return 1;
 }
@@ -0,0 +1,53 @@
+#include <parg.h>
+#include <parwin.h>
+#include "internal.h"
+
+// Wall-clock time beyond this is dropped instead of simulated, so a stall
+// does not trigger a long burst of catch-up steps.
+#define MAX_LAG 0.25
+
+static parg_window_fn_update _update = 0;
+static double _timestep = 0;
+static double _simtime = 0;
+static double _simclock = -1;
+static double _lag = 0;
+
+void parg_window_onupdate(parg_window_fn_update fn, float timestep)
+{
+    _update = fn;
+    _timestep = timestep;
+}
+
+float parg_window_alpha() { return _update ? _lag / _timestep : 0; }
+
+int parg_window_advance(double now)
+{
+    if (!_update) {
+        return 0;
+    }
+    if (_simclock < 0) {
+        _simclock = now;
+    }
+    _lag += PARG_MIN(now - _simclock, MAX_LAG);
+    _simclock = now;
+    int changed = 0;
+    while (_lag >= _timestep) {
+        changed = _update(_simtime, _timestep) || changed;
+        _simtime += _timestep;
+        _lag -= _timestep;
+    }
+    return changed;
+}
+
+void parg_window_simulate(float seconds)
+{
+    while (_update && _simtime < seconds) {
+        _update(_simtime, _timestep);
+        _simtime += _timestep;
+    }
+}
+
+double parg_window_wait(double timeout)
+{
+    return _update ? PARG_MIN(timeout, _timestep - _lag) : timeout;
+}
@@ -5,22 +5,26 @@ int _parg_depthtest = 0;
 
 void parg_state_clearcolor(Vector4 color)
 {
+    _parg_counters.state_changes++;
     glClearColor(color.x, color.y, color.z, color.w);
 }
 
 void parg_state_cullfaces(int enabled)
 {
+    _parg_counters.state_changes++;
     (enabled ? glEnable : glDisable)(GL_CULL_FACE);
 }
 
 void parg_state_depthtest(int enabled)
 {
+    _parg_counters.state_changes++;
     (enabled ? glEnable : glDisable)(GL_DEPTH_TEST);
     _parg_depthtest = enabled;
 }
 
 void parg_state_blending(int enabled)
 {
+    _parg_counters.state_changes++;
     if (enabled == 1) {
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     } else if (enabled == 2) {
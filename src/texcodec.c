@@ -0,0 +1,367 @@
+#include <parg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "internal.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// CPU-side block compression for RGBA8 images.  BC1 and BC3 use a bounding
+// box range fit, while ETC1 uses individual mode with an exhaustive search
+// over the modifier tables.
+
+static const int _etc1_modifiers[8][2] = {{2, 8}, {5, 17}, {9, 29},
+    {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+
+// Pixel indices for the two halves of an ETC1 block, for each flip bit.
+static const int _etc1_halves[4][8] = {{0, 1, 4, 5, 8, 9, 12, 13},
+    {2, 3, 6, 7, 10, 11, 14, 15}, {0, 1, 2, 3, 4, 5, 6, 7},
+    {8, 9, 10, 11, 12, 13, 14, 15}};
+
+int parg_texture_codec_nbytes(parg_texture_codec codec, int width, int height)
+{
+    int blocksize = codec == PARG_TEXTURE_BC3 ? 16 : 8;
+    return ((width + 3) / 4) * ((height + 3) / 4) * blocksize;
+}
+
+static void fetch_block(
+    uint8_t* dst, const uint8_t* src, int width, int height, int bx, int by)
+{
+    for (int y = 0; y < 4; y++) {
+        int sy = PARG_MIN(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++) {
+            int sx = PARG_MIN(bx * 4 + x, width - 1);
+            memcpy(dst, src + (sy * width + sx) * 4, 4);
+            dst += 4;
+        }
+    }
+}
+
+static void block_bounds(const uint8_t* block, uint8_t* lo, uint8_t* hi)
+{
+#ifdef __SSE2__
+    const __m128i* rows = (const __m128i*) block;
+    __m128i r0 = _mm_loadu_si128(rows + 0);
+    __m128i r1 = _mm_loadu_si128(rows + 1);
+    __m128i r2 = _mm_loadu_si128(rows + 2);
+    __m128i r3 = _mm_loadu_si128(rows + 3);
+    __m128i mn = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+    __m128i mx = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+    uint32_t a = _mm_cvtsi128_si32(mn);
+    uint32_t b = _mm_cvtsi128_si32(mx);
+    memcpy(lo, &a, 4);
+    memcpy(hi, &b, 4);
+#else
+    memcpy(lo, block, 4);
+    memcpy(hi, block, 4);
+    for (int i = 4; i < 64; i++) {
+        int c = i & 3;
+        lo[c] = PARG_MIN(lo[c], block[i]);
+        hi[c] = PARG_MAX(hi[c], block[i]);
+    }
+#endif
+}
+
+// Computes the dot product of each pixel's RGB with the given direction.
+static void block_dots(const uint8_t* block, const int* dir, int* dots)
+{
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i d = _mm_setr_epi16(
+        dir[0], dir[1], dir[2], 0, dir[0], dir[1], dir[2], 0);
+    for (int row = 0; row < 4; row++) {
+        __m128i px = _mm_loadu_si128((const __m128i*) block + row);
+        __m128 a = _mm_castsi128_ps(
+            _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), d));
+        __m128 b = _mm_castsi128_ps(
+            _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), d));
+        __m128i rg = _mm_castps_si128(
+            _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i bl = _mm_castps_si128(
+            _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_si128((__m128i*) dots + row, _mm_add_epi32(rg, bl));
+    }
+#else
+    for (int i = 0; i < 16; i++, block += 4) {
+        dots[i] = block[0] * dir[0] + block[1] * dir[1] + block[2] * dir[2];
+    }
+#endif
+}
+
+static uint16_t pack565(const int* c)
+{
+    int r = (c[0] * 31 + 127) / 255;
+    int g = (c[1] * 63 + 127) / 255;
+    int b = (c[2] * 31 + 127) / 255;
+    return (r << 11) | (g << 5) | b;
+}
+
+static void unpack565(uint16_t v, int* c)
+{
+    int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+static void encode_color(
+    const uint8_t* block, const uint8_t* lo, const uint8_t* hi, uint8_t* dst)
+{
+    // Choose the diagonal of the bounding box that follows the covariance
+    // of green and blue against red.
+    int cov[2] = {0, 0};
+    for (int i = 0; i < 16; i++) {
+        const uint8_t* p = block + i * 4;
+        int dr = 2 * p[0] - lo[0] - hi[0];
+        cov[0] += dr * (2 * p[1] - lo[1] - hi[1]);
+        cov[1] += dr * (2 * p[2] - lo[2] - hi[2]);
+    }
+    int c0[3], c1[3];
+    for (int c = 0; c < 3; c++) {
+        int inset = (hi[c] - lo[c]) >> 4;
+        c0[c] = hi[c] - inset;
+        c1[c] = lo[c] + inset;
+    }
+    if (cov[0] < 0) {
+        PARG_SWAP(int, c0[1], c1[1]);
+    }
+    if (cov[1] < 0) {
+        PARG_SWAP(int, c0[2], c1[2]);
+    }
+    uint16_t e0 = pack565(c0);
+    uint16_t e1 = pack565(c1);
+    uint32_t indices = 0;
+    if (e0 != e1) {
+
+        // Four-color mode requires the first endpoint to be larger.
+        if (e0 < e1) {
+            PARG_SWAP(uint16_t, e0, e1);
+        }
+        unpack565(e0, c0);
+        unpack565(e1, c1);
+        int dir[3] = {c0[0] - c1[0], c0[1] - c1[1], c0[2] - c1[2]};
+        int base = c1[0] * dir[0] + c1[1] * dir[1] + c1[2] * dir[2];
+        int dd = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+        int dots[16];
+        block_dots(block, dir, dots);
+        static const int remap[4] = {1, 3, 2, 0};
+        for (int i = 0; i < 16; i++) {
+            int t = 6 * (dots[i] - base);
+            int q = (t >= dd) + (t >= 3 * dd) + (t >= 5 * dd);
+            indices |= remap[q] << (2 * i);
+        }
+    }
+    dst[0] = e0 & 0xff;
+    dst[1] = e0 >> 8;
+    dst[2] = e1 & 0xff;
+    dst[3] = e1 >> 8;
+    for (int i = 0; i < 4; i++) {
+        dst[4 + i] = indices >> (8 * i);
+    }
+}
+
+static void encode_alpha(const uint8_t* block, int lo, int hi, uint8_t* dst)
+{
+    uint64_t indices = 0;
+    if (hi > lo) {
+        int range = hi - lo;
+        for (int i = 0; i < 16; i++) {
+            int q = ((block[i * 4 + 3] - lo) * 14 + range) / (2 * range);
+            uint64_t index = q == 7 ? 0 : (q == 0 ? 1 : 8 - q);
+            indices |= index << (3 * i);
+        }
+    }
+    dst[0] = hi;
+    dst[1] = lo;
+    for (int i = 0; i < 6; i++) {
+        dst[2 + i] = indices >> (8 * i);
+    }
+}
+
+// Encodes half of an ETC1 block, returning the squared error.
+static int etc1_half(const uint8_t* block, const int* pixels, int* base,
+    int* table, int* selectors)
+{
+    int sum[3] = {0, 0, 0};
+    for (int i = 0; i < 8; i++) {
+        for (int c = 0; c < 3; c++) {
+            sum[c] += block[pixels[i] * 4 + c];
+        }
+    }
+    int color[3];
+    for (int c = 0; c < 3; c++) {
+        base[c] = (sum[c] * 15 + 127 * 8) / (255 * 8);
+        color[c] = base[c] * 17;
+    }
+    int besterr = 0x7fffffff;
+    for (int t = 0; t < 8; t++) {
+        int mods[4] = {_etc1_modifiers[t][0], _etc1_modifiers[t][1],
+            -_etc1_modifiers[t][0], -_etc1_modifiers[t][1]};
+        int err = 0;
+        int sel[8];
+        for (int i = 0; i < 8 && err < besterr; i++) {
+            const uint8_t* p = block + pixels[i] * 4;
+            int pixerr = 0x7fffffff;
+            for (int m = 0; m < 4; m++) {
+                int e = 0;
+                for (int c = 0; c < 3; c++) {
+                    int v = PARG_CLAMP(color[c] + mods[m], 0, 255) - p[c];
+                    e += v * v;
+                }
+                if (e < pixerr) {
+                    pixerr = e;
+                    sel[i] = m;
+                }
+            }
+            err += pixerr;
+        }
+        if (err < besterr) {
+            besterr = err;
+            *table = t;
+            for (int i = 0; i < 8; i++) {
+                selectors[pixels[i]] = sel[i];
+            }
+        }
+    }
+    return besterr;
+}
+
+static void encode_etc1(const uint8_t* block, uint8_t* dst)
+{
+    int besterr = 0x7fffffff;
+    uint32_t hi32 = 0, lo32 = 0;
+    for (int flip = 0; flip < 2; flip++) {
+        int base[2][3], table[2], selectors[16];
+        int err = etc1_half(block, _etc1_halves[flip * 2], base[0], &table[0],
+            selectors);
+        err += etc1_half(block, _etc1_halves[flip * 2 + 1], base[1],
+            &table[1], selectors);
+        if (err >= besterr) {
+            continue;
+        }
+        besterr = err;
+        hi32 = (base[0][0] << 28) | (base[1][0] << 24) | (base[0][1] << 20) |
+            (base[1][1] << 16) | (base[0][2] << 12) | (base[1][2] << 8) |
+            (table[0] << 5) | (table[1] << 2) | flip;
+        lo32 = 0;
+
+        // Selectors are stored in column-major order, split into two planes.
+        for (int i = 0; i < 16; i++) {
+            int bit = (i & 3) * 4 + (i >> 2);
+            lo32 |= ((selectors[i] >> 1) << (16 + bit)) |
+                ((selectors[i] & 1) << bit);
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        dst[i] = hi32 >> (24 - 8 * i);
+        dst[4 + i] = lo32 >> (24 - 8 * i);
+    }
+}
+
+static void encode_level(const uint8_t* src, int width, int height,
+    parg_texture_codec codec, uint8_t* dst)
+{
+    uint8_t block[64];
+    uint8_t lo[4], hi[4];
+    for (int by = 0; by < (height + 3) / 4; by++) {
+        for (int bx = 0; bx < (width + 3) / 4; bx++) {
+            fetch_block(block, src, width, height, bx, by);
+            if (codec == PARG_TEXTURE_ETC1) {
+                encode_etc1(block, dst);
+                dst += 8;
+                continue;
+            }
+            block_bounds(block, lo, hi);
+            if (codec == PARG_TEXTURE_BC3) {
+                encode_alpha(block, lo[3], hi[3], dst);
+                dst += 8;
+            }
+            encode_color(block, lo, hi, dst);
+            dst += 8;
+        }
+    }
+}
+
+parg_buffer* parg_texture_encode(const void* rgba, int width, int height,
+    parg_texture_codec codec, parg_mipmap_filter filter, uint32_t hash)
+{
+    if (filter == PARG_MIPMAP_DRIVER) {
+        filter = PARG_MIPMAP_BOX;
+    }
+    int nlevels = 1;
+    int nbytes = PARG_TEXTURE_HEADER * sizeof(int);
+    for (int w = width, h = height;; nlevels++) {
+        nbytes += parg_texture_codec_nbytes(codec, w, h);
+        if (w == 1 && h == 1) {
+            break;
+        }
+        w = PARG_MAX(w / 2, 1);
+        h = PARG_MAX(h / 2, 1);
+    }
+    parg_buffer* buf = parg_buffer_alloc(nbytes, PARG_CPU);
+    int* header = parg_buffer_lock(buf, PARG_WRITE);
+    header[0] = width;
+    header[1] = height;
+    header[2] = codec;
+    header[3] = nlevels;
+    header[4] = hash;
+    uint8_t* dst = (uint8_t*) (header + PARG_TEXTURE_HEADER);
+    const uint8_t* level = rgba;
+    uint8_t* scratch = 0;
+    for (int i = 0, w = width, h = height; i < nlevels; i++) {
+        encode_level(level, w, h, codec, dst);
+        dst += parg_texture_codec_nbytes(codec, w, h);
+        if (i == nlevels - 1) {
+            break;
+        }
+        uint8_t* next = parg_mipmap_u8(level, w, h, 4, filter);
+        free(scratch);
+        level = scratch = next;
+        w = PARG_MAX(w / 2, 1);
+        h = PARG_MAX(h / 2, 1);
+    }
+    free(scratch);
+    parg_buffer_unlock(buf);
+    return buf;
+}
+
+uint32_t parg_texture_hash(const void* data, int nbytes)
+{
+    const uint8_t* bytes = data;
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < nbytes; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint16_t parg_texture_half(float value)
+{
+    union {
+        float f;
+        uint32_t u;
+    } bits = {value};
+    uint16_t sign = (bits.u >> 16) & 0x8000;
+    uint32_t mag = bits.u & 0x7fffffff;
+    if (mag > 0x7f800000) {
+        return sign | 0x7e00;
+    }
+    if (mag >= 0x477ff000) {
+        return sign | 0x7c00;
+    }
+    if (mag < 0x38800000) {
+        return sign | (uint16_t) lrintf(fabsf(value) * 16777216.0f);
+    }
+    uint32_t half = (mag - 0x38000000) >> 13;
+    uint32_t rem = mag & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return sign | half;
+}
@@ -3,80 +3,438 @@
 #include <string.h>
 #include "internal.h"
 #include "pargl.h"
-#include "lodepng.h"
+#include "kvec.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef GL_LUMINANCE_ALPHA
+#define GL_LUMINANCE_ALPHA 0x190A
+#endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_ETC1_RGB8_OES
+#define GL_ETC1_RGB8_OES 0x8D64
+#endif
+#if !EMSCRIPTEN
+#define GL_ALPHA16 0x803E
+#define GL_LUMINANCE16_ALPHA16 0x8048
+#define GL_ALPHA16F_ARB 0x881C
+#define GL_LUMINANCE_ALPHA16F_ARB 0x881F
+#endif
 
 struct parg_texture_s {
     int width;
     int height;
     GLuint handle;
+    parg_token asset;
+    int linear;
+    parg_texture_codec codec;
+    parg_mipmap_filter filter;
+    int nbytes;
 };
 
-parg_texture* parg_texture_from_asset(parg_token id)
+static parg_mipmap_filter _mipmap_filter = PARG_MIPMAP_DRIVER;
+
+static const char* _codec_suffixes[] = {"", "bc1", "bc3", "etc1"};
+
+// Textures that were created from assets, which can be reloaded in place.
+static kvec_t(parg_texture*) _asset_textures = {0, 0, 0};
+
+static GLenum format_from_ncomps(int ncomps)
 {
-    parg_texture* tex = malloc(sizeof(struct parg_texture_s));
-    int* rawdata;
-    parg_buffer* pngbuf = parg_buffer_slurp_asset(id, (void*) &rawdata);
+    static const GLenum formats[4] = {
+        GL_ALPHA, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA};
+    parg_assert(ncomps >= 1 && ncomps <= 4, "Unsupported component count");
+    return formats[ncomps - 1];
+}
+
+static void count_upload(int nbytes)
+{
+    _parg_counters.texture_uploads++;
+    _parg_counters.uploaded_bytes += nbytes;
+}
+
+// Records the GPU size of a texture whenever its levels are respecified.
+static void set_nbytes(parg_texture* tex, int nbytes)
+{
+    _parg_counters.texture_bytes += nbytes - tex->nbytes;
+    tex->nbytes = nbytes;
+}
+
+static int has_extension(const char* desktop, const char* webgl)
+{
+    const char* exts = (const char*) glGetString(GL_EXTENSIONS);
+    return exts && (strstr(exts, desktop) || strstr(exts, webgl));
+}
+
+// Returns zero if the platform cannot sample the given codec.
+static GLenum format_from_codec(parg_texture_codec codec)
+{
+    switch (codec) {
+    case PARG_TEXTURE_BC1:
+        return has_extension(
+                   "texture_compression_s3tc", "compressed_texture_s3tc")
+            ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+            : 0;
+    case PARG_TEXTURE_BC3:
+        return has_extension(
+                   "texture_compression_s3tc", "compressed_texture_s3tc")
+            ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+            : 0;
+    case PARG_TEXTURE_ETC1:
+        return has_extension("ETC1_RGB8_texture", "compressed_texture_etc1")
+            ? GL_ETC1_RGB8_OES
+            : 0;
+    default:
+        return 0;
+    }
+}
+
+static void set_filtering(parg_texture* tex)
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (tex->linear) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    } else {
+        glTexParameteri(
+            GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    }
+}
+
+// Encoded blocks are baked next to the executable, keyed by a hash of the
+// decoded image and the mipmap filter so that edited assets are re-encoded.
+static parg_buffer* encode_asset(parg_texture* tex, int* rawdata, uint32_t hash)
+{
+    hash ^= tex->filter * 2654435761u;
+    sds path = sdscatprintf(sdsdup(parg_asset_whereami()), "%s.%s",
+        parg_token_to_string(tex->asset), _codec_suffixes[tex->codec]);
+    parg_buffer* blocks = 0;
+#if !EMSCRIPTEN
+    if (parg_asset_fileexists(path)) {
+        blocks = parg_buffer_from_file(path);
+        int* header = parg_buffer_lock(blocks, PARG_READ);
+        int stale = header[2] != tex->codec || header[4] != (int) hash;
+        parg_buffer_unlock(blocks);
+        if (stale) {
+            parg_buffer_free(blocks);
+            blocks = 0;
+        }
+    }
+#endif
+    if (!blocks) {
+        blocks = parg_texture_encode(
+            rawdata + 3, rawdata[0], rawdata[1], tex->codec, tex->filter, hash);
+#if !EMSCRIPTEN
+        parg_buffer_to_file(blocks, path);
+#endif
+    }
+    sdsfree(path);
+    return blocks;
+}
+
+static void upload_compressed(parg_texture* tex, int* rawdata, uint32_t hash)
+{
+    parg_assert(rawdata[2] == 4, "Compressed textures require RGBA assets");
+    parg_buffer* blocks = encode_asset(tex, rawdata, hash);
+    int* header = parg_buffer_lock(blocks, PARG_READ);
+    GLenum format = format_from_codec(tex->codec);
+    int width = tex->width = header[0];
+    int height = tex->height = header[1];
+    int nlevels = tex->linear ? 1 : header[3];
+    char* data = (char*) (header + PARG_TEXTURE_HEADER);
+    glBindTexture(GL_TEXTURE_2D, tex->handle);
+    int total = 0;
+    for (int level = 0; level < nlevels; level++) {
+        int nbytes = parg_texture_codec_nbytes(tex->codec, width, height);
+        glCompressedTexImage2D(
+            GL_TEXTURE_2D, level, format, width, height, 0, nbytes, data);
+        count_upload(nbytes);
+        total += nbytes;
+        data += nbytes;
+        width = PARG_MAX(width / 2, 1);
+        height = PARG_MAX(height / 2, 1);
+    }
+    set_nbytes(tex, total);
+    set_filtering(tex);
+    parg_buffer_unlock(blocks);
+    parg_buffer_free(blocks);
+}
+
+// Uploads tightly packed pixels, then either asks the driver for mipmaps or
+// builds the chain on the CPU.  Half-float levels are filtered in fp32.
+// Returns the size of the chain on the GPU.
+static int upload_chain(parg_mipmap_filter filter, GLenum internal,
+    GLenum format, GLenum type, int width, int height, int ncomps,
+    const void* pixels)
+{
+    if (type == GL_UNSIGNED_SHORT) {
+        filter = PARG_MIPMAP_DRIVER;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const void* level = pixels;
+    void* scratch = 0;
+    int texelsize = ncomps * (type == GL_UNSIGNED_BYTE ? 1
+        : type == GL_FLOAT ? 4 : 2);
+    int total = 0;
+    for (int i = 0;; i++) {
+        uint16_t* halves = 0;
+        if (type == PARG_HALF_FLOAT) {
+            int count = width * height * ncomps;
+            const float* src = level;
+            halves = malloc(count * sizeof(uint16_t));
+            for (int j = 0; j < count; j++) {
+                halves[j] = parg_texture_half(src[j]);
+            }
+        }
+        glTexImage2D(GL_TEXTURE_2D, i, internal, width, height, 0, format,
+            type, halves ? (void*) halves : level);
+        free(halves);
+        count_upload(width * height * texelsize);
+        total += width * height * texelsize;
+        if (filter == PARG_MIPMAP_DRIVER) {
+            glGenerateMipmap(GL_TEXTURE_2D);
+            total += total / 3;
+            break;
+        }
+        if (width == 1 && height == 1) {
+            break;
+        }
+        void* next = type == GL_UNSIGNED_BYTE
+            ? parg_mipmap_u8(level, width, height, ncomps, filter)
+            : parg_mipmap_f32(level, width, height, ncomps, filter);
+        free(scratch);
+        level = scratch = next;
+        width = PARG_MAX(width / 2, 1);
+        height = PARG_MAX(height / 2, 1);
+    }
+    free(scratch);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return total;
+}
+
+// Kaiser chains of uncompressed assets are baked next to the executable
+// too, minus the top level, which is the asset itself.  The other filters
+// rebuild their chain faster than the image can be hashed to validate a
+// bake, so they are never cached.
+static int is_baked_chain(parg_texture* tex)
+{
+#if EMSCRIPTEN
+    return 0;
+#else
+    return tex->codec == PARG_TEXTURE_RAW && !tex->linear &&
+        tex->filter == PARG_MIPMAP_KAISER;
+#endif
+}
+
+static parg_buffer* bake_chain(parg_texture* tex, int* rawdata, uint32_t hash)
+{
+    hash ^= tex->filter * 2654435761u;
+    sds path = sdscatprintf(sdsdup(parg_asset_whereami()), "%s.mips",
+        parg_token_to_string(tex->asset));
+    int width = rawdata[0], height = rawdata[1];
+    parg_buffer* chain = 0;
+    if (parg_asset_fileexists(path)) {
+        chain = parg_buffer_from_file(path);
+        int* header = parg_buffer_lock(chain, PARG_READ);
+        int stale = header[0] != width || header[1] != height ||
+            header[4] != (int) hash;
+        parg_buffer_unlock(chain);
+        if (stale) {
+            parg_buffer_free(chain);
+            chain = 0;
+        }
+    }
+    if (!chain) {
+        int nlevels = 1;
+        int nbytes = PARG_TEXTURE_HEADER * sizeof(int);
+        for (int w = width, h = height; w > 1 || h > 1; nlevels++) {
+            w = PARG_MAX(w / 2, 1);
+            h = PARG_MAX(h / 2, 1);
+            nbytes += w * h * 4;
+        }
+        chain = parg_buffer_alloc(nbytes, PARG_CPU);
+        int* header = parg_buffer_lock(chain, PARG_WRITE);
+        header[0] = width;
+        header[1] = height;
+        header[2] = PARG_TEXTURE_RAW;
+        header[3] = nlevels;
+        header[4] = hash;
+        uint8_t* dst = (uint8_t*) (header + PARG_TEXTURE_HEADER);
+        const void* level = rawdata + 3;
+        for (int w = width, h = height; w > 1 || h > 1;) {
+            uint8_t* next = parg_mipmap_u8(level, w, h, 4, tex->filter);
+            w = PARG_MAX(w / 2, 1);
+            h = PARG_MAX(h / 2, 1);
+            memcpy(dst, next, w * h * 4);
+            free(next);
+            level = dst;
+            dst += w * h * 4;
+        }
+        parg_buffer_unlock(chain);
+        parg_buffer_to_file(chain, path);
+    }
+    sdsfree(path);
+    return chain;
+}
+
+// Uploads the asset as the top level and the baked chain below it.
+static int upload_baked_chain(parg_texture* tex, int* rawdata, uint32_t hash)
+{
+    parg_buffer* chain = bake_chain(tex, rawdata, hash);
+    int* header = parg_buffer_lock(chain, PARG_READ);
+    const uint8_t* level = (const uint8_t*) (rawdata + 3);
+    const uint8_t* next = (const uint8_t*) (header + PARG_TEXTURE_HEADER);
+    int width = header[0], height = header[1];
+    int total = 0;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; i < header[3]; i++) {
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, width, height, 0, GL_RGBA,
+            GL_UNSIGNED_BYTE, level);
+        count_upload(width * height * 4);
+        total += width * height * 4;
+        width = PARG_MAX(width / 2, 1);
+        height = PARG_MAX(height / 2, 1);
+        level = next;
+        next += width * height * 4;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    parg_buffer_unlock(chain);
+    parg_buffer_free(chain);
+    return total;
+}
+
+// Asset pixels are top-down.  Textures consume their asset, so the rows
+// are flipped in place, once, rather than copied or uploaded row by row.
+// The flag tracks the state of the shared asset across reloads.
+static void upload_asset(
+    parg_texture* tex, int* rawdata, uint32_t hash, int* flipped)
+{
+    if (!*flipped) {
+        parg_texture_fliprows(rawdata + 3, rawdata[0] * rawdata[2], rawdata[1]);
+        *flipped = 1;
+    }
+    if (tex->codec != PARG_TEXTURE_RAW) {
+        upload_compressed(tex, rawdata, hash);
+        return;
+    }
     tex->width = *rawdata++;
     tex->height = *rawdata++;
     int ncomps = *rawdata++;
     assert(ncomps == 4);
-    glGenTextures(1, &tex->handle);
     glBindTexture(GL_TEXTURE_2D, tex->handle);
-    parg_texture_fliprows(rawdata, tex->width * ncomps, tex->height);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->width, tex->height, 0, GL_RGBA,
-        GL_UNSIGNED_BYTE, rawdata);
+    int nbytes = tex->width * tex->height * 4;
+    if (tex->linear) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->width, tex->height, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, rawdata);
+        count_upload(nbytes);
+    } else if (is_baked_chain(tex)) {
+        nbytes = upload_baked_chain(tex, rawdata - 3, hash);
+    } else {
+        nbytes = upload_chain(tex->filter, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE,
+            tex->width, tex->height, 4, rawdata);
+    }
+    set_nbytes(tex, nbytes);
+    set_filtering(tex);
+}
+
+static int* slurp_asset(parg_token id, parg_buffer** pngbuf, uint32_t* hash)
+{
+    int* rawdata;
+    *pngbuf = parg_buffer_slurp_asset(id, (void*) &rawdata);
+    if (hash) {
+        *hash = parg_texture_hash(rawdata, parg_buffer_length(*pngbuf));
+    }
+    return rawdata;
+}
+
+static parg_texture* texture_from_asset(
+    parg_token id, int linear, parg_texture_codec codec)
+{
+    parg_texture* tex = calloc(sizeof(struct parg_texture_s), 1);
+    tex->asset = id;
+    tex->linear = linear;
+    tex->codec = format_from_codec(codec) ? codec : PARG_TEXTURE_RAW;
+    tex->filter = _mipmap_filter;
+    parg_buffer* pngbuf;
+    uint32_t hash = 0;
+    int flipped = 0;
+    int needhash = tex->codec || is_baked_chain(tex);
+    int* rawdata = slurp_asset(id, &pngbuf, needhash ? &hash : 0);
+    glGenTextures(1, &tex->handle);
+    _parg_counters.live_textures++;
+    upload_asset(tex, rawdata, hash, &flipped);
     parg_buffer_free(pngbuf);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(
-        GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    kv_push(parg_texture*, _asset_textures, tex);
     return tex;
 }
 
+parg_texture* parg_texture_from_asset(parg_token id)
+{
+    return texture_from_asset(id, 0, PARG_TEXTURE_RAW);
+}
+
+parg_texture* parg_texture_from_asset_compressed(
+    parg_token id, parg_texture_codec codec)
+{
+    return texture_from_asset(id, 0, codec);
+}
+
+int parg_texture_reload_asset(parg_token id)
+{
+    parg_buffer* pngbuf = 0;
+    int* rawdata = 0;
+    uint32_t hash = 0;
+    int flipped = 0;
+    int count = 0;
+    for (int i = 0; i < kv_size(_asset_textures); i++) {
+        parg_texture* tex = kv_A(_asset_textures, i);
+        if (tex->asset == id) {
+            if (!pngbuf) {
+                rawdata = slurp_asset(id, &pngbuf, &hash);
+            }
+            upload_asset(tex, rawdata, hash, &flipped);
+            count++;
+        }
+    }
+    parg_buffer_free(pngbuf);
+    return count;
+}
+
 parg_texture* parg_texture_from_buffer(parg_buffer* buf)
 {
     unsigned char* decoded;
     unsigned dims[3] = {0, 0, 4};
     unsigned char* filedata = parg_buffer_lock(buf, PARG_READ);
-    unsigned err = lodepng_decode_memory(&decoded, &dims[0], &dims[1], filedata,
-            parg_buffer_length(buf), LCT_RGBA, 8);
+    unsigned err = parg_png_decode(&decoded, &dims[0], &dims[1], filedata,
+            parg_buffer_length(buf), 1);
     parg_assert(err == 0, "PNG decoding error");
-    int nbytes = dims[0] * dims[1] * dims[2];
     assert(dims[2] == 4);
     parg_texture* tex = calloc(sizeof(struct parg_texture_s), 1);
     tex->width = dims[0];
     tex->height = dims[1];
     glGenTextures(1, &tex->handle);
     glBindTexture(GL_TEXTURE_2D, tex->handle);
-    parg_texture_fliprows(decoded, tex->width * 4, tex->height);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->width, tex->height, 0, GL_RGBA,
         GL_UNSIGNED_BYTE, decoded);
+    _parg_counters.live_textures++;
+    count_upload(tex->width * tex->height * 4);
+    set_nbytes(tex, tex->width * tex->height * 4);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    free(decoded);
     parg_buffer_unlock(buf);
     return tex;
 }
 
 parg_texture* parg_texture_from_asset_linear(parg_token id)
 {
-    parg_texture* tex = malloc(sizeof(struct parg_texture_s));
-    int* rawdata;
-    parg_buffer* pngbuf = parg_buffer_slurp_asset(id, (void*) &rawdata);
-    tex->width = *rawdata++;
-    tex->height = *rawdata++;
-    int ncomps = *rawdata++;
-    assert(ncomps == 4);
-    glGenTextures(1, &tex->handle);
-    glBindTexture(GL_TEXTURE_2D, tex->handle);
-    parg_texture_fliprows(rawdata, tex->width * ncomps, tex->height);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->width, tex->height, 0, GL_RGBA,
-        GL_UNSIGNED_BYTE, rawdata);
-    parg_buffer_free(pngbuf);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    return tex;
+    return texture_from_asset(id, 1, PARG_TEXTURE_RAW);
 }
 
 void parg_texture_bind(parg_texture* tex, int stage)
@@ -93,43 +451,121 @@ void parg_texture_info(parg_texture* tex, int* width, int* height)
 
 void parg_texture_free(parg_texture* tex)
 {
-    if (tex) {
-        glDeleteTextures(1, &tex->handle);
-        free(tex);
+    if (!tex) {
+        return;
     }
+    for (int i = 0; tex->asset && i < kv_size(_asset_textures); i++) {
+        if (kv_A(_asset_textures, i) == tex) {
+            kv_A(_asset_textures, i) = kv_pop(_asset_textures);
+            break;
+        }
+    }
+    glDeleteTextures(1, &tex->handle);
+    _parg_counters.live_textures--;
+    set_nbytes(tex, 0);
+    free(tex);
 }
 
 void parg_texture_fliprows(void* data, int rowsize, int nrows)
 {
-    char* tmp = malloc(rowsize);
     char* top = data;
-    char* bottom = top + rowsize * nrows;
-    for (int i = 0; i < nrows / 2; i++) {
-        bottom -= rowsize;
-        memcpy(tmp, top, rowsize);
-        memcpy(top, bottom, rowsize);
-        memcpy(bottom, tmp, rowsize);
-        top += rowsize;
+    char* bottom = top + rowsize * (nrows - 1);
+    for (; top < bottom; top += rowsize, bottom -= rowsize) {
+        int i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= rowsize; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*) (top + i));
+            __m128i b = _mm_loadu_si128((const __m128i*) (bottom + i));
+            _mm_storeu_si128((__m128i*) (top + i), b);
+            _mm_storeu_si128((__m128i*) (bottom + i), a);
+        }
+#endif
+        for (; i + 8 <= rowsize; i += 8) {
+            uint64_t a, b;
+            memcpy(&a, top + i, 8);
+            memcpy(&b, bottom + i, 8);
+            memcpy(top + i, &b, 8);
+            memcpy(bottom + i, &a, 8);
+        }
+        for (; i < rowsize; i++) {
+            PARG_SWAP(char, top[i], bottom[i]);
+        }
     }
-    free(tmp);
 }
 
-parg_texture* parg_texture_from_u8(
-    parg_buffer* buf, int width, int height, int ncomps, int byteoffset)
+static parg_texture* texture_from_pixels(int width, int height, int ncomps,
+    GLenum internal, GLenum format, GLenum type, const void* pixels)
 {
-    assert(ncomps == 4);
-    parg_texture* tex = malloc(sizeof(struct parg_texture_s));
+    parg_texture* tex = calloc(sizeof(struct parg_texture_s), 1);
     tex->width = width;
     tex->height = height;
-    char* rawdata = parg_buffer_lock(buf, PARG_READ);
+    tex->filter = _mipmap_filter;
     glGenTextures(1, &tex->handle);
     glBindTexture(GL_TEXTURE_2D, tex->handle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->width, tex->height, 0, GL_RGBA,
-        GL_UNSIGNED_BYTE, rawdata + byteoffset);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(
-        GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    _parg_counters.live_textures++;
+    set_nbytes(tex, upload_chain(tex->filter, internal, format, type, width,
+        height, ncomps, pixels));
+    set_filtering(tex);
+    return tex;
+}
+
+void parg_texture_mipmap_filter(parg_mipmap_filter filter)
+{
+    _mipmap_filter = filter;
+}
+
+parg_texture* parg_texture_from_u8(
+    parg_buffer* buf, int width, int height, int ncomps, int byteoffset)
+{
+    GLenum format = format_from_ncomps(ncomps);
+    char* rawdata = parg_buffer_lock(buf, PARG_READ);
+    parg_texture* tex = texture_from_pixels(width, height, ncomps, format,
+        format, GL_UNSIGNED_BYTE, rawdata + byteoffset);
+    parg_buffer_unlock(buf);
+    return tex;
+}
+
+parg_texture* parg_texture_from_u16(
+    parg_buffer* buf, int width, int height, int ncomps, int byteoffset)
+{
+    GLenum format = format_from_ncomps(ncomps);
+    char* rawdata = parg_buffer_lock(buf, PARG_READ);
+    uint16_t* src = (uint16_t*) (rawdata + byteoffset);
+#if EMSCRIPTEN
+
+    // WebGL 1.0 cannot upload 16-bit channels, so keep the high bytes.
+    int count = width * height * ncomps;
+    uint8_t* bytes = malloc(count);
+    for (int i = 0; i < count; i++) {
+        bytes[i] = src[i] >> 8;
+    }
+    parg_texture* tex = texture_from_pixels(
+        width, height, ncomps, format, format, GL_UNSIGNED_BYTE, bytes);
+    free(bytes);
+#else
+    static const GLenum internals[4] = {
+        GL_ALPHA16, GL_LUMINANCE16_ALPHA16, GL_RGB16, GL_RGBA16};
+    parg_texture* tex = texture_from_pixels(width, height, ncomps,
+        internals[ncomps - 1], format, GL_UNSIGNED_SHORT, src);
+#endif
+    parg_buffer_unlock(buf);
+    return tex;
+}
+
+parg_texture* parg_texture_from_fp16(
+    parg_buffer* buf, int width, int height, int ncomps, int byteoffset)
+{
+    GLenum format = format_from_ncomps(ncomps);
+    char* rawdata = parg_buffer_lock(buf, PARG_READ);
+#if EMSCRIPTEN
+    GLenum internal = format;
+#else
+    static const GLenum internals[4] = {GL_ALPHA16F_ARB,
+        GL_LUMINANCE_ALPHA16F_ARB, GL_RGB16F, GL_RGBA16F};
+    GLenum internal = internals[ncomps - 1];
+#endif
+    parg_texture* tex = texture_from_pixels(width, height, ncomps, internal,
+        format, PARG_HALF_FLOAT, rawdata + byteoffset);
     parg_buffer_unlock(buf);
     return tex;
 }
@@ -137,19 +573,10 @@ parg_texture* parg_texture_from_u8(
 parg_texture* parg_texture_from_fp32(
     parg_buffer* buf, int width, int height, int ncomps, int byteoffset)
 {
-    assert(ncomps == 1);
-    parg_texture* tex = malloc(sizeof(struct parg_texture_s));
-    tex->width = width;
-    tex->height = height;
+    GLenum format = format_from_ncomps(ncomps);
     char* rawdata = parg_buffer_lock(buf, PARG_READ);
-    glGenTextures(1, &tex->handle);
-    glBindTexture(GL_TEXTURE_2D, tex->handle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, tex->width, tex->height, 0,
-        GL_ALPHA, GL_FLOAT, rawdata + byteoffset);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(
-        GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    parg_texture* tex = texture_from_pixels(width, height, ncomps, format,
+        format, GL_FLOAT, rawdata + byteoffset);
     parg_buffer_unlock(buf);
     return tex;
 }
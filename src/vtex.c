@@ -0,0 +1,891 @@
+#include <parg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include "internal.h"
+#include "pargl.h"
+#include "kvec.h"
+#include "khash.h"
+
+#if !EMSCRIPTEN
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lodepng.h"
+#endif
+
+// A virtual texture is a fixed-size atlas of tiles plus an indirection
+// texture that acts as a page table for a window of tiles around the view.
+// The window lies at the level of the visible tiles and is large enough to
+// hold any set of tiles that fits in the atlas, so its size depends only on
+// the atlas.  Each indirection texel holds the atlas slot (red, green) and
+// level (blue) of the finest resident tile that covers it, so missing tiles
+// fall back to an ancestor.  Level zero is loaded up front and never
+// evicted.  When tiles arrive or leave, only their texels are rewritten;
+// the whole window is rebuilt only when it moves.
+//
+// Each tick rebuilds the request queue from scratch, so requests that have
+// not yet been picked up by a worker are cancelled once they leave the view.
+// Requests are ordered by screen-space error (how many levels coarser the
+// current fallback is) and by distance from the center of the view.  Tiles
+// in the predicted viewport are requested at a lower priority and may only
+// evict tiles that were not visible during the current tick.
+//
+// Virtual textures made from an asset bake their tiles next to the
+// executable, each level of the pyramid resampled into tiles and each tile
+// encoded as a PNG.  The bake starts with a header of {width, height,
+// tilesize, maxlevel, hash} and the file offset of every tile, coarsest
+// level first, and then the tiles.  Workers read and decode one tile at a
+// time, so only the offsets stay in memory, however large the map.
+
+#define MAX_LEVEL 13
+#define MAX_WORKERS 4
+#define MAX_UPLOADS_PER_TICK 8
+#define EMPTY_SLOT 0xffffffffu
+#define PREFETCH_PRIORITY 0.5f
+#define TILES_HEADER 5
+
+enum { PREFETCH = 1, VISIBLE = 2 };
+
+KHASH_MAP_INIT_INT(tilemap, int)
+
+typedef struct {
+    uint32_t key;
+    int lastused;
+} vtex_slot;
+
+typedef struct {
+    uint32_t key;
+    float priority;
+    int visible;
+} vtex_request;
+
+typedef struct {
+    uint32_t key;
+    parg_byte* rgba;
+} vtex_result;
+
+typedef struct {
+    parg_byte** levels;
+    int* widths;
+    int* heights;
+    int nlevels;
+    Vector2 mapsize;
+    int tilesize;
+} vtex_image;
+
+typedef struct {
+    int fd;
+    int* offsets;
+    int tilesize;
+} vtex_tiles;
+
+struct parg_vtex_s {
+    Vector2 mapsize;
+    int tilesize;
+    int maxlevel;
+    int nslots;
+    parg_vtex_loader loader;
+    void* userdata;
+    vtex_image* image;
+    vtex_tiles* tiles;
+    GLuint atlas;
+    GLuint indirection;
+    uint32_t* table;
+    uint32_t* staging;
+    int winsize;
+    int winlevel;
+    int winx;
+    int winy;
+    int rebuild;
+    kvec_t(uint32_t) dirty;
+    int frame;
+    vtex_slot* slots;
+    khash_t(tilemap)* resident;
+    khash_t(tilemap)* pending;
+    khash_t(tilemap)* failed;
+    kvec_t(uint32_t) queue;
+    kvec_t(vtex_request) requests;
+    kvec_t(vtex_result) results;
+#if !EMSCRIPTEN
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t workers[MAX_WORKERS];
+    int nworkers;
+    int quit;
+#endif
+};
+
+static uint32_t tile_key(parg_tilename tile)
+{
+    return (tile.z << 26) | (tile.y << 13) | tile.x;
+}
+
+static parg_tilename tile_from_key(uint32_t key)
+{
+    parg_tilename tile = {key & 0x1fff, (key >> 13) & 0x1fff, key >> 26};
+    return tile;
+}
+
+static void lock(parg_vtex* vt)
+{
+#if !EMSCRIPTEN
+    pthread_mutex_lock(&vt->lock);
+#endif
+}
+
+static void unlock(parg_vtex* vt)
+{
+#if !EMSCRIPTEN
+    pthread_mutex_unlock(&vt->lock);
+#endif
+}
+
+static vtex_result load_tile(parg_vtex* vt, uint32_t key)
+{
+    vtex_result result = {key, malloc(vt->tilesize * vt->tilesize * 4)};
+    if (!vt->loader(tile_from_key(key), result.rgba, vt->userdata)) {
+        free(result.rgba);
+        result.rgba = 0;
+    }
+    return result;
+}
+
+#if !EMSCRIPTEN
+static void* worker_main(void* arg)
+{
+    parg_vtex* vt = arg;
+    pthread_mutex_lock(&vt->lock);
+    while (!vt->quit) {
+        if (!kv_size(vt->queue)) {
+            pthread_cond_wait(&vt->wake, &vt->lock);
+            continue;
+        }
+
+        // The queue is sorted by ascending priority.
+        uint32_t key = kv_pop(vt->queue);
+        pthread_mutex_unlock(&vt->lock);
+        vtex_result result = load_tile(vt, key);
+        pthread_mutex_lock(&vt->lock);
+        kv_push(vtex_result, vt->results, result);
+    }
+    pthread_mutex_unlock(&vt->lock);
+    return 0;
+}
+#endif
+
+static void upload_tile(parg_vtex* vt, int slot, parg_byte* rgba)
+{
+    int ts = vt->tilesize;
+    glBindTexture(GL_TEXTURE_2D, vt->atlas);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % vt->nslots) * ts,
+        (slot / vt->nslots) * ts, ts, ts, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    _parg_counters.texture_uploads++;
+    _parg_counters.uploaded_bytes += ts * ts * 4;
+}
+
+static void make_resident(parg_vtex* vt, int slot, uint32_t key, int stamp)
+{
+    int ret;
+    if (vt->slots[slot].key != EMPTY_SLOT) {
+        khiter_t it = kh_get(tilemap, vt->resident, vt->slots[slot].key);
+        kh_del(tilemap, vt->resident, it);
+        kv_push(uint32_t, vt->dirty, vt->slots[slot].key);
+    }
+    vt->slots[slot].key = key;
+    vt->slots[slot].lastused = stamp;
+    khiter_t it = kh_put(tilemap, vt->resident, key, &ret);
+    kh_value(vt->resident, it) = slot;
+    kv_push(uint32_t, vt->dirty, key);
+}
+
+// Returns the least recently used slot whose stamp is older than the given
+// stamp, or -1 if every slot is in use.
+static int find_victim(parg_vtex* vt, int stamp)
+{
+    int victim = -1;
+    for (int i = 0; i < vt->nslots * vt->nslots; i++) {
+        vtex_slot* slot = vt->slots + i;
+        if (slot->lastused < stamp &&
+            (victim == -1 || slot->lastused < vt->slots[victim].lastused)) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+// Repaints a rectangle of the window, coarsest tiles first so that finer
+// tiles overwrite their ancestors, and uploads only that rectangle.
+static void update_indirection(parg_vtex* vt, int x0, int y0, int x1, int y1)
+{
+    int w = vt->winsize;
+    x0 = PARG_MAX(x0, 0);
+    y0 = PARG_MAX(y0, 0);
+    x1 = PARG_MIN(x1, w);
+    y1 = PARG_MIN(y1, w);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    int nslots = vt->nslots * vt->nslots;
+    for (int z = 0; z <= vt->winlevel; z++) {
+        int span = 1 << (vt->winlevel - z);
+        for (int i = 0; i < nslots; i++) {
+            uint32_t key = vt->slots[i].key;
+            if (key == EMPTY_SLOT || (int) (key >> 26) != z) {
+                continue;
+            }
+            parg_tilename tile = tile_from_key(key);
+            int tx0 = PARG_MAX(tile.x * span - vt->winx, x0);
+            int ty0 = PARG_MAX(tile.y * span - vt->winy, y0);
+            int tx1 = PARG_MIN((tile.x + 1) * span - vt->winx, x1);
+            int ty1 = PARG_MIN((tile.y + 1) * span - vt->winy, y1);
+            uint32_t texel = (i % vt->nslots) | ((i / vt->nslots) << 8) |
+                (z << 16) | 0xff000000u;
+            for (int y = ty0; y < ty1; y++) {
+                uint32_t* row = vt->table + y * w;
+                for (int x = tx0; x < tx1; x++) {
+                    row[x] = texel;
+                }
+            }
+        }
+    }
+    int width = x1 - x0, height = y1 - y0;
+    for (int y = 0; y < height; y++) {
+        memcpy(vt->staging + y * width, vt->table + (y0 + y) * w + x0,
+            width * sizeof(uint32_t));
+    }
+    glBindTexture(GL_TEXTURE_2D, vt->indirection);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, width, height, GL_RGBA,
+        GL_UNSIGNED_BYTE, vt->staging);
+    _parg_counters.texture_uploads++;
+    _parg_counters.uploaded_bytes += width * height * 4;
+}
+
+static void flush_indirection(parg_vtex* vt)
+{
+    if (vt->rebuild) {
+        update_indirection(vt, 0, 0, vt->winsize, vt->winsize);
+        vt->rebuild = 0;
+        vt->dirty.n = 0;
+    }
+    for (int i = 0; i < kv_size(vt->dirty); i++) {
+        parg_tilename tile = tile_from_key(kv_A(vt->dirty, i));
+        if (tile.z > vt->winlevel) {
+            continue;
+        }
+        int span = 1 << (vt->winlevel - tile.z);
+        update_indirection(vt, tile.x * span - vt->winx,
+            tile.y * span - vt->winy, (tile.x + 1) * span - vt->winx,
+            (tile.y + 1) * span - vt->winy);
+    }
+    vt->dirty.n = 0;
+}
+
+// Keeps the visible tiles inside the window.  The origin snaps to half the
+// window size so that panning only occasionally forces a rebuild.
+static void move_window(parg_vtex* vt, parg_tilerange visible)
+{
+    int half = vt->winsize / 2;
+    int z = visible.mintile.z;
+    int x = visible.mintile.x / half * half;
+    int y = visible.mintile.y / half * half;
+    if (z != vt->winlevel || x != vt->winx || y != vt->winy) {
+        vt->winlevel = z;
+        vt->winx = x;
+        vt->winy = y;
+        vt->rebuild = 1;
+    }
+}
+
+static void count_texture(int count, int size)
+{
+    _parg_counters.live_textures += count;
+    _parg_counters.texture_bytes += count * (int64_t) size * size * 4;
+}
+
+static GLuint create_texture(int size, GLenum filter)
+{
+    GLuint handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D, handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA,
+        GL_UNSIGNED_BYTE, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    count_texture(1, size);
+    return handle;
+}
+
+parg_vtex* parg_vtex_create(Vector2 mapsize, int tilesize, int maxlevel,
+    int nslots, parg_vtex_loader loader, void* userdata)
+{
+    parg_assert(maxlevel <= MAX_LEVEL, "Virtual texture is too deep");
+    parg_assert(nslots * nslots > 1, "Virtual texture atlas is too small");
+    parg_vtex* vt = calloc(sizeof(struct parg_vtex_s), 1);
+    vt->mapsize = mapsize;
+    vt->tilesize = tilesize;
+    vt->maxlevel = maxlevel;
+    vt->nslots = nslots;
+    vt->loader = loader;
+    vt->userdata = userdata;
+    vt->resident = kh_init(tilemap);
+    vt->pending = kh_init(tilemap);
+    vt->failed = kh_init(tilemap);
+    vt->slots = malloc(sizeof(vtex_slot) * nslots * nslots);
+    for (int i = 0; i < nslots * nslots; i++) {
+        vt->slots[i].key = EMPTY_SLOT;
+        vt->slots[i].lastused = -1;
+    }
+
+    // Fewer than nslots^2 tiles are ever visible, so a row of them always
+    // fits in half of the window.
+    vt->winsize = 2;
+    while (vt->winsize < 2 * nslots * nslots) {
+        vt->winsize *= 2;
+    }
+    int n = vt->winsize;
+    vt->table = calloc(n * n, sizeof(uint32_t));
+    vt->staging = malloc(n * n * sizeof(uint32_t));
+    vt->atlas = create_texture(nslots * tilesize, GL_LINEAR);
+    vt->indirection = create_texture(n, GL_NEAREST);
+    vt->rebuild = 1;
+
+    // Pin the root tile so that every texel always has a fallback.
+    parg_tilename root = {0, 0, 0};
+    vtex_result result = load_tile(vt, tile_key(root));
+    parg_assert(result.rgba, "Unable to load the root tile");
+    upload_tile(vt, 0, result.rgba);
+    make_resident(vt, 0, result.key, INT_MAX);
+    free(result.rgba);
+    flush_indirection(vt);
+
+#if !EMSCRIPTEN
+    pthread_mutex_init(&vt->lock, 0);
+    pthread_cond_init(&vt->wake, 0);
+    vt->nworkers = PARG_CLAMP(parg_parallel_threads() - 1, 1, MAX_WORKERS);
+    for (int i = 0; i < vt->nworkers; i++) {
+        pthread_create(&vt->workers[i], 0, worker_main, vt);
+    }
+#endif
+    return vt;
+}
+
+static int stamp(parg_vtex* vt, int visible)
+{
+    return vt->frame * 2 - (visible ? 0 : 1);
+}
+
+// Marks a resident tile and its resident ancestors as recently used, and
+// returns the level of the finest one.
+static int touch_tile(parg_vtex* vt, parg_tilename tile, int visible)
+{
+    int fallback = -1;
+    for (; tile.z >= 0; tile.z--, tile.x /= 2, tile.y /= 2) {
+        khiter_t it = kh_get(tilemap, vt->resident, tile_key(tile));
+        if (it != kh_end(vt->resident)) {
+            vtex_slot* slot = vt->slots + kh_value(vt->resident, it);
+            slot->lastused = PARG_MAX(slot->lastused, stamp(vt, visible));
+            fallback = PARG_MAX(fallback, tile.z);
+        }
+    }
+    return fallback;
+}
+
+static int count_tiles(parg_tilerange range)
+{
+    int nx = range.maxtile.x - range.mintile.x + 1;
+    int ny = range.maxtile.y - range.mintile.y + 1;
+    return PARG_MAX(nx, 0) * PARG_MAX(ny, 0);
+}
+
+// Picks the level whose texel density matches the framebuffer, coarsening
+// until the tiles fit in the atlas with room left for the pinned root.
+static void choose_tiles(parg_vtex* vt, parg_aar viewport, float fbwidth,
+    parg_tilerange* range)
+{
+    float extent = PARG_MAX(vt->mapsize.x, vt->mapsize.y);
+    float density = fbwidth * extent / parg_aar_width(viewport);
+    int z = ceilf(log2f(PARG_MAX(density / vt->tilesize, 1)));
+    z = PARG_MIN(z, vt->maxlevel);
+    for (;; z--) {
+        int ntiles = 1 << z;
+        float tilesize = extent / ntiles;
+        int x0 = PARG_MAX((viewport.left + extent * 0.5) / tilesize, 0);
+        int y0 = PARG_MAX((viewport.bottom + extent * 0.5) / tilesize, 0);
+        int x1 = (viewport.right + extent * 0.5) / tilesize;
+        int y1 = (viewport.top + extent * 0.5) / tilesize;
+        x1 = PARG_MIN(x1, ntiles - 1);
+        y1 = PARG_MIN(y1, ntiles - 1);
+        range->mintile = (parg_tilename){x0, y0, z};
+        range->maxtile = (parg_tilename){x1, y1, z};
+        if (z == 0 || count_tiles(*range) < vt->nslots * vt->nslots) {
+            break;
+        }
+    }
+}
+
+static void collect_requests(parg_vtex* vt, parg_tilerange range,
+    parg_aar viewport, int visible)
+{
+    Vector2 center = {(viewport.left + viewport.right) * 0.5,
+        (viewport.bottom + viewport.top) * 0.5};
+    float radius = 0.5 * (parg_aar_width(viewport) + parg_aar_height(viewport));
+    int z = range.mintile.z;
+    for (int y = range.mintile.y; y <= range.maxtile.y; y++) {
+        for (int x = range.mintile.x; x <= range.maxtile.x; x++) {
+            parg_tilename tile = {x, y, z};
+            int fallback = touch_tile(vt, tile, visible);
+            uint32_t key = tile_key(tile);
+            if (fallback == z ||
+                kh_get(tilemap, vt->failed, key) != kh_end(vt->failed)) {
+                continue;
+            }
+            int ret;
+            khiter_t it = kh_put(tilemap, vt->pending, key, &ret);
+            if (!ret) {
+                kh_value(vt->pending, it) |= visible;
+                continue;
+            }
+            kh_value(vt->pending, it) = visible;
+            parg_aar rect = parg_aar_from_tilename(tile, vt->mapsize);
+            float dx = (rect.left + rect.right) * 0.5 - center.x;
+            float dy = (rect.bottom + rect.top) * 0.5 - center.y;
+            float dist = sqrtf(dx * dx + dy * dy) / radius;
+            vtex_request request;
+            request.key = key;
+            request.priority = exp2f(z - fallback) / (1 + dist) *
+                (visible ? 1 : PREFETCH_PRIORITY);
+            request.visible = visible;
+            kv_push(vtex_request, vt->requests, request);
+        }
+    }
+}
+
+static int compare_requests(const void* a, const void* b)
+{
+    float pa = ((const vtex_request*) a)->priority;
+    float pb = ((const vtex_request*) b)->priority;
+    return (pa > pb) - (pa < pb);
+}
+
+int parg_vtex_tick(parg_vtex* vt, parg_aar viewport, parg_aar predicted,
+    float fbwidth)
+{
+    vt->frame++;
+    parg_tilerange visible, prefetch;
+    choose_tiles(vt, viewport, fbwidth, &visible);
+    choose_tiles(vt, predicted, fbwidth, &prefetch);
+    move_window(vt, visible);
+
+    lock(vt);
+
+    // Cancel everything that has not been picked up by a worker; tiles that
+    // are still wanted get re-queued below.
+    for (int i = 0; i < kv_size(vt->queue); i++) {
+        khiter_t it = kh_get(tilemap, vt->pending, kv_A(vt->queue, i));
+        kh_del(tilemap, vt->pending, it);
+    }
+    vt->queue.n = 0;
+    vt->requests.n = 0;
+    collect_requests(vt, visible, viewport, VISIBLE);
+    collect_requests(vt, prefetch, predicted, 0);
+    qsort(vt->requests.a, kv_size(vt->requests), sizeof(vtex_request),
+        compare_requests);
+
+    // Prefetch only as many tiles as there are slots left over after the
+    // visible tiles, so that prefetching cannot thrash the atlas.
+    int nspare = vt->nslots * vt->nslots - 1 - count_tiles(visible);
+    for (int i = kv_size(vt->requests) - 1; i >= 0; i--) {
+        vtex_request request = kv_A(vt->requests, i);
+        if (!request.visible && nspare-- <= 0) {
+            khiter_t it = kh_get(tilemap, vt->pending, request.key);
+            kh_del(tilemap, vt->pending, it);
+            kv_A(vt->requests, i).key = EMPTY_SLOT;
+        }
+    }
+    for (int i = 0; i < kv_size(vt->requests); i++) {
+        if (kv_A(vt->requests, i).key != EMPTY_SLOT) {
+            kv_push(uint32_t, vt->queue, kv_A(vt->requests, i).key);
+        }
+    }
+#if EMSCRIPTEN
+    for (int i = 0; i < MAX_WORKERS && kv_size(vt->queue); i++) {
+        kv_push(vtex_result, vt->results, load_tile(vt, kv_pop(vt->queue)));
+    }
+#else
+    pthread_cond_broadcast(&vt->wake);
+#endif
+
+    // Upload a bounded number of finished tiles; the rest wait for the
+    // next tick.
+    int nuploads = 0;
+    while (kv_size(vt->results) && nuploads < MAX_UPLOADS_PER_TICK) {
+        vtex_result result = kv_pop(vt->results);
+        khiter_t it = kh_get(tilemap, vt->pending, result.key);
+        int wanted = 0;
+        if (it != kh_end(vt->pending)) {
+            wanted = kh_value(vt->pending, it);
+            kh_del(tilemap, vt->pending, it);
+        }
+        if (!result.rgba) {
+            int ret;
+            kh_put(tilemap, vt->failed, result.key, &ret);
+            continue;
+        }
+        int slot = find_victim(vt, stamp(vt, wanted & VISIBLE));
+        if (slot >= 0) {
+            upload_tile(vt, slot, result.rgba);
+            make_resident(vt, slot, result.key, stamp(vt, wanted & VISIBLE));
+            nuploads++;
+        }
+        free(result.rgba);
+    }
+    unlock(vt);
+
+    flush_indirection(vt);
+    return nuploads > 0;
+}
+
+void parg_vtex_bind(parg_vtex* vt, int atlas_stage, int indirection_stage)
+{
+    glActiveTexture(GL_TEXTURE0 + atlas_stage);
+    glBindTexture(GL_TEXTURE_2D, vt->atlas);
+    glActiveTexture(GL_TEXTURE0 + indirection_stage);
+    glBindTexture(GL_TEXTURE_2D, vt->indirection);
+}
+
+void parg_vtex_info(
+    parg_vtex* vt, int* nslots, int* tilesize, Vector4* window)
+{
+    *nslots = vt->nslots;
+    *tilesize = vt->tilesize;
+    float ntiles = 1 << vt->winlevel;
+    window->x = vt->winx / ntiles;
+    window->y = vt->winy / ntiles;
+    window->z = window->w = ntiles / vt->winsize;
+}
+
+static void free_image(vtex_image* image)
+{
+    if (!image) {
+        return;
+    }
+    for (int i = 0; i < image->nlevels; i++) {
+        free(image->levels[i]);
+    }
+    free(image->levels);
+    free(image->widths);
+    free(image->heights);
+    free(image);
+}
+
+static void free_tiles(vtex_tiles* tiles)
+{
+#if !EMSCRIPTEN
+    if (!tiles) {
+        return;
+    }
+    close(tiles->fd);
+    free(tiles->offsets);
+    free(tiles);
+#endif
+}
+
+void parg_vtex_free(parg_vtex* vt)
+{
+    if (!vt) {
+        return;
+    }
+#if !EMSCRIPTEN
+    pthread_mutex_lock(&vt->lock);
+    vt->quit = 1;
+    pthread_cond_broadcast(&vt->wake);
+    pthread_mutex_unlock(&vt->lock);
+    for (int i = 0; i < vt->nworkers; i++) {
+        pthread_join(vt->workers[i], 0);
+    }
+    pthread_mutex_destroy(&vt->lock);
+    pthread_cond_destroy(&vt->wake);
+#endif
+    for (int i = 0; i < kv_size(vt->results); i++) {
+        free(kv_A(vt->results, i).rgba);
+    }
+    kv_destroy(vt->results);
+    kv_destroy(vt->queue);
+    kv_destroy(vt->requests);
+    kv_destroy(vt->dirty);
+    kh_destroy(tilemap, vt->resident);
+    kh_destroy(tilemap, vt->pending);
+    kh_destroy(tilemap, vt->failed);
+    glDeleteTextures(1, &vt->atlas);
+    glDeleteTextures(1, &vt->indirection);
+    count_texture(-1, vt->nslots * vt->tilesize);
+    count_texture(-1, vt->winsize);
+    free_image(vt->image);
+    free_tiles(vt->tiles);
+    free(vt->slots);
+    free(vt->table);
+    free(vt->staging);
+    free(vt);
+}
+
+static void sample_level(vtex_image* image, int level, float u, float v,
+    parg_byte* dst)
+{
+    int w = image->widths[level], h = image->heights[level];
+    const parg_byte* src = image->levels[level];
+    float x = u * w - 0.5f, y = v * h - 0.5f;
+    int x0 = floorf(x), y0 = floorf(y);
+    float fx = x - x0, fy = y - y0;
+    int x1 = PARG_CLAMP(x0 + 1, 0, w - 1), y1 = PARG_CLAMP(y0 + 1, 0, h - 1);
+    x0 = PARG_CLAMP(x0, 0, w - 1);
+    y0 = PARG_CLAMP(y0, 0, h - 1);
+    const parg_byte* a = src + (y0 * w + x0) * 4;
+    const parg_byte* b = src + (y0 * w + x1) * 4;
+    const parg_byte* c = src + (y1 * w + x0) * 4;
+    const parg_byte* d = src + (y1 * w + x1) * 4;
+    for (int i = 0; i < 4; i++) {
+        float top = a[i] + (b[i] - a[i]) * fx;
+        float bottom = c[i] + (d[i] - c[i]) * fx;
+        dst[i] = 0.5f + top + (bottom - top) * fy;
+    }
+}
+
+// Resamples a tile out of the image pyramid, choosing the level whose
+// pixels are closest in size to the tile's texels.
+static int image_loader(parg_tilename tile, parg_byte* rgba, void* userdata)
+{
+    vtex_image* image = userdata;
+    int ts = image->tilesize;
+    parg_aar rect = parg_aar_from_tilename(tile, image->mapsize);
+    Vector2 size = image->mapsize;
+    float du = parg_aar_width(rect) / size.x / ts;
+    float dv = parg_aar_height(rect) / size.y / ts;
+    float ratio = du * image->widths[0];
+    int level = ratio > 1 ? (int) log2f(ratio) : 0;
+    level = PARG_MIN(level, image->nlevels - 1);
+    for (int j = 0; j < ts; j++) {
+        float v = (rect.bottom + size.y * 0.5f) / size.y + (j + 0.5f) * dv;
+        for (int i = 0; i < ts; i++, rgba += 4) {
+            float u = (rect.left + size.x * 0.5f) / size.x + (i + 0.5f) * du;
+            if (u < 0 || u > 1 || v < 0 || v > 1) {
+                memset(rgba, 0, 4);
+            } else {
+                sample_level(image, level, u, v, rgba);
+            }
+        }
+    }
+    return 1;
+}
+
+// Builds the image pyramid from bottom-up RGBA, which is copied.
+static vtex_image* create_image(Vector2 mapsize, const parg_byte* rgba,
+    int width, int height, int tilesize)
+{
+    vtex_image* image = calloc(sizeof(vtex_image), 1);
+    image->mapsize = mapsize;
+    image->tilesize = tilesize;
+    int nlevels = 1;
+    while ((width >> (nlevels - 1)) > 1 || (height >> (nlevels - 1)) > 1) {
+        nlevels++;
+    }
+    image->nlevels = nlevels;
+    image->levels = malloc(sizeof(parg_byte*) * nlevels);
+    image->widths = malloc(sizeof(int) * nlevels);
+    image->heights = malloc(sizeof(int) * nlevels);
+    image->levels[0] = malloc(width * height * 4);
+    memcpy(image->levels[0], rgba, width * height * 4);
+    image->widths[0] = width;
+    image->heights[0] = height;
+    for (int i = 1; i < nlevels; i++) {
+        int w = image->widths[i - 1], h = image->heights[i - 1];
+        image->levels[i] =
+            parg_mipmap_u8(image->levels[i - 1], w, h, 4, PARG_MIPMAP_BOX);
+        image->widths[i] = PARG_MAX(w / 2, 1);
+        image->heights[i] = PARG_MAX(h / 2, 1);
+    }
+    return image;
+}
+
+static int image_maxlevel(int width, int height, int tilesize)
+{
+    int maxlevel = 0;
+    while (maxlevel < MAX_LEVEL &&
+        (tilesize << maxlevel) < PARG_MAX(width, height)) {
+        maxlevel++;
+    }
+    return maxlevel;
+}
+
+parg_vtex* parg_vtex_from_image(Vector2 mapsize, const parg_byte* rgba,
+    int width, int height, int tilesize)
+{
+    vtex_image* image = create_image(mapsize, rgba, width, height, tilesize);
+    int maxlevel = image_maxlevel(width, height, tilesize);
+    parg_vtex* vt =
+        parg_vtex_create(mapsize, tilesize, maxlevel, 8, image_loader, image);
+    vt->image = image;
+    return vt;
+}
+
+#if !EMSCRIPTEN
+
+// Tiles are numbered level by level, coarsest first, and row by row.
+static int tile_index(parg_tilename tile)
+{
+    return ((1 << (2 * tile.z)) - 1) / 3 + (tile.y << tile.z) + tile.x;
+}
+
+static parg_tilename tile_from_index(int index)
+{
+    int z = 0;
+    while (index >= 1 << (2 * z)) {
+        index -= 1 << (2 * z);
+        z++;
+    }
+    parg_tilename tile = {index & ((1 << z) - 1), index >> z, z};
+    return tile;
+}
+
+typedef struct {
+    vtex_image* image;
+    uint8_t** encoded;
+    size_t* sizes;
+} vtex_bake;
+
+static void encode_tiles(void* context, int begin, int end)
+{
+    vtex_bake* bake = context;
+    int ts = bake->image->tilesize;
+    parg_byte* rgba = malloc(ts * ts * 4);
+    for (int i = begin; i < end; i++) {
+        image_loader(tile_from_index(i), rgba, bake->image);
+        lodepng_encode32(&bake->encoded[i], &bake->sizes[i], rgba, ts, ts);
+    }
+    free(rgba);
+}
+
+// Writes every tile of every level, resampled from a top-down image.
+static void bake_tiles(const char* path, int* header, Vector2 mapsize,
+    const parg_byte* rgba)
+{
+    int width = header[0], height = header[1], tilesize = header[2];
+    parg_byte* flipped = malloc(width * height * 4);
+    memcpy(flipped, rgba, width * height * 4);
+    parg_texture_fliprows(flipped, width * 4, height);
+    vtex_bake bake = {0};
+    bake.image = create_image(mapsize, flipped, width, height, tilesize);
+    free(flipped);
+    int ntiles = tile_index((parg_tilename){0, 0, header[3] + 1});
+    bake.encoded = calloc(ntiles, sizeof(uint8_t*));
+    bake.sizes = calloc(ntiles, sizeof(size_t));
+    parg_parallel_for(ntiles, 1, encode_tiles, &bake);
+    free_image(bake.image);
+    int* offsets = malloc(sizeof(int) * (ntiles + 1));
+    offsets[0] = (TILES_HEADER + ntiles + 1) * sizeof(int);
+    for (int i = 0; i < ntiles; i++) {
+        offsets[i + 1] = offsets[i] + bake.sizes[i];
+    }
+    FILE* file = fopen(path, "wb");
+    parg_verify(file, "Unable to write tiles", path);
+    fwrite(header, sizeof(int), TILES_HEADER, file);
+    fwrite(offsets, sizeof(int), ntiles + 1, file);
+    for (int i = 0; i < ntiles; i++) {
+        fwrite(bake.encoded[i], 1, bake.sizes[i], file);
+        free(bake.encoded[i]);
+    }
+    fclose(file);
+    free(offsets);
+    free(bake.encoded);
+    free(bake.sizes);
+}
+
+// Opens a bake if it matches the given header, returning null otherwise.
+static vtex_tiles* open_tiles(const char* path, const int* header)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    int found[TILES_HEADER];
+    int size = sizeof(found);
+    if (pread(fd, found, size, 0) != size ||
+        memcmp(found, header, size)) {
+        close(fd);
+        return 0;
+    }
+    int ntiles = tile_index((parg_tilename){0, 0, header[3] + 1});
+    vtex_tiles* tiles = calloc(sizeof(vtex_tiles), 1);
+    tiles->fd = fd;
+    tiles->tilesize = header[2];
+    tiles->offsets = malloc(sizeof(int) * (ntiles + 1));
+    size = sizeof(int) * (ntiles + 1);
+    if (pread(fd, tiles->offsets, size, sizeof(found)) != size) {
+        free_tiles(tiles);
+        return 0;
+    }
+    return tiles;
+}
+
+static int tiles_loader(parg_tilename tile, parg_byte* rgba, void* userdata)
+{
+    vtex_tiles* tiles = userdata;
+    int index = tile_index(tile);
+    int offset = tiles->offsets[index];
+    int nbytes = tiles->offsets[index + 1] - offset;
+    uint8_t* png = malloc(nbytes);
+    parg_byte* decoded = 0;
+    unsigned width = 0, height = 0;
+    if (pread(tiles->fd, png, nbytes, offset) == nbytes) {
+        lodepng_decode32(&decoded, &width, &height, png, nbytes);
+    }
+    free(png);
+    int ts = tiles->tilesize;
+    int ok = decoded && width == ts && height == ts;
+    if (ok) {
+        memcpy(rgba, decoded, ts * ts * 4);
+    }
+    free(decoded);
+    return ok;
+}
+
+#endif
+
+parg_vtex* parg_vtex_from_asset(Vector2 mapsize, parg_token id, int tilesize)
+{
+    int* rawdata;
+    parg_buffer* buf = parg_buffer_slurp_asset(id, (void*) &rawdata);
+    int width = rawdata[0], height = rawdata[1];
+    parg_assert(rawdata[2] == 4, "Virtual textures must be RGBA");
+#if EMSCRIPTEN
+    parg_byte* flipped = malloc(width * height * 4);
+    memcpy(flipped, rawdata + 3, width * height * 4);
+    parg_texture_fliprows(flipped, width * 4, height);
+    parg_buffer_unlock(buf);
+    parg_vtex* vt =
+        parg_vtex_from_image(mapsize, flipped, width, height, tilesize);
+    free(flipped);
+    return vt;
+#else
+    int maxlevel = image_maxlevel(width, height, tilesize);
+    int header[TILES_HEADER] = {width, height, tilesize, maxlevel,
+        parg_texture_hash(rawdata + 3, width * height * 4)};
+    sds path = sdscatprintf(sdsdup(parg_asset_whereami()), "%s.tiles",
+        parg_token_to_string(id));
+    vtex_tiles* tiles = open_tiles(path, header);
+    if (!tiles) {
+        bake_tiles(path, header, mapsize, (const parg_byte*) (rawdata + 3));
+        tiles = open_tiles(path, header);
+        parg_verify(tiles, "Unable to read tiles", path);
+    }
+    parg_buffer_unlock(buf);
+    sdsfree(path);
+    parg_vtex* vt = parg_vtex_create(
+        mapsize, tilesize, maxlevel, 8, tiles_loader, tiles);
+    vt->tiles = tiles;
+    return vt;
+#endif
+}
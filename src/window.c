@@ -4,8 +4,17 @@
 #include <GLFW/glfw3.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
-#include "lodepng.h"
+#include <time.h>
+#include "internal.h"
+
+// While the tick reports nothing to draw, the loop sleeps until an event
+// arrives or this many seconds pass, whichever comes first.  The timeout
+// bounds the latency of work that finishes without an event, such as
+// background meshing.
+#define IDLE_TIMEOUT 0.1
+
+// Offscreen rendering advances the clock by this much per frame.
+#define OFFSCREEN_STEP (1.0 / 60.0)
 
 static int _argc = 0;
 static char** _argv = 0;
@@ -13,6 +22,11 @@ static float _touchpt[2] = {0};
 static float _pixscale = 1.0f;
 static int _winwidth = 0;
 static int _winheight = 0;
+static int _fbwidth = 0;
+static int _fbheight = 0;
+static float _maxfps = 0;
+static volatile int _redraw = 0;
+static GLFWwindow* _window = 0;
 static parg_window_fn_init _init = 0;
 static parg_window_fn_tick _tick = 0;
 static parg_window_fn_draw _draw = 0;
@@ -38,6 +52,16 @@ void parg_window_oninput(parg_window_fn_input fn) { _input = fn; }
 
 void parg_window_onmessage(parg_window_fn_message fn) { _message = fn; }
 
+void parg_window_request_redraw()
+{
+    _redraw = 1;
+    if (_window) {
+        glfwPostEmptyEvent();
+    }
+}
+
+void parg_window_set_maxfps(float fps) { _maxfps = fps; }
+
 static void onerror(int error, const char* description)
 {
     fputs(description, stderr);
@@ -84,8 +108,206 @@ static void onscroll(GLFWwindow* window, double dx, double dy)
     }
 }
 
+static void onresize(GLFWwindow* window, int width, int height)
+{
+    glfwGetFramebufferSize(window, &_fbwidth, &_fbheight);
+    glfwGetWindowSize(window, &_winwidth, &_winheight);
+    _pixscale = (float) _fbwidth / _winwidth;
+    _redraw = 1;
+}
+
+static void onrefresh(GLFWwindow* window) { _redraw = 1; }
+
+static void wait_events(double seconds)
+{
+#if GLFW_VERSION_MAJOR > 3 || GLFW_VERSION_MINOR >= 2
+    glfwWaitEventsTimeout(seconds);
+#else
+    struct timespec ts = {0, seconds * 1e9};
+    nanosleep(&ts, 0);
+    glfwPollEvents();
+#endif
+}
+
+static void print_counters()
+{
+    parg_counters c;
+    parg_counters_snapshot(&c);
+    printf("draws %d, triangles %d, binds %d, states %d, "
+        "uploads %d + %d (%lld KB), buffers %d (%lld KB), "
+        "textures %d (%lld KB), fbos %d (%lld KB)\n",
+        c.draws, c.triangles, c.program_binds, c.state_changes,
+        c.buffer_uploads, c.texture_uploads,
+        (long long) c.uploaded_bytes / 1024, c.live_buffers,
+        (long long) c.buffer_bytes / 1024, c.live_textures,
+        (long long) c.texture_bytes / 1024, c.live_framebuffers,
+        (long long) c.framebuffer_bytes / 1024);
+}
+
+// Counts the frame number conversions in a capture path, which is used as a
+// printf format.  Only "%d", optionally with a width of up to two digits
+// such as "%04d", and the "%%" escape are allowed; returns -1 for anything
+// else.
+static int capture_conversions(const char* capture)
+{
+    int count = 0;
+    for (const char* c = strchr(capture, '%'); c; c = strchr(c, '%')) {
+        if (c[1] == '%') {
+            c += 2;
+            continue;
+        }
+        size_t width = strspn(c + 1, "0123456789");
+        c += 1 + width;
+        if (width > 2 || *c++ != 'd') {
+            return -1;
+        }
+        count++;
+    }
+    return count;
+}
+
+// Renders frames into an FBO with simulated time advancing at a fixed
+// rate, and optionally captures them.  A capture path with a "%d" gets one
+// file per frame; otherwise only the last frame is saved.  Expects a
+// current context.
+static void render_offscreen(int width, int height, int nframes,
+    const char* capture, float simulate, int hud)
+{
+    _winwidth = _fbwidth = width;
+    _winheight = _fbheight = height;
+    _pixscale = 1;
+    if (_init) {
+        _init(width, height, 1);
+    }
+    parg_window_simulate(simulate);
+    parg_framebuffer* fbo = parg_framebuffer_create_empty(
+        width, height, PARG_FBO_DEPTH | PARG_FBO_ALPHA);
+    parg_framebuffer_pushfbo(fbo, 0);
+    parg_readback* readback =
+        capture ? parg_readback_create(width, height) : 0;
+    int sequence = capture && capture_conversions(capture) == 1;
+    for (int frame = 0; frame < nframes; frame++) {
+        double seconds = frame * OFFSCREEN_STEP;
+        parg_profile_frame_begin();
+        if (_tick) {
+            parg_profile_phase_begin(PARG_PHASE_TICK);
+            _tick(width, height, 1, seconds);
+            parg_profile_phase_end(PARG_PHASE_TICK);
+        }
+        parg_profile_phase_begin(PARG_PHASE_UPDATE);
+        parg_window_advance(seconds);
+        parg_profile_phase_end(PARG_PHASE_UPDATE);
+        parg_profile_phase_begin(PARG_PHASE_DRAW);
+        if (_draw) {
+            _draw();
+        }
+        if (glGetError() != GL_NO_ERROR) {
+            puts("OpenGL Error");
+        }
+        parg_profile_phase_end(PARG_PHASE_DRAW);
+        if (hud) {
+            parg_profile_draw_hud();
+        }
+        parg_counters_frame();
+        if (readback && (sequence || frame == nframes - 1)) {
+            sds path = sdscatprintf(sdsempty(), capture, frame);
+            parg_readback_push(readback, path);
+            sdsfree(path);
+        }
+        parg_profile_frame_end();
+    }
+    if (hud) {
+        print_counters();
+    }
+    parg_readback_free(readback);
+    parg_framebuffer_popfbo();
+    if (_dispose) {
+        _dispose();
+    }
+    parg_framebuffer_free(fbo);
+}
+
 int parg_window_exec(float winwidth, float winheight, int vsync, int aa)
 {
+    // Render offscreen and save the result as a PNG instead of showing a
+    // window.  The size and frame count default to the window size and 1.
+    char* capture = 0;
+    int width = winwidth, height = winheight;
+    int nframes = 0;
+    for (int i = 1; i < _argc - 1; i++) {
+        if (0 == strcmp(_argv[i], "-capture")) {
+            capture = _argv[i + 1];
+        } else if (0 == strcmp(_argv[i], "-size")) {
+            sscanf(_argv[i + 1], "%dx%d", &width, &height);
+        } else if (0 == strcmp(_argv[i], "-frames")) {
+            nframes = atoi(_argv[i + 1]);
+        }
+    }
+
+    // Render through an EGL or OSMesa context instead of a hidden window.
+    // The backend is "egl", "osmesa", or "auto".
+    char* headless = 0;
+    for (int i = 1; i < _argc - 1; i++) {
+        if (0 == strcmp(_argv[i], "-headless")) {
+            headless = _argv[i + 1];
+        }
+    }
+    int conversions = capture ? capture_conversions(capture) : 0;
+    if (conversions < 0 || conversions > 1) {
+        fputs("The capture path may hold one %d and no other "
+              "conversions; write a literal percent sign as %%.\n",
+            stderr);
+        exit(EXIT_FAILURE);
+    }
+    int offscreen = capture || headless || nframes > 0;
+    nframes = PARG_MAX(nframes, 1);
+
+    // Simulate this many seconds as fast as possible before the first frame.
+    float simulate = 0;
+    for (int i = 1; i < _argc - 1; i++) {
+        if (0 == strcmp(_argv[i], "-simulate")) {
+            simulate = atof(_argv[i + 1]);
+        }
+    }
+
+    // Reload shaders and textures when their files change on disk.
+    int watch = 0;
+    for (int i = 1; i < _argc; i++) {
+        watch = watch || 0 == strcmp(_argv[i], "-watch");
+    }
+
+    // Record frame timings and write them as a Chrome trace on exit.
+    char* profile = 0;
+    for (int i = 1; i < _argc - 1; i++) {
+        if (0 == strcmp(_argv[i], "-profile")) {
+            profile = _argv[i + 1];
+            parg_profile_enable(1);
+        }
+    }
+
+    // Overlay frame timings and print the counters once per second.
+    int hud = 0;
+    for (int i = 1; i < _argc; i++) {
+        hud = hud || 0 == strcmp(_argv[i], "-hud");
+    }
+    if (hud) {
+        parg_profile_enable(1);
+    }
+
+    if (headless) {
+        parg_headless* context = parg_headless_create(headless, width, height);
+        if (!context) {
+            fputs("Unable to create a headless context.\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        render_offscreen(width, height, nframes, capture, simulate, hud);
+        parg_headless_free(context);
+        if (profile) {
+            parg_profile_write_trace(profile);
+        }
+        return 0;
+    }
+
     GLFWwindow* window;
     glfwSetErrorCallback(onerror);
     if (!glfwInit()) {
@@ -101,6 +323,9 @@ int parg_window_exec(float winwidth, float winheight, int vsync, int aa)
     if (aa) {
         glfwWindowHint(GLFW_SAMPLES, 4);
     }
+    if (offscreen) {
+        glfwWindowHint(GLFW_VISIBLE, 0);
+    }
 
     // This removes borders which looks nice sometimes.
     glfwWindowHint(GLFW_DECORATED, GL_FALSE);
@@ -110,14 +335,6 @@ int parg_window_exec(float winwidth, float winheight, int vsync, int aa)
     glfwWindowHint(GLFW_ALPHA_MASK, GL_TRUE);
 #endif
 
-    char* capture = 0;
-    for (int i = 1; i < _argc - 1; i++) {
-        if (0 == strcmp(_argv[i], "-capture")) {
-            capture = _argv[i + 1];
-            glfwWindowHint(GLFW_VISIBLE, 0);
-        }
-    }
-
     // 1.85 is the "Letterbox" aspect ratio, popular in the film industry.
     // Also, the window is small enough to fit just fine on my 13" Pro.
 
@@ -127,69 +344,114 @@ int parg_window_exec(float winwidth, float winheight, int vsync, int aa)
         exit(EXIT_FAILURE);
     }
 
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    glfwGetWindowSize(window, &_winwidth, &_winheight);
-    _pixscale = (float) width / _winwidth;
+    if (offscreen) {
+        glfwMakeContextCurrent(window);
+        render_offscreen(width, height, nframes, capture, simulate, hud);
+        glfwMakeContextCurrent(0);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        if (profile) {
+            parg_profile_write_trace(profile);
+        }
+        return 0;
+    }
+
+    onresize(window, 0, 0);
     glfwMakeContextCurrent(window);
     glfwSwapInterval(vsync);
     if (_init) {
         _init(_winwidth, _winheight, _pixscale);
     }
+    if (watch) {
+        parg_asset_watch(1);
+    }
+    parg_window_simulate(simulate);
     glfwMakeContextCurrent(0);
     glfwSetKeyCallback(window, onkey);
     glfwSetCursorPosCallback(window, onmove);
     glfwSetMouseButtonCallback(window, onclick);
     glfwSetScrollCallback(window, onscroll);
+    glfwSetFramebufferSizeCallback(window, onresize);
+    glfwSetWindowSizeCallback(window, onresize);
+    glfwSetWindowRefreshCallback(window, onrefresh);
+    _window = window;
 
-    struct timeval tm1;
-    gettimeofday(&tm1, NULL);
-
+    double start = parg_profile_now();
+    double lastdraw = -1;
+    double lastprint = 0;
     while (!glfwWindowShouldClose(window)) {
-        int width, height;
-
-        // Get microseconds.
-        struct timeval tm2;
-        gettimeofday(&tm2, 0);
-        unsigned long long milliseconds = 1000 * (tm2.tv_sec - tm1.tv_sec) +
-            (tm2.tv_usec - tm1.tv_usec) / 1000;
-
-        // Check if the window has been resized.
-        glfwGetFramebufferSize(window, &width, &height);
-        glfwGetWindowSize(window, &_winwidth, &_winheight);
-        _pixscale = (float) width / _winwidth;
+        parg_profile_frame_begin();
+
         int needs_draw = 1;
         if (_tick) {
-            needs_draw =
-                _tick(_winwidth, _winheight, _pixscale, milliseconds / 1000.0);
+            parg_profile_phase_begin(PARG_PHASE_TICK);
+            needs_draw = _tick(_winwidth, _winheight, _pixscale,
+                parg_profile_now() - start);
+            parg_profile_phase_end(PARG_PHASE_TICK);
+        }
+        if (_redraw) {
+            _redraw = 0;
+            needs_draw = 1;
         }
 
         // Perform all OpenGL work.
         glfwMakeContextCurrent(window);
-        if (needs_draw && _draw) {
-            if (capture) {
-                parg_framebuffer_create_empty(
-                    width, height, PARG_FBO_DEPTH | PARG_FBO_ALPHA);
-            }
-            _draw();
-            GLenum err = glGetError();
-            if (err != GL_NO_ERROR) {
-                puts("OpenGL Error\n");
-            }
-            glfwSwapBuffers(window);
-            if (capture) {
-                unsigned char* buffer = malloc(width * height * 4);
-                glReadPixels(
-                    0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
-                parg_texture_fliprows(buffer, width * 4, height);
-                lodepng_encode32_file(capture, buffer, width, height);
-                free(buffer);
-                break;
+        if (parg_asset_poll()) {
+            needs_draw = 1;
+        }
+        parg_profile_phase_begin(PARG_PHASE_UPDATE);
+        if (parg_window_advance(glfwGetTime())) {
+            needs_draw = 1;
+        }
+        parg_profile_phase_end(PARG_PHASE_UPDATE);
+        if (!needs_draw || !_draw) {
+            glfwMakeContextCurrent(0);
+            double timeout = parg_window_wait(IDLE_TIMEOUT);
+            parg_profile_phase_begin(PARG_PHASE_EVENTS);
+            wait_events(timeout);
+            parg_profile_phase_end(PARG_PHASE_EVENTS);
+            parg_profile_frame_end();
+            continue;
+        }
+
+        // Sleeps out the rest of the frame when a maximum rate is set.
+        // Input that arrives meanwhile is still delivered.
+        if (_maxfps > 0 && lastdraw >= 0) {
+            double wakeup = lastdraw + 1.0 / _maxfps;
+            double now = glfwGetTime();
+            parg_profile_phase_begin(PARG_PHASE_EVENTS);
+            while (now < wakeup) {
+                wait_events(wakeup - now);
+                now = glfwGetTime();
             }
+            parg_profile_phase_end(PARG_PHASE_EVENTS);
+        }
+        lastdraw = glfwGetTime();
+        parg_profile_phase_begin(PARG_PHASE_DRAW);
+        _draw();
+        GLenum err = glGetError();
+        if (err != GL_NO_ERROR) {
+            puts("OpenGL Error\n");
+        }
+        parg_profile_phase_end(PARG_PHASE_DRAW);
+        if (hud) {
+            parg_profile_draw_hud();
+        }
+        parg_profile_phase_begin(PARG_PHASE_SWAP);
+        glfwSwapBuffers(window);
+        parg_profile_phase_end(PARG_PHASE_SWAP);
+        parg_counters_frame();
+        if (hud && lastdraw - lastprint >= 1) {
+            print_counters();
+            lastprint = lastdraw;
         }
         glfwMakeContextCurrent(0);
+        parg_profile_phase_begin(PARG_PHASE_EVENTS);
         glfwPollEvents();
+        parg_profile_phase_end(PARG_PHASE_EVENTS);
+        parg_profile_frame_end();
     }
+    _window = 0;
 
     // First perform OpenGL-related cleanup.
     glfwMakeContextCurrent(window);
@@ -203,6 +465,9 @@ int parg_window_exec(float winwidth, float winheight, int vsync, int aa)
     glfwMakeContextCurrent(0);
 
     // Perform all other cleanup.
+    if (profile) {
+        parg_profile_write_trace(profile);
+    }
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -1,157 +1,480 @@
 #include <parg.h>
+#include <stdlib.h>
 
-static DMatrix4 _projmat;
-static DPoint3 _camerapos;
-static DVector3 _worldsize;
-static double _maxcamz;
-static double _mincamz;
-static double _fovy;
-static double _winaspect = 0;
-static double _zplanes[2];
-static DPoint3 _grabpt;
-static int _grabbing = 0;
-static int _dirty = 1;
+// Parameters of the van Wijk and Nuij path between two views, where w is
+// the height of the viewport.  S is the length of the path.
+typedef struct {
+    DPoint3 from;
+    double dx, dy;
+    double w0;
+    double d1;
+    double r0;
+    double S;
+} zcam_path;
+
+struct parg_zcamera_s {
+    DMatrix4 projmat;
+    DPoint3 camerapos;
+    DVector3 worldsize;
+    double maxcamz;
+    double mincamz;
+    double fovy;
+    double tanhalf;
+    double winaspect;
+    double zplanes[2];
+    DPoint3 grabpt;
+    int grabbing;
+    int dirty;
+    DPoint3 prevpos;
+    double prevtime;
+    DVector3 velocity;
+    int zooming;
+    double zoomgoal;
+    float zoomanchor[2];
+    int coasting;
+    DVector3 inertia;
+    int flying;
+    double flytime;
+    double flyduration;
+    zcam_path path;
+};
+
+static parg_zcamera _default = {.dirty = 1, .prevtime = -1};
+
+// Motion is smoothed over roughly this many seconds.
+#define VELOCITY_SMOOTHING 0.1
+
+// Scroll zoom approaches its goal with this time constant, and released
+// pans coast to a stop with this one.
+#define ZOOM_SMOOTHING 0.08
+#define INERTIA_DECAY 0.25
+
+// Coasting stops below this speed, in viewport heights per second.
+#define INERTIA_MINSPEED 0.02
+
+// Trade-off between zooming and panning along flights; sqrt(2) is the value
+// van Wijk and Nuij found most natural.
+#define FLIGHT_RHO 1.41421356237
 
 #define MIN(a, b) (a > b ? b : a)
 #define MAX(a, b) (a > b ? a : b)
 #define CLAMP(v, lo, hi) MAX(lo, MIN(hi, v))
 
-static DPoint3 window_to_world(float winx, float winy)
+static double viewport_height(parg_zcamera* cam, double z)
+{
+    return 2 * cam->tanhalf * z;
+}
+
+static DPoint3 window_to_world(parg_zcamera* cam, float winx, float winy)
 {
     DPoint3 worldspace;
-    double vpheight = 2 * tan(_fovy / 2) * _camerapos.z;
-    double vpwidth = vpheight * _winaspect;
-    worldspace.y = _camerapos.y + vpheight * (winy - 0.5);
-    worldspace.x = _camerapos.x + vpwidth * (winx - 0.5);
+    double vpheight = viewport_height(cam, cam->camerapos.z);
+    double vpwidth = vpheight * cam->winaspect;
+    worldspace.y = cam->camerapos.y + vpheight * (winy - 0.5);
+    worldspace.x = cam->camerapos.x + vpwidth * (winx - 0.5);
     worldspace.z = 0;
     return worldspace;
 }
 
-void parg_zcam_get_viewport(float* lbrt)
+static zcam_path make_path(DPoint3 from, double w0, double x1, double y1,
+    double w1)
+{
+    const double rho = FLIGHT_RHO, rho2 = rho * rho, rho4 = rho2 * rho2;
+    zcam_path path = {from, x1 - from.x, y1 - from.y, w0};
+    double d2 = path.dx * path.dx + path.dy * path.dy;
+    path.d1 = sqrt(d2);
+    if (path.d1 < 1e-12 * w0) {
+        path.d1 = 0;
+        path.S = log(w1 / w0) / rho;
+        return path;
+    }
+    double b0 = (w1 * w1 - w0 * w0 + rho4 * d2) / (2 * w0 * rho2 * path.d1);
+    double b1 = (w1 * w1 - w0 * w0 - rho4 * d2) / (2 * w1 * rho2 * path.d1);
+    path.r0 = log(sqrt(b0 * b0 + 1) - b0);
+    double r1 = log(sqrt(b1 * b1 + 1) - b1);
+    path.S = (r1 - path.r0) / rho;
+    return path;
+}
+
+// Returns the center and viewport height at fraction t of the path.
+static DPoint3 eval_path(const zcam_path* path, double t)
+{
+    const double rho = FLIGHT_RHO;
+    double s = t * path->S;
+    if (path->d1 == 0) {
+        return (DPoint3){path->from.x + t * path->dx,
+            path->from.y + t * path->dy, path->w0 * exp(rho * s)};
+    }
+    double coshr0 = cosh(path->r0);
+    double u = path->w0 / (rho * rho * path->d1) *
+        (coshr0 * tanh(rho * s + path->r0) - sinh(path->r0));
+    return (DPoint3){path->from.x + u * path->dx, path->from.y + u * path->dy,
+        path->w0 * coshr0 / cosh(rho * s + path->r0)};
+}
+
+// Moves the camera to the given depth while keeping the world point under
+// the given window coordinate fixed.
+static void zoom_about(parg_zcamera* cam, double z, float winx, float winy)
+{
+    DPoint3 focalpt = window_to_world(cam, winx, winy);
+    DPoint3* pos = &cam->camerapos;
+    pos->z = CLAMP(z, cam->mincamz, cam->maxcamz);
+    double vpheight = viewport_height(cam, pos->z);
+    double vpwidth = vpheight * cam->winaspect;
+    pos->y = -vpheight * (winy - 0.5) + focalpt.y;
+    pos->x = -vpwidth * (winx - 0.5) + focalpt.x;
+}
+
+static void animate(parg_zcamera* cam, double dt)
+{
+    DPoint3* pos = &cam->camerapos;
+    if (cam->flying) {
+        cam->flytime += dt;
+        double t = MIN(1, cam->flytime / cam->flyduration);
+        double eased = t * t * (3 - 2 * t);
+        DPoint3 p = eval_path(&cam->path, eased);
+        *pos = (DPoint3){p.x, p.y, p.z / viewport_height(cam, 1)};
+        cam->flying = t < 1;
+        cam->dirty = 1;
+        return;
+    }
+    if (cam->zooming) {
+        double alpha = 1 - exp(-dt / ZOOM_SMOOTHING);
+        double logz = log(pos->z);
+        logz += (log(cam->zoomgoal) - logz) * alpha;
+        if (fabs(logz - log(cam->zoomgoal)) < 1e-4) {
+            logz = log(cam->zoomgoal);
+            cam->zooming = 0;
+        }
+        zoom_about(cam, exp(logz), cam->zoomanchor[0], cam->zoomanchor[1]);
+        cam->dirty = 1;
+    }
+    if (cam->coasting) {
+        pos->x += cam->inertia.x * dt;
+        pos->y += cam->inertia.y * dt;
+        double decay = exp(-dt / INERTIA_DECAY);
+        cam->inertia.x *= decay;
+        cam->inertia.y *= decay;
+        double speed = sqrt(cam->inertia.x * cam->inertia.x +
+            cam->inertia.y * cam->inertia.y);
+        cam->coasting = speed > INERTIA_MINSPEED * viewport_height(cam, pos->z);
+        cam->dirty = 1;
+    }
+}
+
+parg_zcamera* parg_zcamera_create(
+    float world_width, float world_height, float fovy)
+{
+    parg_zcamera* cam = calloc(sizeof(struct parg_zcamera_s), 1);
+    cam->dirty = 1;
+    cam->prevtime = -1;
+    parg_zcamera_init(cam, world_width, world_height, fovy);
+    return cam;
+}
+
+void parg_zcamera_free(parg_zcamera* cam)
 {
-    double vpheight = 2 * tan(_fovy / 2) * _camerapos.z;
-    double vpwidth = vpheight * _winaspect;
-    float left = _camerapos.x - vpwidth * 0.5;
-    float bottom = _camerapos.y - vpheight * 0.5;
-    float right = _camerapos.x + vpwidth * 0.5;
-    float top = _camerapos.y + vpheight * 0.5;
+    if (cam != &_default) {
+        free(cam);
+    }
+}
+
+parg_zcamera* parg_zcamera_default() { return &_default; }
+
+void parg_zcamera_get_viewport(parg_zcamera* cam, float* lbrt)
+{
+    double vpheight = viewport_height(cam, cam->camerapos.z);
+    double vpwidth = vpheight * cam->winaspect;
+    float left = cam->camerapos.x - vpwidth * 0.5;
+    float bottom = cam->camerapos.y - vpheight * 0.5;
+    float right = cam->camerapos.x + vpwidth * 0.5;
+    float top = cam->camerapos.y + vpheight * 0.5;
     *lbrt++ = left;
     *lbrt++ = bottom;
     *lbrt++ = right;
     *lbrt = top;
 }
 
-parg_aar parg_zcam_get_rectangle()
+parg_aar parg_zcamera_get_rectangle(parg_zcamera* cam)
 {
     parg_aar rect;
-    parg_zcam_get_viewport(&rect.left);
+    parg_zcamera_get_viewport(cam, &rect.left);
     return rect;
 }
 
-void parg_zcam_init(float worldwidth, float worldheight, float fovy)
+parg_aar parg_zcamera_get_predicted_rectangle(
+    parg_zcamera* cam, float seconds_ahead)
 {
-    _maxcamz = 0.5 * worldheight / tan(fovy * 0.5);
-    _camerapos = (DPoint3){0, 0, _maxcamz};
-    _mincamz = 0.0000001;
-    _zplanes[0] = _mincamz * 0.9;
-    _zplanes[1] = _maxcamz * 1.5;
-    _fovy = fovy;
-    _worldsize.x = worldwidth;
-    _worldsize.y = worldheight;
+    double z = cam->camerapos.z * exp(cam->velocity.z * seconds_ahead);
+    z = CLAMP(z, cam->mincamz, cam->maxcamz);
+    double x = cam->camerapos.x + cam->velocity.x * seconds_ahead;
+    double y = cam->camerapos.y + cam->velocity.y * seconds_ahead;
+    double vpheight = viewport_height(cam, z);
+    double vpwidth = vpheight * cam->winaspect;
+    parg_aar rect;
+    rect.left = x - vpwidth * 0.5;
+    rect.bottom = y - vpheight * 0.5;
+    rect.right = x + vpwidth * 0.5;
+    rect.top = y + vpheight * 0.5;
+    return rect;
 }
 
-void parg_zcam_tick(float winaspect, float seconds)
+void parg_zcamera_init(
+    parg_zcamera* cam, float worldwidth, float worldheight, float fovy)
 {
-    if (_winaspect != winaspect) {
-        _winaspect = winaspect;
-        double* z = _zplanes;
-        _projmat = DM4MakePerspective(_fovy, _winaspect, z[0], z[1]);
+    cam->tanhalf = tan(fovy * 0.5);
+    cam->maxcamz = 0.5 * worldheight / cam->tanhalf;
+    cam->camerapos = (DPoint3){0, 0, cam->maxcamz};
+    cam->mincamz = 0.0000001;
+    cam->zplanes[0] = cam->mincamz * 0.9;
+    cam->zplanes[1] = cam->maxcamz * 1.5;
+    cam->fovy = fovy;
+    cam->worldsize.x = worldwidth;
+    cam->worldsize.y = worldheight;
+}
+
+void parg_zcamera_tick(parg_zcamera* cam, float winaspect, float seconds)
+{
+    if (cam->winaspect != winaspect) {
+        cam->winaspect = winaspect;
+        double* z = cam->zplanes;
+        cam->projmat = DM4MakePerspective(cam->fovy, winaspect, z[0], z[1]);
+    }
+
+    double dt = seconds - cam->prevtime;
+    if (cam->prevtime >= 0 && dt > 0) {
+        animate(cam, dt);
+    }
+
+    // Track pan velocity in world units per second, and zoom rate as the
+    // derivative of log(z).
+    DPoint3 pos = cam->camerapos;
+    if (cam->prevtime >= 0 && dt > 0) {
+        DVector3 v;
+        v.x = (pos.x - cam->prevpos.x) / dt;
+        v.y = (pos.y - cam->prevpos.y) / dt;
+        v.z = log(pos.z / cam->prevpos.z) / dt;
+        double alpha = MIN(1, dt / VELOCITY_SMOOTHING);
+        cam->velocity = DV3Lerp(alpha, cam->velocity, v);
     }
+    cam->prevpos = pos;
+    cam->prevtime = seconds;
 }
 
-float parg_zcam_get_magnification()
+float parg_zcamera_get_magnification(parg_zcamera* cam)
 {
-    double vpheight = 2 * tan(_fovy / 2) * _camerapos.z;
-    return _worldsize.y / vpheight;
+    return cam->worldsize.y / viewport_height(cam, cam->camerapos.z);
 }
 
-void parg_zcam_grab_begin(float winx, float winy)
+void parg_zcamera_grab_begin(parg_zcamera* cam, float winx, float winy)
 {
-    _grabbing = 1;
-    _grabpt = window_to_world(winx, winy);
+    cam->grabbing = 1;
+    cam->coasting = 0;
+    cam->flying = 0;
+    cam->grabpt = window_to_world(cam, winx, winy);
 }
 
-void parg_zcam_grab_update(float winx, float winy, float scrolldelta)
+void parg_zcamera_grab_update(
+    parg_zcamera* cam, float winx, float winy, float scrolldelta)
 {
-    if (_grabbing) {
-        double vpheight = 2 * tan(_fovy / 2) * _camerapos.z;
-        double vpwidth = vpheight * _winaspect;
-        _camerapos.y = -vpheight * (winy - 0.5) + _grabpt.y;
-        _camerapos.x = -vpwidth * (winx - 0.5) + _grabpt.x;
+    DPoint3* pos = &cam->camerapos;
+    if (cam->grabbing) {
+        double vpheight = viewport_height(cam, pos->z);
+        double vpwidth = vpheight * cam->winaspect;
+        pos->y = -vpheight * (winy - 0.5) + cam->grabpt.y;
+        pos->x = -vpwidth * (winx - 0.5) + cam->grabpt.x;
+    } else if (scrolldelta && cam->prevtime < 0) {
+        zoom_about(cam, pos->z * (1 - scrolldelta * 0.01), winx, winy);
     } else if (scrolldelta) {
-        DPoint3 focalpt = window_to_world(winx, winy);
-        _camerapos.z -= scrolldelta * _camerapos.z * 0.01;
-        _camerapos.z = CLAMP(_camerapos.z, _mincamz, _maxcamz);
-        double vpheight = 2 * tan(_fovy / 2) * _camerapos.z;
-        double vpwidth = vpheight * _winaspect;
-        _camerapos.y = -vpheight * (winy - 0.5) + focalpt.y;
-        _camerapos.x = -vpwidth * (winx - 0.5) + focalpt.x;
+        // Scrolling moves the goal, which the tick then eases towards.
+        double z = cam->zooming ? cam->zoomgoal : pos->z;
+        z -= scrolldelta * z * 0.01;
+        cam->zoomgoal = CLAMP(z, cam->mincamz, cam->maxcamz);
+        cam->zoomanchor[0] = winx;
+        cam->zoomanchor[1] = winy;
+        cam->zooming = 1;
+        cam->flying = 0;
     }
-    _dirty = 1;
+    cam->dirty = 1;
 }
 
-void parg_zcam_set_position(double x, double y, double z)
+void parg_zcamera_set_position(parg_zcamera* cam, double x, double y, double z)
 {
-    _camerapos.x = x;
-    _camerapos.y = y;
-    _camerapos.z = z;
-    _dirty = 1;
-    _grabbing = 0;
+    cam->camerapos.x = x;
+    cam->camerapos.y = y;
+    cam->camerapos.z = z;
+    cam->dirty = 1;
+    cam->grabbing = 0;
+    cam->prevtime = -1;
+    cam->velocity = (DVector3){0, 0, 0};
+    cam->zooming = cam->coasting = cam->flying = 0;
 }
 
-void parg_zcam_grab_end() { _grabbing = 0; }
+void parg_zcamera_grab_end(parg_zcamera* cam)
+{
+    if (cam->grabbing) {
+        cam->inertia = (DVector3){cam->velocity.x, cam->velocity.y, 0};
+        cam->coasting = 1;
+    }
+    cam->grabbing = 0;
+}
 
-DPoint3 parg_zcam_dmatrices(DMatrix4* proj, DMatrix4* view)
+void parg_zcamera_fly_to(parg_zcamera* cam, parg_aar rect, float duration)
 {
-    *proj = _projmat;
-    DPoint3 target = {_camerapos.x, _camerapos.y, 0};
-    DVector3 up = {0, 1, 0};
-    *view = DM4MakeLookAt(_camerapos, target, up);
-    return _camerapos;
+    double height = rect.top - rect.bottom;
+    if (cam->winaspect > 0) {
+        height = MAX(height, (rect.right - rect.left) / cam->winaspect);
+    }
+    double z = height / viewport_height(cam, 1);
+    z = CLAMP(z, cam->mincamz, cam->maxcamz);
+    double w0 = viewport_height(cam, cam->camerapos.z);
+    double w1 = viewport_height(cam, z);
+    double x1 = 0.5 * (rect.left + rect.right);
+    double y1 = 0.5 * (rect.bottom + rect.top);
+    cam->path = make_path(cam->camerapos, w0, x1, y1, w1);
+    cam->flytime = 0;
+    cam->flyduration = MAX(duration, 1e-3);
+    cam->flying = 1;
+    cam->grabbing = cam->zooming = cam->coasting = 0;
+    cam->dirty = 1;
 }
 
-Point3 parg_zcam_matrices(Matrix4* proj, Matrix4* view)
+int parg_zcamera_is_settled(parg_zcamera* cam)
 {
-    *proj = M4MakeFromDM4(_projmat);
-    DPoint3 target = {_camerapos.x, _camerapos.y, 0};
+    return !cam->flying && !cam->zooming && !cam->coasting;
+}
+
+DPoint3 parg_zcamera_dmatrices(
+    parg_zcamera* cam, DMatrix4* proj, DMatrix4* view)
+{
+    DPoint3 pos = cam->camerapos;
+    *proj = cam->projmat;
+    DPoint3 target = {pos.x, pos.y, 0};
     DVector3 up = {0, 1, 0};
-    *view = M4MakeFromDM4(DM4MakeLookAt(_camerapos, target, up));
-    return (Point3){_camerapos.x, _camerapos.y, _camerapos.z};
+    *view = DM4MakeLookAt(pos, target, up);
+    return pos;
 }
 
-void parg_zcam_highprec(Matrix4* vp, Point3* eyepos_lo, Point3* eyepos_hi)
+Point3 parg_zcamera_matrices(parg_zcamera* cam, Matrix4* proj, Matrix4* view)
 {
-    DPoint3 origin = {0, 0, 0};
-    DPoint3 target = {0, 0, -1};
+    DPoint3 pos = cam->camerapos;
+    *proj = M4MakeFromDM4(cam->projmat);
+    DPoint3 target = {pos.x, pos.y, 0};
     DVector3 up = {0, 1, 0};
-    DMatrix4 view = DM4MakeLookAt(origin, target, up);
+    *view = M4MakeFromDM4(DM4MakeLookAt(pos, target, up));
+    return (Point3){pos.x, pos.y, pos.z};
+}
+
+Matrix4 parg_zcamera_rte_mvp(
+    parg_zcamera* cam, DPoint3 origin, DMatrix4 model)
+{
+    // With the eye at the origin looking down -Z, the view matrix is just
+    // the translation to the geometry's origin.
+    DVector3 offset = DP3Sub(origin, cam->camerapos);
+    DMatrix4 view = DM4MakeTranslation(offset);
+    return M4MakeFromDM4Mul3(cam->projmat, view, model);
+}
+
+void parg_zcamera_highprec(
+    parg_zcamera* cam, Matrix4* vp, Point3* eyepos_lo, Point3* eyepos_hi)
+{
     if (vp) {
-        *vp = M4MakeFromDM4(DM4Mul(_projmat, view));
+        *vp = M4MakeFromDM4(cam->projmat);
     }
-    Point3 eyepos = P3MakeFromDP3(_camerapos);
+    Point3 eyepos = P3MakeFromDP3(cam->camerapos);
     DPoint3 deyepos = DP3MakeFromP3(eyepos);
-    DVector3 difference = DP3Sub(_camerapos, deyepos);
+    DVector3 difference = DP3Sub(cam->camerapos, deyepos);
     if (eyepos_lo) {
         *eyepos_lo = P3MakeFromV3(V3MakeFromDV3(difference));
     }
     *eyepos_hi = eyepos;
 }
 
-int parg_zcam_has_moved()
+int parg_zcamera_has_moved(parg_zcamera* cam)
 {
-    int retval = _dirty;
-    _dirty = 0;
+    int retval = cam->dirty;
+    cam->dirty = 0;
     return retval;
 }
 
-void parg_zcam_touch() { _dirty = 1; }
+void parg_zcamera_touch(parg_zcamera* cam) { cam->dirty = 1; }
+
+// The parg_zcam functions operate on the default camera.
+
+void parg_zcam_init(float worldwidth, float worldheight, float fovy)
+{
+    parg_zcamera_init(&_default, worldwidth, worldheight, fovy);
+}
+
+void parg_zcam_tick(float winaspect, float seconds)
+{
+    parg_zcamera_tick(&_default, winaspect, seconds);
+}
+
+float parg_zcam_get_magnification()
+{
+    return parg_zcamera_get_magnification(&_default);
+}
+
+void parg_zcam_get_viewport(float* lbrt)
+{
+    parg_zcamera_get_viewport(&_default, lbrt);
+}
+
+parg_aar parg_zcam_get_rectangle()
+{
+    return parg_zcamera_get_rectangle(&_default);
+}
+
+parg_aar parg_zcam_get_predicted_rectangle(float seconds_ahead)
+{
+    return parg_zcamera_get_predicted_rectangle(&_default, seconds_ahead);
+}
+
+void parg_zcam_grab_begin(float winx, float winy)
+{
+    parg_zcamera_grab_begin(&_default, winx, winy);
+}
+
+void parg_zcam_grab_update(float winx, float winy, float scrolldelta)
+{
+    parg_zcamera_grab_update(&_default, winx, winy, scrolldelta);
+}
+
+void parg_zcam_grab_end() { parg_zcamera_grab_end(&_default); }
+
+void parg_zcam_fly_to(parg_aar rect, float duration)
+{
+    parg_zcamera_fly_to(&_default, rect, duration);
+}
+
+int parg_zcam_is_settled() { return parg_zcamera_is_settled(&_default); }
+
+Point3 parg_zcam_matrices(Matrix4* proj, Matrix4* view)
+{
+    return parg_zcamera_matrices(&_default, proj, view);
+}
+
+DPoint3 parg_zcam_dmatrices(DMatrix4* proj, DMatrix4* view)
+{
+    return parg_zcamera_dmatrices(&_default, proj, view);
+}
+
+void parg_zcam_highprec(Matrix4* vp, Point3* eyepos_lo, Point3* eyepos_hi)
+{
+    parg_zcamera_highprec(&_default, vp, eyepos_lo, eyepos_hi);
+}
+
+Matrix4 parg_zcam_rte_mvp(DPoint3 origin, DMatrix4 model)
+{
+    return parg_zcamera_rte_mvp(&_default, origin, model);
+}
+
+int parg_zcam_has_moved() { return parg_zcamera_has_moved(&_default); }
+
+void parg_zcam_touch() { parg_zcamera_touch(&_default); }
+
+void parg_zcam_set_position(double x, double y, double z)
+{
+    parg_zcamera_set_position(&_default, x, y, z);
+}
@@ -173,11 +173,18 @@ PargApp.prototype.start = function() {
     canvas.addEventListener("DOMMouseScroll", onmouse);
     canvas.addEventListener("wheel", onmouse);
 
+    var lastdraw = -1;
     var raf = function() {
         var milliseconds = window.performance.now();
+        var maxfps = this.module.parg_window_maxfps;
+        if (maxfps > 0 && lastdraw >= 0 && milliseconds - lastdraw < 1000.0 / maxfps) {
+            window.requestAnimationFrame(raf);
+            return;
+        }
         var needs_draw = this.module.Window.tick(milliseconds / 1000.0, window.devicePixelRatio);
         if (needs_draw) {
             this.module.Window.draw();
+            lastdraw = milliseconds;
         }
         window.requestAnimationFrame(raf);
     }.bind(this);